@@ -0,0 +1,41 @@
+#!/bin/sh
+# Matrice de scénarios de référence pour comparer un changement du
+# scheduler ou des codecs avant/après : une ligne JSON par scénario sur la
+# sortie standard (redirigez-la vers un fichier pour garder l'historique).
+#
+# Variables : BENCH_PORT (défaut 5000), BENCH_WORKERS (défaut : nb de cœurs)
+
+PORT=${BENCH_PORT:-5000}
+WORKERS=${BENCH_WORKERS:-$(getconf _NPROCESSORS_ONLN)}
+LOADGEN="./scheduler_loadgen -P $PORT"
+
+# Serveur dédié, sans console (stdin fermé) ni endpoint de métriques
+./scheduler_server -p "$PORT" -w "$WORKERS" -m 0 < /dev/null > /dev/null 2>&1 &
+SERVER=$!
+trap 'kill $SERVER 2>/dev/null; wait $SERVER 2>/dev/null || true' EXIT INT TERM
+
+# Prêt quand une tâche fait l'aller-retour (loadgen sort en erreur tant que
+# la connexion est refusée)
+i=0
+until $LOADGEN -c 1 -n 1 -s fixed:1 -m text:1 -l warmup > /dev/null 2>&1; do
+    i=$((i + 1))
+    if [ $i -ge 50 ]; then
+        echo "Serveur injoignable sur le port $PORT" >&2
+        exit 1
+    fi
+    sleep 0.1
+done
+
+# Petites tâches texte : coût fixe par tâche et par quantum
+$LOADGEN -l small-text    -c 8  -n 64 -s uniform:4K-64K -m text:100
+# Gros fichiers mixtes : débit de compression
+$LOADGEN -l large-mixed   -c 4  -n 4  -s uniform:4M-32M -m text:50,random:50
+# Toutes les priorités en concurrence : équité et latence par classe
+$LOADGEN -l prio-contend  -c 12 -n 8  -s fixed:2M -m text:70,random:30
+# Beaucoup de tâches multiplexées par connexion
+$LOADGEN -l pipelined     -c 2  -n 64 -p 16 -s exp:256K -m text:80,random:20
+# Chemin de transcodage (seulement si ffmpeg est installé) : audio WAV PCM
+# converti en mp3, codec compris
+if command -v ffmpeg > /dev/null 2>&1; then
+    $LOADGEN -l media     -c 4  -n 4  -s fixed:2M -m media:100
+fi
@@ -1,18 +1,57 @@
 #include "admin_console.h"
 #include "log.h"
+#include "scheduler_helpers.h"
+#include "levelctl.h"
+#include "mempool.h"
+#include "metrics.h"
+#include "userauth.h"
+#include "session.h"
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 #include <pthread.h>
 
 typedef struct {
-    NetQueue *queue;
+    WorkerPool *pool;
     bool *running;
 } AdminArg;
 
+static void print_task(NetTask *cur, void *ctx) {
+    (void)ctx;
+    char level[16] = "-";
+    if (cur->type == TASK_COMPRESS && cur->level > 0) snprintf(level, sizeof(level), "%d", cur->level);
+    char cost[16] = "-";
+    if (cur->cost_ns > 0) snprintf(cost, sizeof(cost), "%.2f", cur->cost_ns);
+    printf("ID=%d | Prio=%d | Type=%s | Niveau=%s | %ld/%ld | CPU=%.1f ms | Coût=%s ns/o\n",
+           cur->task_id,
+           cur->user_priority,
+           (cur->type==TASK_COMPRESS?(cur->parallel?"COMP/PAR":"COMP"):"CONV"),
+           level,
+           cur->processed_bytes,
+           cur->total_size,
+           __atomic_load_n(&cur->cpu_ns, __ATOMIC_RELAXED) / 1e6,
+           cost);
+}
+
+static void print_slab(const Slab *s, void *ctx) {
+    (void)ctx;
+    printf("%-12s | %7zu o | utilisés=%ld | hits=%ld | miss=%ld\n",
+           s->name, s->obj_size,
+           __atomic_load_n(&s->in_use, __ATOMIC_RELAXED),
+           __atomic_load_n(&s->hits, __ATOMIC_RELAXED),
+           __atomic_load_n(&s->misses, __ATOMIC_RELAXED));
+}
+
+static void print_session(const char *pseudo, int priority, int conns, int tasks, long bytes,
+                          uint64_t rejected, void *ctx) {
+    (void)ctx;
+    printf("%-16s | Prio=%d | connexions=%d | tâches=%d | %.1f Mio | refus=%llu\n",
+           pseudo, priority, conns, tasks, bytes / (1024.0 * 1024.0), (unsigned long long)rejected);
+}
+
 static void *admin_thread_func(void *arg) {
     AdminArg *a = arg;
-    NetQueue *q = a->queue;
+    WorkerPool *pool = a->pool;
     bool *run = a->running;
     char line[128];
 
@@ -22,68 +61,71 @@ static void *admin_thread_func(void *arg) {
         line[strcspn(line, "\n")] = '\0';
 
         if (strcmp(line, "list") == 0) {
-            pthread_mutex_lock(&q->mutex);
-            printf("=== Tâches (%d) ===\n", q->size);
-            NetTask *cur = q->head;
-            while (cur) {
-                printf("ID=%d | Prio=%d | Type=%s | %ld/%ld\n",
-                       cur->task_id,
-                       cur->user_priority,
-                       (cur->type==TASK_COMPRESS?"COMP":"CONV"),
-                       cur->processed_bytes,
-                       cur->total_size);
-                cur = cur->next;
-            }
+            printf("=== Tâches (%d, + %d en attente de données, + %d en attente du client) - %d workers ===\n",
+                   worker_pool_pending(pool), worker_pool_waiting_input(pool),
+                   worker_pool_waiting_output(pool), pool->nworkers);
+            worker_pool_foreach(pool, print_task, NULL);
+            printf("Niveau Zstd courant : %d (~%.0f Mio/s par worker)\n",
+                   levelctl_level(), levelctl_mbps());
             printf("===============\n");
-            pthread_mutex_unlock(&q->mutex);
         }
         else if (strncmp(line, "kick ", 5) == 0) {
             int tid = atoi(line+5);
-            NetTask *found = NULL;
-            pthread_mutex_lock(&q->mutex);
-            NetTask *prev = NULL, *cur = q->head;
-            while (cur) {
-                if (cur->task_id == tid) {
-                    if (!prev) {
-                        q->head = cur->next;
-                        if (!q->head) q->tail = NULL;
-                    } else {
-                        prev->next = cur->next;
-                        if (!prev->next) q->tail = prev;
-                    }
-                    q->size--;
-                    found = cur;
-                    break;
-                }
-                prev = cur;
-                cur = cur->next;
-            }
-            pthread_mutex_unlock(&q->mutex);
+            NetTask *found = worker_pool_remove(pool, tid);
             if (found) {
-                log_internal("Admin kick %d", tid);
-                nettask_free(found);
+                log_msg(LOG_INFO, tid, "Admin kick");
+                task_abort(found, "Tâche retirée par l'administrateur");
+                metrics_inc(M_TASKS_ABORTED);
+                // Blocs encore en compression : le dernier worker la libère
+                if (!found->parallel || parallel_compress_abandon(found)) nettask_free(found);
                 printf("Tâche %d retirée\n", tid);
             } else {
                 printf("ID %d introuvable\n", tid);
             }
         }
+        else if (strcmp(line, "stats") == 0) {
+            printf("=== Statistiques ===\n");
+            metrics_write(stdout, false);
+            printf("===============\n");
+        }
+        else if (strcmp(line, "pools") == 0) {
+            printf("=== Pools mémoire ===\n");
+            slab_foreach(print_slab, NULL);
+            printf("===============\n");
+        }
+        else if (strcmp(line, "sessions") == 0) {
+            printf("=== Sessions (%d) ===\n", session_count());
+            for (int p = 0; p < NETQUEUE_PRIORITIES; p++) {
+                SessionLimits l;
+                session_get_limits(p, &l);
+                printf("Quotas prio %d : %d connexions, %d tâches, %ld Mio (0 = illimité)\n",
+                       p, l.max_conns, l.max_tasks, l.max_mb);
+            }
+            session_foreach(print_session, NULL);
+            printf("===============\n");
+        }
+        else if (strcmp(line, "reload") == 0) {
+            // Relu par le thread de l'annuaire : la console ne bloque pas
+            userauth_request_reload();
+            printf("Rechargement de l'annuaire demandé (%d utilisateurs actuellement)\n", userauth_count());
+        }
         else if (strcmp(line, "quit") == 0) {
             *run = false;
             log_internal("Admin quit");
             break;
         }
         else {
-            printf("Commandes: list - kick <id> - quit\n");
+            printf("Commandes: list - kick <id> - stats - pools - sessions - reload - quit\n");
         }
     }
     free(a);
     return NULL;
 }
 
-void start_admin_console(NetQueue *q, bool *server_running) {
+void start_admin_console(WorkerPool *pool, bool *server_running) {
     pthread_t tid;
     AdminArg *arg = malloc(sizeof(AdminArg));
-    arg->queue = q;
+    arg->pool = pool;
     arg->running = server_running;
     if (pthread_create(&tid, NULL, admin_thread_func, arg) != 0) {
         perror("pthread_create admin_console");
@@ -2,8 +2,8 @@
 #define ADMIN_CONSOLE_H
 
 #include <stdbool.h>
-#include "netqueue.h"
+#include "worker_pool.h"
 
-void start_admin_console(NetQueue *q, bool *server_running);
+void start_admin_console(WorkerPool *pool, bool *server_running);
 
 #endif // ADMIN_CONSOLE_H
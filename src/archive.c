@@ -0,0 +1,316 @@
+#define _GNU_SOURCE
+#include "archive.h"
+#include "utils.h"
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Le préchargeur ne prend pas plus d'avance que cela sur l'émetteur
+#define ARCHIVE_LOOKAHEAD 64
+#define ARCHIVE_MAX_BUFFERED (8 * 1024 * 1024)
+// Lecture anticipée demandée au noyau pour le début d'un gros fichier
+#define ARCHIVE_READAHEAD (4 * 1024 * 1024)
+#define ARCHIVE_MAX_NAME 4095
+
+static const char LONGLINK_NAME[] = "././@LongLink";
+
+static int add_entry(Archive *a, const char *path, const char *name, const struct stat *st) {
+    if (a->count == a->cap) {
+        size_t cap = a->cap ? a->cap * 2 : 64;
+        ArchiveEntry *n = realloc(a->entries, cap * sizeof(*n));
+        if (!n) return -1;
+        a->entries = n;
+        a->cap = cap;
+    }
+    ArchiveEntry *e = &a->entries[a->count];
+    memset(e, 0, sizeof(*e));
+    e->path = strdup(path);
+    e->name = strdup(name);
+    if (!e->path || !e->name) {
+        free(e->path);
+        free(e->name);
+        return -1;
+    }
+    e->is_dir = S_ISDIR(st->st_mode);
+    e->size = e->is_dir ? 0 : (uint64_t)st->st_size;
+    e->mode = st->st_mode & 07777;
+    e->mtime = st->st_mtime;
+    e->fd = -1;
+    e->state = e->is_dir ? ARCHIVE_READY : ARCHIVE_PENDING;
+    a->count++;
+    a->total_size += archive_header_size(e);
+    if (!e->is_dir) a->total_size += e->size + archive_padding(e->size);
+    return 0;
+}
+
+static int cmp_names(const void *x, const void *y) {
+    return strcmp(*(char *const *)x, *(char *const *)y);
+}
+
+// Dossier path (déjà ajouté sous name) : ajoute ses enfants, triés, en profondeur
+static int scan_dir(Archive *a, const char *path, const char *name) {
+    DIR *d = opendir(path);
+    if (!d) return 0;       // illisible : reste vide dans l'archive
+    char **kids = NULL;
+    size_t nk = 0, ck = 0;
+    struct dirent *de;
+    while ((de = readdir(d))) {
+        if (strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0) continue;
+        if (nk == ck) {
+            ck = ck ? ck * 2 : 16;
+            char **n = realloc(kids, ck * sizeof(*n));
+            if (!n) break;
+            kids = n;
+        }
+        if (!(kids[nk] = strdup(de->d_name))) break;
+        nk++;
+    }
+    closedir(d);
+    qsort(kids, nk, sizeof(*kids), cmp_names);
+
+    int rc = 0;
+    for (size_t i = 0; i < nk; i++) {
+        char cpath[PATH_MAX], cname[ARCHIVE_MAX_NAME + 2];
+        struct stat st;
+        int lp = snprintf(cpath, sizeof(cpath), "%s/%s", path, kids[i]);
+        int ln = snprintf(cname, sizeof(cname), "%s%s", name, kids[i]);
+        free(kids[i]);
+        if (rc < 0 || lp >= (int)sizeof(cpath) || ln > ARCHIVE_MAX_NAME - 1) continue;
+        if (lstat(cpath, &st) < 0) continue;
+        if (S_ISREG(st.st_mode)) {
+            rc = add_entry(a, cpath, cname, &st);
+        } else if (S_ISDIR(st.st_mode)) {
+            strcat(cname, "/");
+            rc = add_entry(a, cpath, cname, &st);
+            if (rc == 0) rc = scan_dir(a, cpath, cname);
+        }
+    }
+    free(kids);
+    return rc;
+}
+
+int archive_scan(Archive *a, const char *root) {
+    memset(a, 0, sizeof(*a));
+    pthread_mutex_init(&a->lock, NULL);
+    pthread_cond_init(&a->cond, NULL);
+    struct stat st;
+    if (stat(root, &st) < 0 || !S_ISDIR(st.st_mode)) return -1;
+
+    // Les entrées sont nommées à partir du dernier composant de root
+    char base[ARCHIVE_MAX_NAME + 2];
+    size_t len = strlen(root);
+    while (len > 1 && root[len - 1] == '/') len--;
+    size_t start = len;
+    while (start > 0 && root[start - 1] != '/') start--;
+    size_t blen = len - start;
+    if (blen == 0 || blen > 255 || root[start] == '/' ||
+        (root[start] == '.' && (blen == 1 || (blen == 2 && root[start + 1] == '.')))) {
+        snprintf(base, sizeof(base), "archive/");
+    } else {
+        snprintf(base, sizeof(base), "%.*s/", (int)blen, root + start);
+    }
+
+    if (add_entry(a, root, base, &st) < 0 || scan_dir(a, root, base) < 0) {
+        archive_free(a);
+        return -1;
+    }
+    a->total_size += ARCHIVE_TRAILER;
+    return 0;
+}
+
+// Prépare une entrée, hors verrou : contenu d'un petit fichier ou
+// descripteur d'un gros. Retourne son état, publié ensuite sous a->lock.
+static int fetch_entry(const ArchiveEntry *e, void **data, int *fdp) {
+    *data = NULL;
+    *fdp = -1;
+    int fd = open(e->path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return ARCHIVE_FAILED;
+    if (e->size <= ARCHIVE_SMALL_FILE) {
+        void *buf = calloc(1, e->size ? e->size : 1);
+        bool ok = buf && read_n_bytes(fd, buf, e->size) >= 0;
+        close(fd);
+        if (!ok) {
+            free(buf);
+            return ARCHIVE_FAILED;
+        }
+        *data = buf;
+        return ARCHIVE_READY;
+    }
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    posix_fadvise(fd, 0, e->size < ARCHIVE_READAHEAD ? e->size : ARCHIVE_READAHEAD,
+                  POSIX_FADV_WILLNEED);
+    *fdp = fd;
+    return ARCHIVE_READY;
+}
+
+static void *prefetch_thread(void *arg) {
+    Archive *a = arg;
+    pthread_mutex_lock(&a->lock);
+    while (!a->stop && a->next_fetch < a->count) {
+        if (a->next_fetch >= a->next_consume + ARCHIVE_LOOKAHEAD ||
+            a->buffered >= ARCHIVE_MAX_BUFFERED) {
+            pthread_cond_wait(&a->cond, &a->lock);
+            continue;
+        }
+        ArchiveEntry *e = &a->entries[a->next_fetch++];
+        if (e->is_dir) continue;
+        pthread_mutex_unlock(&a->lock);
+        void *data;
+        int fd;
+        int state = fetch_entry(e, &data, &fd);
+        // Publication sous verrou : archive_wait voit data et fd avec l'état
+        pthread_mutex_lock(&a->lock);
+        e->data = data;
+        e->fd = fd;
+        e->state = state;
+        if (e->data) a->buffered += e->size;
+        pthread_cond_broadcast(&a->cond);
+    }
+    pthread_mutex_unlock(&a->lock);
+    return NULL;
+}
+
+int archive_prefetch_start(Archive *a, int nthreads) {
+    if (nthreads < 1) nthreads = 1;
+    if (nthreads > ARCHIVE_PREFETCH_THREADS) nthreads = ARCHIVE_PREFETCH_THREADS;
+    for (int i = 0; i < nthreads; i++) {
+        if (pthread_create(&a->threads[i], NULL, prefetch_thread, a) != 0) break;
+        a->nthreads++;
+    }
+    return a->nthreads > 0 ? 0 : -1;
+}
+
+ArchiveEntry *archive_wait(Archive *a, size_t i) {
+    ArchiveEntry *e = &a->entries[i];
+    pthread_mutex_lock(&a->lock);
+    while (e->state == ARCHIVE_PENDING) pthread_cond_wait(&a->cond, &a->lock);
+    pthread_mutex_unlock(&a->lock);
+    return e;
+}
+
+static void entry_drop(ArchiveEntry *e) {
+    free(e->data);
+    e->data = NULL;
+    if (e->fd >= 0) close(e->fd);
+    e->fd = -1;
+}
+
+void archive_release(Archive *a, size_t i) {
+    ArchiveEntry *e = &a->entries[i];
+    pthread_mutex_lock(&a->lock);
+    if (e->data) a->buffered -= e->size;
+    entry_drop(e);
+    a->next_consume = i + 1;
+    pthread_cond_broadcast(&a->cond);
+    pthread_mutex_unlock(&a->lock);
+}
+
+// width - 1 chiffres octaux puis NUL
+static void put_octal(char *field, size_t width, uint64_t v) {
+    field[width - 1] = '\0';
+    for (size_t i = width - 1; i-- > 0; v >>= 3) field[i] = (char)('0' + (v & 7));
+}
+
+// Taille : octal sur 11 chiffres jusqu'à 8 Gio, base 256 (extension GNU) au-delà
+static void put_size(char *field, uint64_t v) {
+    if (v < 077777777777ULL) {
+        put_octal(field, 12, v);
+        return;
+    }
+    memset(field, 0, 12);
+    field[0] = (char)0x80;
+    for (int i = 11; i >= 4; i--) {
+        field[i] = (char)(v & 0xff);
+        v >>= 8;
+    }
+}
+
+static void put_checksum(uint8_t *h) {
+    unsigned sum = 0;
+    memset(h + 148, ' ', 8);
+    for (int i = 0; i < ARCHIVE_BLOCK; i++) sum += h[i];
+    snprintf((char *)h + 148, 8, "%06o", sum);
+    h[155] = ' ';
+}
+
+static void fill_header(uint8_t *h, const char *name, const char *prefix, char type,
+                        mode_t mode, uint64_t size, time_t mtime) {
+    memset(h, 0, ARCHIVE_BLOCK);
+    memcpy(h, name, strnlen(name, 100));
+    put_octal((char *)h + 100, 8, mode);
+    put_octal((char *)h + 108, 8, 0);
+    put_octal((char *)h + 116, 8, 0);
+    put_size((char *)h + 124, size);
+    put_octal((char *)h + 136, 12, mtime > 0 ? (uint64_t)mtime : 0);
+    h[156] = (uint8_t)type;
+    memcpy(h + 257, "ustar", 6);
+    memcpy(h + 263, "00", 2);
+    if (prefix) memcpy(h + 345, prefix, strnlen(prefix, 155));
+    put_checksum(h);
+}
+
+// Découpage ustar prefix/name : position du '/' séparateur, 0 si le nom tient
+// tel quel, -1 s'il faut une entrée de nom long.
+static int split_name(const char *name) {
+    size_t len = strlen(name);
+    if (len <= 100) return 0;
+    // Le '/' final d'un dossier reste dans la partie name (jamais vide)
+    for (size_t k = len - 101; k <= 155 && k + 2 <= len; k++) {
+        if (k > 0 && name[k] == '/') return (int)k;
+    }
+    return -1;
+}
+
+size_t archive_header_size(const ArchiveEntry *e) {
+    if (split_name(e->name) >= 0) return ARCHIVE_BLOCK;
+    size_t n = strlen(e->name) + 1;
+    return 2 * ARCHIVE_BLOCK + n + archive_padding(n);
+}
+
+size_t archive_header(const ArchiveEntry *e, uint8_t *buf, size_t cap) {
+    size_t need = archive_header_size(e);
+    if (need > cap) return 0;
+    char type = e->is_dir ? '5' : '0';
+    int split = split_name(e->name);
+    if (split == 0) {
+        fill_header(buf, e->name, NULL, type, e->mode, e->size, e->mtime);
+    } else if (split > 0) {
+        char prefix[156];
+        memcpy(prefix, e->name, split);
+        prefix[split] = '\0';
+        fill_header(buf, e->name + split + 1, prefix, type, e->mode, e->size, e->mtime);
+    } else {
+        // Entrée GNU « L » : le nom complet en données, puis l'en-tête réel
+        size_t n = strlen(e->name) + 1;
+        fill_header(buf, LONGLINK_NAME, NULL, 'L', 0644, n, 0);
+        memset(buf + ARCHIVE_BLOCK, 0, n + archive_padding(n));
+        memcpy(buf + ARCHIVE_BLOCK, e->name, n);
+        fill_header(buf + need - ARCHIVE_BLOCK, e->name, NULL, type, e->mode, e->size, e->mtime);
+    }
+    return need;
+}
+
+void archive_free(Archive *a) {
+    pthread_mutex_lock(&a->lock);
+    a->stop = true;
+    pthread_cond_broadcast(&a->cond);
+    pthread_mutex_unlock(&a->lock);
+    for (int i = 0; i < a->nthreads; i++) pthread_join(a->threads[i], NULL);
+    a->nthreads = 0;
+    for (size_t i = 0; i < a->count; i++) {
+        entry_drop(&a->entries[i]);
+        free(a->entries[i].path);
+        free(a->entries[i].name);
+    }
+    free(a->entries);
+    a->entries = NULL;
+    a->count = a->cap = 0;
+    pthread_mutex_destroy(&a->lock);
+    pthread_cond_destroy(&a->cond);
+}
@@ -0,0 +1,76 @@
+#ifndef ARCHIVE_H
+#define ARCHIVE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/types.h>
+
+// Archive d'un dossier au format tar (ustar, noms longs à la GNU) produite au
+// fil de l'envoi : le parcours calcule d'avance la taille exacte du flux, les
+// en-têtes sont générés à la volée et le contenu des fichiers est préparé par
+// quelques threads en avance sur l'émetteur (lecture en mémoire des petits
+// fichiers, ouverture et lecture anticipée des gros).
+#define ARCHIVE_BLOCK 512
+#define ARCHIVE_TRAILER (2 * ARCHIVE_BLOCK)
+#define ARCHIVE_SMALL_FILE (64 * 1024)      // au-delà : envoyé depuis le fd (sendfile)
+#define ARCHIVE_PREFETCH_THREADS 4
+#define ARCHIVE_MAX_HEADER (4 * ARCHIVE_BLOCK + 4096)
+
+enum { ARCHIVE_PENDING, ARCHIVE_READY, ARCHIVE_FAILED };
+
+typedef struct {
+    char *path;         // chemin local
+    char *name;         // chemin dans l'archive (« dossier/... », '/' final pour un dossier)
+    bool is_dir;
+    uint64_t size;      // taille relevée au parcours, celle annoncée dans l'en-tête
+    mode_t mode;
+    time_t mtime;
+    // Rempli par le préchargeur
+    int state;
+    int fd;             // gros fichier ouvert, ou -1
+    void *data;         // petit fichier : size octets (complétés de zéros s'il a rétréci)
+} ArchiveEntry;
+
+typedef struct {
+    ArchiveEntry *entries;
+    size_t count, cap;
+    uint64_t total_size;        // taille exacte du flux tar
+    pthread_t threads[ARCHIVE_PREFETCH_THREADS];
+    int nthreads;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    size_t next_fetch;          // prochaine entrée à préparer
+    size_t next_consume;        // prochaine entrée attendue par l'émetteur
+    size_t buffered;            // octets de petits fichiers en mémoire
+    bool stop;
+} Archive;
+
+// Parcourt root (dossiers et fichiers réguliers ; liens et fichiers spéciaux
+// ignorés) dans l'ordre alphabétique. Retourne -1 si root n'est pas un
+// dossier lisible.
+int archive_scan(Archive *a, const char *root);
+
+// Lance le préchargement (nthreads borné à ARCHIVE_PREFETCH_THREADS).
+int archive_prefetch_start(Archive *a, int nthreads);
+
+// Attend que l'entrée i (consommées dans l'ordre) soit prête ou en échec.
+ArchiveEntry *archive_wait(Archive *a, size_t i);
+
+// L'émetteur a fini l'entrée i : libère son contenu, le préchargeur avance.
+void archive_release(Archive *a, size_t i);
+
+// En-tête de e (précédé de l'entrée de nom long si besoin). Retourne sa
+// longueur, multiple de ARCHIVE_BLOCK.
+size_t archive_header(const ArchiveEntry *e, uint8_t *buf, size_t cap);
+size_t archive_header_size(const ArchiveEntry *e);
+
+static inline size_t archive_padding(uint64_t size) {
+    return (ARCHIVE_BLOCK - size % ARCHIVE_BLOCK) % ARCHIVE_BLOCK;
+}
+
+// Arrête le préchargeur et libère tout.
+void archive_free(Archive *a);
+
+#endif // ARCHIVE_H
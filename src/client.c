@@ -11,30 +11,303 @@
 #include <pthread.h>
 #include <sys/stat.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/mman.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 
 #include "utils.h"
 #include "log.h"
+#include "protocol.h"
+#include "archive.h"
 
 #define DEFAULT_SERVER_PORT 5000
+#define CLIENT_MAX_STREAMS 64       // CONN_MAX_STREAMS côté serveur
+#define DEFAULT_BATCH_CONNS 1
+#define DEFAULT_BATCH_JOBS 8
+// Envoi : une trame DATA couvre ce que la fenêtre du serveur autorise, entre
+// SEND_MIN (on attend plutôt que d'émettre des miettes) et SEND_MAX octets.
+#define CLIENT_SEND_MIN PROTO_DATA_CHUNK
+#define CLIENT_SEND_MAX (256 * 1024)
+// Réception : tampon agrandi au besoin jusqu'à une trame complète
+#define CLIENT_RBUF_INITIAL (256 * 1024)
+// SO_SNDBUF / SO_RCVBUF, de quoi couvrir le produit débit × RTT d'un lien 10 GbE
+#define CLIENT_SOCKBUF (4 * 1024 * 1024)
+// Au-delà, compression par blocs en parallèle demandée au serveur (sortie seekable)
+#define CLIENT_PARALLEL_MIN (64L * 1024 * 1024)
+// À partir de cette taille, le fichier est empreinté (XXH64) : le serveur peut
+// resservir un résultat déjà calculé sans que le contenu soit renvoyé
+#define CLIENT_HASH_MIN (1L * 1024 * 1024)
+// À partir de cette taille, une compression simple est reprenable : le jeton
+// reçu est noté dans <sortie>.resume et la prochaine soumission du même
+// fichier reprend là où la connexion a été perdue
+#define CLIENT_RESUME_MIN (16L * 1024 * 1024)
 
 static bool is_connected = false;
 static int server_fd = -1;
 static int user_priority = 2;
 
+struct ClientConn;
+
 // ------------------------------------------------------------------------------------------------
 // Définition du type TransferArg (à placer tout en haut) :
-//   Ce struct est utilisé par les deux threads (send et recv) pour savoir quel fichier ouvrir, 
-//   quel socket utiliser, etc.
+//   Une tâche en cours. Le thread d'envoi lit local_path ; le thread de réception de la
+//   connexion écrit dans out_fd les trames DATA de la tâche et la termine sur END ou ERROR.
 // ------------------------------------------------------------------------------------------------
-typedef struct {
-    int sockfd;         // descripteur du socket vers le serveur
+typedef struct TransferArg {
+    struct ClientConn *conn;    // connexion qui porte la tâche
     char *local_path;   // chemin complet du fichier local à lire (source)
+    Archive *archive;   // dossier : flux tar produit à l'envoi (NULL pour un fichier)
+    int unreadable;     // fichiers du dossier illisibles, envoyés remplis de zéros
+    bool parallel;      // compression par blocs demandée (PROTO_TASK_PARALLEL)
     long total_size;    // taille totale du fichier source (en octets)
     char *output_path;  // chemin complet du fichier de sortie (où écrire le flux reçu)
+    int out_fd;         // fichier de sortie ouvert (préalloué), fermé à la fin de la tâche
+    uint32_t stream_id; // identifiant de la tâche dans les trames
+    long window;        // octets que le serveur accepte encore (contrôle de flux)
+    bool finished;      // END ou ERROR reçu : l'envoi peut s'arrêter
+    bool cached;        // résultat resservi par le cache du serveur : rien à envoyer
+    bool accepted;      // FRAME_ACCEPT reçu
+    bool resuming;      // reprise demandée : l'envoi attend l'offset de FRAME_ACCEPT
+    uint64_t resume_token;      // jeton de reprise (0 : tâche non reprenable)
+    uint64_t resume_have;       // sortie déjà présente localement
+    uint64_t resume_in;         // entrée à partir de laquelle envoyer
+    bool resumed;               // reprise acceptée par le serveur
+    bool failed;        // ERROR reçu, ou connexion perdue
+    char error[128];
+    uint64_t bytes_sent, bytes_recv;
+    uint32_t dict_id;   // dictionnaire Zstd nécessaire pour décompresser (0 : aucun)
+    uint64_t t_start, t_end;    // µs, horloge monotone
+    pthread_t sender;
+    bool has_sender;
+    struct TransferArg *next;   // file des tâches terminées (mode batch)
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
 } TransferArg;
 
+// ------------------------------------------------------------------------------------------------
+// Une connexion au serveur : un thread de réception (thread_recv_func) répartit les trames
+// entre les tâches en cours, chaque tâche a son thread d'envoi (thread_send_func).
+// ------------------------------------------------------------------------------------------------
+typedef struct ClientConn {
+    int fd;
+    pthread_mutex_t wlock;      // une trame sortante à la fois
+    pthread_mutex_t lock;       // streams, nstreams, dead
+    TransferArg *streams[CLIENT_MAX_STREAMS];
+    int nstreams;
+    bool dead;                  // plus de réception possible
+    uint32_t next_stream_id;
+    pthread_t reader;
+    void (*on_done)(TransferArg *t);    // fin d'une tâche (NULL : on attend avec transfer_wait)
+} ClientConn;
+
+static ClientConn *ui_conn = NULL;
+
+static uint64_t now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000u + (uint64_t)ts.tv_nsec / 1000u;
+}
+
+static TransferArg *transfer_new(const char *local, long size, const char *output) {
+    TransferArg *t = calloc(1, sizeof(*t));
+    if (!t) return NULL;
+    t->local_path = strdup(local);
+    t->total_size = size;
+    t->output_path = strdup(output);
+    t->out_fd = -1;
+    t->window = PROTO_INITIAL_WINDOW;
+    pthread_mutex_init(&t->lock, NULL);
+    pthread_cond_init(&t->cond, NULL);
+    return t;
+}
+
+static void transfer_free(TransferArg *t) {
+    if (t->out_fd >= 0) close(t->out_fd);
+    if (t->archive) {
+        archive_free(t->archive);
+        free(t->archive);
+    }
+    pthread_mutex_destroy(&t->lock);
+    pthread_cond_destroy(&t->cond);
+    free(t->local_path);
+    free(t->output_path);
+    free(t);
+}
+
+// ------------------------------------------------------------------------------------------------
+// Prépare la tâche de compression de path : un fichier régulier est envoyé tel quel (sortie
+// <path>.zst), un dossier est parcouru et envoyé comme une archive tar (sortie <path>.tar.zst),
+// son préchargement démarre aussitôt. Retourne NULL (motif dans err) sinon.
+// ------------------------------------------------------------------------------------------------
+static TransferArg *transfer_open(const char *path, char *err, size_t errlen) {
+    char clean[PROTO_MAX_NAME], out[PROTO_MAX_NAME + 16];
+    snprintf(clean, sizeof(clean), "%s", path);
+    size_t len = strlen(clean);
+    while (len > 1 && clean[len - 1] == '/') clean[--len] = '\0';
+
+    struct stat st;
+    if (stat(clean, &st) < 0) {
+        snprintf(err, errlen, "introuvable ou illisible");
+        return NULL;
+    }
+    if (S_ISREG(st.st_mode)) {
+        snprintf(out, sizeof(out), "%s.zst", clean);
+        TransferArg *t = transfer_new(clean, (long)st.st_size, out);
+        if (!t) snprintf(err, errlen, "mémoire insuffisante");
+        else t->parallel = t->total_size >= CLIENT_PARALLEL_MIN;
+        return t;
+    }
+    if (!S_ISDIR(st.st_mode)) {
+        snprintf(err, errlen, "ni fichier régulier ni dossier");
+        return NULL;
+    }
+    Archive *a = malloc(sizeof(*a));
+    if (!a || archive_scan(a, clean) < 0) {
+        snprintf(err, errlen, "dossier illisible");
+        free(a);
+        return NULL;
+    }
+    snprintf(out, sizeof(out), "%s.tar.zst", clean);
+    TransferArg *t = transfer_new(clean, (long)a->total_size, out);
+    if (!t || archive_prefetch_start(a, ARCHIVE_PREFETCH_THREADS) < 0) {
+        snprintf(err, errlen, "mémoire insuffisante");
+        archive_free(a);
+        free(a);
+        if (t) transfer_free(t);
+        return NULL;
+    }
+    t->archive = a;
+    t->parallel = t->total_size >= CLIENT_PARALLEL_MIN;
+    return t;
+}
+
+// Attend que la fenêtre du serveur autorise au moins min octets et en réserve
+// jusqu'à max. Retourne le nombre d'octets réservés, 0 si la tâche est
+// terminée côté serveur ou servie par son cache.
+static long transfer_reserve(TransferArg *t, long min, long max) {
+    pthread_mutex_lock(&t->lock);
+    while (t->window < min && !t->finished && !t->cached) pthread_cond_wait(&t->cond, &t->lock);
+    long n = 0;
+    if (!t->finished && !t->cached) {
+        n = t->window < max ? t->window : max;
+        t->window -= n;
+    }
+    pthread_mutex_unlock(&t->lock);
+    return n;
+}
+
+// Note de reprise d'une sortie : <sortie>.resume, « jeton taille mtime » de la source
+static void resume_note_path(const TransferArg *t, char *buf, size_t len) {
+    snprintf(buf, len, "%s.resume", t->output_path);
+}
+
+static long long source_mtime(const TransferArg *t) {
+    struct stat st;
+    return stat(t->local_path, &st) == 0 ? (long long)st.st_mtime : -1;
+}
+
+// Reprise possible si la note correspond à la source et que la sortie existe
+static bool resume_note_load(TransferArg *t) {
+    char path[PROTO_MAX_NAME + 32];
+    resume_note_path(t, path, sizeof(path));
+    FILE *f = fopen(path, "r");
+    if (!f) return false;
+    unsigned long long token;
+    long size;
+    long long mtime;
+    struct stat st;
+    bool ok = fscanf(f, "%llx %ld %lld", &token, &size, &mtime) == 3 && token != 0 &&
+              size == t->total_size && mtime == source_mtime(t) && stat(t->output_path, &st) == 0;
+    fclose(f);
+    if (ok) {
+        t->resume_token = token;
+        t->resume_have = (uint64_t)st.st_size;
+    }
+    return ok;
+}
+
+static void resume_note_save(const TransferArg *t) {
+    char path[PROTO_MAX_NAME + 32];
+    resume_note_path(t, path, sizeof(path));
+    FILE *f = fopen(path, "w");
+    if (!f) return;
+    fprintf(f, "%016llx %ld %lld\n", (unsigned long long)t->resume_token, t->total_size, source_mtime(t));
+    fclose(f);
+}
+
+static void resume_note_drop(const TransferArg *t) {
+    char path[PROTO_MAX_NAME + 32];
+    resume_note_path(t, path, sizeof(path));
+    unlink(path);
+}
+
+// Termine la tâche (thread de réception seul). error == NULL : succès.
+// En mode batch, t appartient ensuite au thread principal.
+static void transfer_finish(TransferArg *t, const char *error) {
+    void (*done)(TransferArg *) = t->conn->on_done;
+    if (t->out_fd >= 0) {
+        // Rend la place préallouée au-delà de ce qui a été reçu
+        if (ftruncate(t->out_fd, (off_t)t->bytes_recv) < 0) error = error ? error : strerror(errno);
+        close(t->out_fd);
+        t->out_fd = -1;
+    }
+    // Succès : la note de reprise n'a plus d'objet ; échec : elle reste
+    if (!error && !t->failed && t->resume_token) resume_note_drop(t);
+    pthread_mutex_lock(&t->lock);
+    t->t_end = now_us();
+    if (error) {
+        t->failed = true;
+        snprintf(t->error, sizeof(t->error), "%s", error);
+    }
+    t->finished = true;
+    pthread_cond_broadcast(&t->cond);
+    pthread_mutex_unlock(&t->lock);
+    if (done) done(t);
+}
+
+// Attend la fin de la tâche et de son thread d'envoi
+static void transfer_wait(TransferArg *t) {
+    pthread_mutex_lock(&t->lock);
+    while (!t->finished) pthread_cond_wait(&t->cond, &t->lock);
+    pthread_mutex_unlock(&t->lock);
+    if (t->has_sender) pthread_join(t->sender, NULL);
+}
+
+static int conn_send(ClientConn *c, uint8_t type, uint32_t task_id, const void *payload, uint32_t len) {
+    pthread_mutex_lock(&c->wlock);
+    int rc = proto_send(c->fd, type, task_id, payload, len);
+    pthread_mutex_unlock(&c->wlock);
+    return rc;
+}
+
+// Trame DATA lue directement dans le fichier source (sendfile). Sur échec la
+// trame est tronquée : la connexion est coupée.
+static int conn_send_file(ClientConn *c, uint32_t task_id, int file_fd, off_t offset, uint32_t len) {
+    pthread_mutex_lock(&c->wlock);
+    int rc = proto_send_file(c->fd, FRAME_DATA, task_id, file_fd, offset, len);
+    if (rc < 0) shutdown(c->fd, SHUT_RDWR);
+    pthread_mutex_unlock(&c->wlock);
+    return rc;
+}
+
+static TransferArg *conn_find_stream(ClientConn *c, uint32_t stream, bool take) {
+    TransferArg *t = NULL;
+    pthread_mutex_lock(&c->lock);
+    for (int i = 0; i < c->nstreams; i++) {
+        if (c->streams[i]->stream_id == stream) {
+            t = c->streams[i];
+            if (take) c->streams[i] = c->streams[--c->nstreams];
+            break;
+        }
+    }
+    pthread_mutex_unlock(&c->lock);
+    return t;
+}
+
 // ------------------------------------------------------------------------------------------------
 // Vérifie si un programme existe dans le PATH (via la commande “which <prog>”).
 // Retourne true si “which <prog>” renvoie 0, sinon false.
@@ -96,95 +369,546 @@ static void install_dependencies_if_needed() {
     noecho();
     keypad(stdscr, TRUE);
 }
-
 // ------------------------------------------------------------------------------------------------
-// Tente de se connecter au serveur à l’adresse IP donnée (argv[1]).
-// Retourne true si la connexion (socket + connect()) réussit, false sinon.
-// Affiche un message à l'écran via ncurses pour indiquer la progression.
+// Ouvre une connexion TCP vers ip:port. Retourne le descripteur, ou -1.
 // ------------------------------------------------------------------------------------------------
-bool connect_to_server(const char *server_ip) {
+static int open_server_socket(const char *server_ip, int port) {
     struct sockaddr_in serv;
-    server_fd = socket(AF_INET, SOCK_STREAM, 0);
-    if (server_fd < 0) {
-        return false;
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return -1;
     }
+    // Avant connect() : la taille de SO_RCVBUF fixe le facteur d'échelle de fenêtre TCP
+    int sockbuf = CLIENT_SOCKBUF;
+    setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &sockbuf, sizeof(sockbuf));
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &sockbuf, sizeof(sockbuf));
     memset(&serv, 0, sizeof(serv));
     serv.sin_family = AF_INET;
-    serv.sin_port = htons(DEFAULT_SERVER_PORT);
-    if (inet_pton(AF_INET, server_ip, &serv.sin_addr) <= 0) {
-        close(server_fd);
-        return false;
+    serv.sin_port = htons(port);
+    if (inet_pton(AF_INET, server_ip, &serv.sin_addr) <= 0 ||
+        connect(fd, (struct sockaddr*)&serv, sizeof(serv)) < 0) {
+        close(fd);
+        return -1;
     }
+    return fd;
+}
 
+// ------------------------------------------------------------------------------------------------
+// Tente de se connecter au serveur à l’adresse IP donnée (argv[1]).
+// Retourne true si la connexion (socket + connect()) réussit, false sinon.
+// Affiche un message à l'écran via ncurses pour indiquer la progression.
+// ------------------------------------------------------------------------------------------------
+bool connect_to_server(const char *server_ip) {
     // Affichage ncurses : “Connexion en cours…”
     mvprintw(10, 4, "Connexion au serveur %s:%d...", server_ip, DEFAULT_SERVER_PORT);
     refresh();
 
-    if (connect(server_fd, (struct sockaddr*)&serv, sizeof(serv)) < 0) {
-        return false;
+    server_fd = open_server_socket(server_ip, DEFAULT_SERVER_PORT);
+    return server_fd >= 0;
+}
+
+// ------------------------------------------------------------------------------------------------
+// Envoie la trame AUTH (charge = pseudo) et lit la réponse du serveur.
+// Retourne la priorité accordée, ou -1 (message du serveur dans err).
+// ------------------------------------------------------------------------------------------------
+static int authenticate(int fd, const char *pseudo, char *err, size_t errlen) {
+    char resp[256];
+    ProtoHeader h;
+    snprintf(err, errlen, "aucune réponse du serveur");
+    if (proto_send(fd, FRAME_AUTH, 0, pseudo, (uint32_t)strlen(pseudo)) < 0 ||
+        proto_recv(fd, &h, resp, sizeof(resp) - 1) < 0) {
+        return -1;
+    }
+    resp[h.length] = '\0';
+    if (h.type == FRAME_AUTH_OK && h.length == 4) {
+        return (int)get_u32((uint8_t *)resp);
+    }
+    snprintf(err, errlen, "%s", resp);
+    return -1;
+}
+
+void *thread_recv_func(void *arg);
+
+// Prend en charge une connexion authentifiée et lance son thread de réception
+static ClientConn *client_conn_new(int fd, void (*on_done)(TransferArg *)) {
+    ClientConn *c = calloc(1, sizeof(*c));
+    if (!c) return NULL;
+    c->fd = fd;
+    c->next_stream_id = 1;
+    c->on_done = on_done;
+    pthread_mutex_init(&c->wlock, NULL);
+    pthread_mutex_init(&c->lock, NULL);
+    if (pthread_create(&c->reader, NULL, thread_recv_func, c) != 0) {
+        pthread_mutex_destroy(&c->wlock);
+        pthread_mutex_destroy(&c->lock);
+        free(c);
+        return NULL;
     }
+    return c;
+}
 
-    return true;
+// Envoie BYE, coupe le socket (ce qui arrête le thread de réception) et libère
+static void client_conn_close(ClientConn *c) {
+    conn_send(c, FRAME_BYE, 0, NULL, 0);
+    shutdown(c->fd, SHUT_RDWR);
+    pthread_join(c->reader, NULL);
+    close(c->fd);
+    pthread_mutex_destroy(&c->wlock);
+    pthread_mutex_destroy(&c->lock);
+    free(c);
 }
 
-// Ferme la connexion proprement (envoie “BYE\n” puis close(fd))
+// Tâches en cours sur la connexion, ou -1 si elle est perdue
+static int client_conn_load(ClientConn *c) {
+    pthread_mutex_lock(&c->lock);
+    int n = c->dead ? -1 : c->nstreams;
+    pthread_mutex_unlock(&c->lock);
+    return n;
+}
+
+// Ferme la connexion proprement (envoie une trame BYE puis close(fd))
 void disconnect_from_server() {
-    if (server_fd >= 0) {
-        write_n_bytes(server_fd, "BYE\n", 4);
+    if (ui_conn) {
+        client_conn_close(ui_conn);
+        ui_conn = NULL;
+        server_fd = -1;
+    } else if (server_fd >= 0) {
+        proto_send(server_fd, FRAME_BYE, 0, NULL, 0);
         close(server_fd);
         server_fd = -1;
     }
 }
 
 // ------------------------------------------------------------------------------------------------
-// Thread qui lit le fichier local (local_path) par blocs et envoie chaque bloc au serveur via le socket.
-//   - T : TransferArg* arg, contient sockfd, local_path, total_size...
+// Envoie la trame FRAME_TASK (en-tête de la tâche) pour le flux stream_id.
+// Retourne 0, ou -1 si l'envoi échoue.
+// ------------------------------------------------------------------------------------------------
+static int submit_task(ClientConn *c, const TransferArg *t, uint8_t type, uint8_t flags,
+                       uint64_t hash, const char *meta, const char *out) {
+    ProtoTask pt;
+    memset(&pt, 0, sizeof(pt));
+    pt.type = type;
+    pt.flags = flags;
+    pt.total_size = (uint64_t)t->total_size;
+    pt.hash = hash;
+    pt.resume_token = t->resume_token;
+    pt.resume_have = t->resume_have;
+    snprintf(pt.meta, sizeof(pt.meta), "%s", meta);
+    snprintf(pt.out, sizeof(pt.out), "%s", out ? out : "");
+    uint8_t payload[PROTO_TASK_FIXED + 2 * PROTO_MAX_NAME + 24];
+    ssize_t len = proto_encode_task(&pt, payload, sizeof(payload));
+    if (len < 0) return -1;
+    return conn_send(c, FRAME_TASK, t->stream_id, payload, (uint32_t)len);
+}
+
+void *thread_send_func(void *arg);
+
+// Empreinte XXH64 du fichier path (projeté en mémoire). Retourne -1 si illisible.
+static int file_hash(const char *path, long size, uint64_t *hash) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+    void *p = mmap(NULL, (size_t)size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) return -1;
+    posix_madvise(p, (size_t)size, POSIX_MADV_SEQUENTIAL);
+    *hash = xxh64(p, (size_t)size, 0);
+    munmap(p, (size_t)size);
+    return 0;
+}
+
+// ------------------------------------------------------------------------------------------------
+// Lance la tâche t sur la connexion c : ouvre le fichier de sortie, enregistre la tâche auprès
+// du thread de réception, envoie FRAME_TASK puis démarre son thread d'envoi.
+// Retourne -1 (rien n'est lancé) si la sortie est inaccessible ou la connexion perdue ou pleine.
+// ------------------------------------------------------------------------------------------------
+static int client_submit(ClientConn *c, TransferArg *t, uint8_t type, const char *out_name) {
+    // Reprise : la sortie partielle est gardée, le serveur dira où la tronquer
+    bool resumable = type == PROTO_TASK_COMPRESS && !t->archive && !t->parallel &&
+                     t->total_size >= CLIENT_RESUME_MIN;
+    t->resuming = resumable && resume_note_load(t);
+    t->out_fd = open(t->output_path, O_WRONLY | O_CREAT | O_CLOEXEC | (t->resuming ? 0 : O_TRUNC), 0644);
+    if (t->out_fd < 0) {
+        snprintf(t->error, sizeof(t->error), "sortie %s : %s", t->output_path, strerror(errno));
+        return -1;
+    }
+    // La sortie dépasse rarement l'entrée : réserver la place évite de
+    // fragmenter le fichier au fil des écritures (tronqué à la fin). Pas pour
+    // une tâche reprenable : après un arrêt brutal, la taille du fichier doit
+    // rester celle de la sortie effectivement reçue.
+    if (t->total_size > 0 && !resumable) posix_fallocate(t->out_fd, 0, t->total_size);
+    pthread_mutex_lock(&c->lock);
+    if (c->dead || c->nstreams == CLIENT_MAX_STREAMS) {
+        pthread_mutex_unlock(&c->lock);
+        snprintf(t->error, sizeof(t->error), "connexion indisponible");
+        return -1;
+    }
+    t->conn = c;
+    t->stream_id = c->next_stream_id++;
+    c->streams[c->nstreams++] = t;
+    pthread_mutex_unlock(&c->lock);
+
+    // Un dossier est annoncé comme « nom.tar » : le serveur ne le prend pas pour un média
+    char meta[PROTO_MAX_NAME + 1];
+    if (t->archive) {
+        const char *slash = strrchr(t->local_path, '/');
+        snprintf(meta, sizeof(meta), "%s.tar", slash ? slash + 1 : t->local_path);
+    } else {
+        snprintf(meta, sizeof(meta), "%s", t->local_path);
+    }
+
+    uint8_t flags = 0;
+    if (t->archive) flags |= PROTO_TASK_ARCHIVE;
+    if (t->parallel && type == PROTO_TASK_COMPRESS) flags |= PROTO_TASK_PARALLEL;
+    t->t_start = now_us();
+    uint64_t hash = 0;
+    if (!t->archive && t->total_size >= CLIENT_HASH_MIN && file_hash(t->local_path, t->total_size, &hash) == 0) {
+        flags |= PROTO_TASK_HASHED;
+    }
+    if (resumable) flags |= PROTO_TASK_RESUMABLE;
+    if (t->resuming) flags |= PROTO_TASK_RESUME;
+    if (submit_task(c, t, type, flags, hash, meta, out_name) < 0) {
+        // Trame tronquée : le thread de réception terminera toutes les tâches
+        shutdown(c->fd, SHUT_RDWR);
+    }
+    // Même sur échec, le thread d'envoi s'arrête de lui-même (tâche terminée)
+    if (pthread_create(&t->sender, NULL, thread_send_func, t) == 0) {
+        t->has_sender = true;
+    } else {
+        shutdown(c->fd, SHUT_RDWR);
+    }
+    return 0;
+}
+
+// Envoie len octets du fichier fd (à partir de off) en trames DATA par sendfile(), chaque trame
+// couvrant ce que la fenêtre du serveur autorise (CLIENT_SEND_MIN..CLIENT_SEND_MAX).
+static int send_file_range(TransferArg *t, int fd, off_t off, uint64_t len) {
+    while (len > 0) {
+        long max = len < CLIENT_SEND_MAX ? (long)len : CLIENT_SEND_MAX;
+        long n = transfer_reserve(t, len < CLIENT_SEND_MIN ? (long)len : CLIENT_SEND_MIN, max);
+        if (n <= 0) return -1;
+        if (conn_send_file(t->conn, t->stream_id, fd, off, (uint32_t)n) < 0) return -1;
+        t->bytes_sent += n;
+        off += n;
+        len -= n;
+    }
+    return 0;
+}
+
+// Même découpage pour des octets en mémoire
+static int send_mem(TransferArg *t, const uint8_t *p, size_t len) {
+    while (len > 0) {
+        long max = len < CLIENT_SEND_MAX ? (long)len : CLIENT_SEND_MAX;
+        long n = transfer_reserve(t, len < CLIENT_SEND_MIN ? (long)len : CLIENT_SEND_MIN, max);
+        if (n <= 0) return -1;
+        if (conn_send(t->conn, FRAME_DATA, t->stream_id, p, (uint32_t)n) < 0) return -1;
+        t->bytes_sent += n;
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+// Regroupe en-têtes, bourrage et petits fichiers d'une archive en trames pleines
+typedef struct {
+    TransferArg *t;
+    uint8_t *buf;       // CLIENT_SEND_MAX octets
+    size_t len;
+} SendStage;
+
+static int stage_flush(SendStage *s) {
+    int rc = send_mem(s->t, s->buf, s->len);
+    s->len = 0;
+    return rc;
+}
+
+// Ajoute n octets de p (des zéros si p est NULL)
+static int stage_put(SendStage *s, const void *p, uint64_t n) {
+    const uint8_t *src = p;
+    while (n > 0) {
+        size_t k = CLIENT_SEND_MAX - s->len;
+        if (k > n) k = (size_t)n;
+        if (src) {
+            memcpy(s->buf + s->len, src, k);
+            src += k;
+        } else {
+            memset(s->buf + s->len, 0, k);
+        }
+        s->len += k;
+        n -= k;
+        if (s->len == CLIENT_SEND_MAX && stage_flush(s) < 0) return -1;
+    }
+    return 0;
+}
+
+// Produit le flux tar du dossier : en-têtes générés ici, contenu préparé par le préchargeur.
+// Un fichier qui a changé de taille depuis le parcours est tronqué ou complété de zéros,
+// un fichier illisible est remplacé par des zéros : la taille annoncée est toujours tenue.
+static void send_archive(TransferArg *t) {
+    Archive *a = t->archive;
+    SendStage s = { .t = t, .buf = malloc(CLIENT_SEND_MAX), .len = 0 };
+    uint8_t hdr[ARCHIVE_MAX_HEADER];
+    if (!s.buf) return;
+    for (size_t i = 0; i < a->count; i++) {
+        ArchiveEntry *e = archive_wait(a, i);
+        size_t hl = archive_header(e, hdr, sizeof(hdr));
+        int rc = stage_put(&s, hdr, hl);
+        if (rc == 0 && !e->is_dir) {
+            uint64_t done = 0;
+            if (e->data) {
+                rc = stage_put(&s, e->data, e->size);
+                done = e->size;
+            } else if (e->fd >= 0) {
+                struct stat st;
+                uint64_t avail = fstat(e->fd, &st) == 0 ? (uint64_t)st.st_size : 0;
+                done = avail < e->size ? avail : e->size;
+                rc = stage_flush(&s);
+                if (rc == 0) rc = send_file_range(t, e->fd, 0, done);
+            } else {
+                t->unreadable++;
+            }
+            if (rc == 0) rc = stage_put(&s, NULL, e->size - done + archive_padding(e->size));
+        }
+        archive_release(a, i);
+        if (rc < 0) {
+            free(s.buf);
+            return;
+        }
+    }
+    if (stage_put(&s, NULL, ARCHIVE_TRAILER) == 0) stage_flush(&s);
+    free(s.buf);
+}
+
+// ------------------------------------------------------------------------------------------------
+// Thread qui envoie le fichier local (local_path) au serveur en trames DATA, puis une trame END.
+// Les octets passent du cache de pages au socket par sendfile(), sans copie. Pour un dossier,
+// envoie le flux tar produit par send_archive.
+//   - T : TransferArg* arg, contient la connexion, local_path, total_size, stream_id...
 // ------------------------------------------------------------------------------------------------
 void *thread_send_func(void *arg) {
     TransferArg *t = (TransferArg*)arg;
-    FILE *f = fopen(t->local_path, "rb");
-    if (!f) {
-        return NULL;
-    }
-    size_t block = 16 * 1024;
-    void *buf = malloc(block);
-    long rem = t->total_size;
-    while (rem > 0) {
-        size_t chunk = (rem < (long)block) ? rem : block;
-        size_t r = fread(buf, 1, chunk, f);
-        if (!r) break;
-        write_n_bytes(t->sockfd, buf, r);
-        rem -= r;
+    if (t->archive) {
+        send_archive(t);
+    } else {
+        // Reprise : l'offset de départ vient de FRAME_ACCEPT
+        pthread_mutex_lock(&t->lock);
+        while (t->resuming && !t->accepted && !t->finished) pthread_cond_wait(&t->cond, &t->lock);
+        uint64_t from = t->resume_in;
+        pthread_mutex_unlock(&t->lock);
+        int fd = open(t->local_path, O_RDONLY | O_CLOEXEC);
+        if (fd >= 0) {
+            posix_fadvise(fd, (off_t)from, 0, POSIX_FADV_SEQUENTIAL);
+            send_file_range(t, fd, (off_t)from, (uint64_t)t->total_size - from);
+            close(fd);
+        }
     }
-    free(buf);
-    fclose(f);
+    // Toujours signaler la fin d'envoi : le serveur termine la tâche au plus tôt
+    conn_send(t->conn, FRAME_END, t->stream_id, NULL, 0);
     return NULL;
 }
 
+// Cache local des dictionnaires Zstd du serveur :
+// $XDG_CACHE_HOME/netsched/dicts/<id>.zdict (défaut ~/.cache). « zstd -d -D <fichier> ».
+static void dict_cache_path(uint32_t id, char *buf, size_t len) {
+    const char *xdg = getenv("XDG_CACHE_HOME");
+    const char *home = getenv("HOME");
+    char base[PROTO_MAX_NAME];
+    if (xdg && *xdg) snprintf(base, sizeof(base), "%s", xdg);
+    else snprintf(base, sizeof(base), "%s/.cache", home && *home ? home : "/tmp");
+    if (id == 0) {
+        // Création des dossiers
+        mkdir(base, 0700);
+        snprintf(buf, len, "%s/netsched", base);
+        mkdir(buf, 0700);
+        snprintf(buf, len, "%s/netsched/dicts", base);
+        mkdir(buf, 0700);
+        return;
+    }
+    snprintf(buf, len, "%s/netsched/dicts/%u.zdict", base, id);
+}
+
+static bool dict_cached(uint32_t id) {
+    char path[PROTO_MAX_NAME + 64];
+    dict_cache_path(id, path, sizeof(path));
+    return access(path, R_OK) == 0;
+}
+
+// Enregistre le dictionnaire reçu (fichier temporaire puis rename)
+static int dict_store(uint32_t id, const uint8_t *data, size_t len) {
+    char dir[PROTO_MAX_NAME + 64], path[PROTO_MAX_NAME + 64], tmp[PROTO_MAX_NAME + 80];
+    dict_cache_path(0, dir, sizeof(dir));
+    dict_cache_path(id, path, sizeof(path));
+    snprintf(tmp, sizeof(tmp), "%s.%d", path, (int)getpid());
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) return -1;
+    int rc = write_n_bytes(fd, data, len) < 0 ? -1 : 0;
+    close(fd);
+    if (rc == 0) rc = rename(tmp, path);
+    if (rc < 0) unlink(tmp);
+    return rc;
+}
+
+// FRAME_ACCEPT : résultat en cache (rien à envoyer), jeton de reprise, ou
+// reprise acceptée (sortie tronquée au point de reprise, envoi de la suite).
+// Une reprise refusée repart de zéro.
+static void accept_task(TransferArg *t, const uint8_t *p, uint32_t len) {
+    uint8_t flags = len >= 5 ? p[4] : 0;
+    uint32_t off = 5;
+    uint64_t in = 0, out = 0;
+    if ((flags & PROTO_ACCEPT_RESUMABLE) && len >= off + 8) {
+        t->resume_token = get_u64(p + off);
+        off += 8;
+        resume_note_save(t);
+    }
+    if ((flags & PROTO_ACCEPT_RESUMED) && len >= off + 16) {
+        in = get_u64(p + off);
+        out = get_u64(p + off + 8);
+        t->resumed = true;
+    }
+    if (t->resuming && t->out_fd >= 0 &&
+        (ftruncate(t->out_fd, (off_t)out) < 0 || lseek(t->out_fd, (off_t)out, SEEK_SET) < 0)) {
+        // Sortie inutilisable : la tâche continue côté serveur, résultat perdu
+        t->failed = true;
+        snprintf(t->error, sizeof(t->error), "reprise %s : %s", t->output_path, strerror(errno));
+        close(t->out_fd);
+        t->out_fd = -1;
+    }
+    t->bytes_recv = out;
+    pthread_mutex_lock(&t->lock);
+    t->cached = (flags & PROTO_ACCEPT_CACHED) != 0;
+    t->resume_in = in;
+    t->accepted = true;
+    pthread_cond_broadcast(&t->cond);
+    pthread_mutex_unlock(&t->lock);
+}
+
+// Traite une trame reçue. Retourne -1 sur erreur de connexion (motif dans reason).
+static int conn_dispatch(ClientConn *c, const ProtoHeader *h, const uint8_t *p,
+                         char *reason, size_t reasonlen) {
+    if (h->task_id == 0) {
+        // Erreur de connexion (serveur plein...) : plus rien ne passera
+        if (h->type == FRAME_ERROR) {
+            snprintf(reason, reasonlen, "%.*s", (int)h->length, (const char *)p);
+            return -1;
+        }
+        return 0;
+    }
+    // Sortie compressée avec un dictionnaire absent du cache : la tâche ne se
+    // termine qu'à sa réception (FRAME_DICT sur le même identifiant)
+    uint32_t dict = h->type == FRAME_END && h->length >= 12 ? get_u32(p + 8) : 0;
+    bool fetch = dict && !dict_cached(dict);
+    bool last = (h->type == FRAME_END && !fetch) || h->type == FRAME_ERROR || h->type == FRAME_DICT;
+    TransferArg *t = conn_find_stream(c, h->task_id, last);
+    if (!t) return 0;
+    if (h->type == FRAME_DATA) {
+        if (t->out_fd >= 0 && write_n_bytes(t->out_fd, p, h->length) < 0) {
+            // La tâche continue côté serveur, mais son résultat est perdu
+            t->failed = true;
+            snprintf(t->error, sizeof(t->error), "écriture %s : %s", t->output_path, strerror(errno));
+            close(t->out_fd);
+            t->out_fd = -1;
+        }
+        t->bytes_recv += h->length;
+    } else if (h->type == FRAME_ACCEPT) {
+        accept_task(t, p, h->length);
+    } else if (h->type == FRAME_WINDOW && h->length == 4) {
+        pthread_mutex_lock(&t->lock);
+        t->window += get_u32(p);
+        pthread_cond_signal(&t->cond);
+        pthread_mutex_unlock(&t->lock);
+    } else if (h->type == FRAME_END) {
+        t->dict_id = dict;
+        if (!fetch) {
+            transfer_finish(t, NULL);
+        } else {
+            uint8_t id[4];
+            put_u32(id, dict);
+            if (conn_send(c, FRAME_DICT_GET, h->task_id, id, sizeof(id)) < 0) {
+                snprintf(reason, reasonlen, "envoi impossible");
+                return -1;
+            }
+        }
+    } else if (h->type == FRAME_DICT) {
+        const char *err = NULL;
+        if (h->length <= 4 || get_u32(p) != t->dict_id) err = "dictionnaire indisponible sur le serveur";
+        else if (dict_store(t->dict_id, p + 4, h->length - 4) < 0) err = "dictionnaire : écriture du cache impossible";
+        transfer_finish(t, err);
+    } else if (h->type == FRAME_ERROR) {
+        char msg[128];
+        snprintf(msg, sizeof(msg), "%.*s", (int)h->length, (const char *)p);
+        transfer_finish(t, msg);
+    }
+    return 0;
+}
+
 // ------------------------------------------------------------------------------------------------
-// Thread qui lit en boucle (non-bloquant si possible) la réponse du serveur (octets compressés / convertis)
-//   et écrit ces octets dans le fichier de sortie (output_path).
+// Thread de réception d'une connexion : lit les trames du serveur et les répartit entre les
+// tâches en cours (DATA → fichier de sortie, WINDOW → crédit d'envoi, END/ERROR → fin).
+// Lit par grands blocs et découpe les trames dans le tampon, qui grandit si une trame n'y
+// tient pas. À la perte de la connexion, toutes les tâches restantes se terminent en erreur.
 // ------------------------------------------------------------------------------------------------
 void *thread_recv_func(void *arg) {
-    TransferArg *t = (TransferArg*)arg;
-    FILE *f = fopen(t->output_path, "wb");
-    if (!f) {
-        return NULL;
-    }
-    char buf[8192];
-    ssize_t r;
-    while ((r = read(t->sockfd, buf, sizeof(buf))) > 0) {
-        fwrite(buf, 1, r, f);
+    ClientConn *c = (ClientConn*)arg;
+    char reason[128] = "connexion perdue";
+    size_t cap = CLIENT_RBUF_INITIAL, len = 0;
+    uint8_t *buf = malloc(cap);
+    while (buf) {
+        ssize_t n = read(c->fd, buf + len, cap - len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        len += n;
+
+        size_t off = 0;
+        ProtoHeader h;
+        int rc = 0;
+        while (rc == 0 && len - off >= PROTO_HEADER_SIZE) {
+            if (proto_parse_header(buf + off, &h) < 0) {
+                snprintf(reason, sizeof(reason), "trame invalide");
+                rc = -1;
+                break;
+            }
+            size_t need = PROTO_HEADER_SIZE + h.length;
+            if (len - off < need) {
+                if (need > cap) {
+                    // Trame plus grande que le tampon : on l'agrandit
+                    memmove(buf, buf + off, len - off);
+                    len -= off;
+                    off = 0;
+                    uint8_t *nb = realloc(buf, need);
+                    if (!nb) rc = -1;
+                    else {
+                        buf = nb;
+                        cap = need;
+                    }
+                }
+                break;
+            }
+            rc = conn_dispatch(c, &h, buf + off + PROTO_HEADER_SIZE, reason, sizeof(reason));
+            off += need;
+        }
+        if (rc < 0) break;
+        memmove(buf, buf + off, len - off);
+        len -= off;
     }
-    fclose(f);
+    free(buf);
+
+    // Débloque les envois qui attendent encore de la fenêtre
+    pthread_mutex_lock(&c->lock);
+    c->dead = true;
+    TransferArg *orphans[CLIENT_MAX_STREAMS];
+    int n = c->nstreams;
+    memcpy(orphans, c->streams, n * sizeof(orphans[0]));
+    c->nstreams = 0;
+    pthread_mutex_unlock(&c->lock);
+    for (int i = 0; i < n; i++) transfer_finish(orphans[i], reason);
     return NULL;
 }
 
 // ------------------------------------------------------------------------------------------------
 // UI ncurses pour « Compresser un fichier »
 //   - Demande le chemin du fichier/dossier,
-//   - Envoie la commande "TASK|COMPRESS|<taille>|<chemin>|\n" au serveur,
-//   - Lance deux threads : un pour envoyer (thread_send_func), un pour recevoir (thread_recv_func).
+//   - Envoie la trame FRAME_TASK (COMPRESS, taille, chemin) au serveur,
+//   - Lance le thread d'envoi (thread_send_func) ; le thread de réception de la connexion
+//     (thread_recv_func) écrit le résultat.
 // ------------------------------------------------------------------------------------------------
 void compress_file_ui() {
     echo();
@@ -192,57 +916,47 @@ void compress_file_ui() {
     mvprintw(10,4,"Chemin du fichier ou dossier à compresser : ");
     clrtoeol();
     getnstr(path,256);
+    noecho();
 
-    struct stat st;
-    if (stat(path,&st) < 0) {
-        mvprintw(12,4,"Erreur : introuvable ou illisible");
+    // Un dossier devient une archive tar, parcourue ici
+    char err[128];
+    TransferArg *arg = transfer_open(path, err, sizeof(err));
+    if (!arg) {
+        mvprintw(12,4,"Erreur : %s", err);
         getch();
-        noecho();
         return;
     }
-    long sz = st.st_size;
-    noecho();
 
     mvprintw(12,4,"Envoi de la tâche de compression...");
     refresh();
 
-    // Préparer la ligne réseau : TASK|COMPRESS|<taille>|<chemin>|
-    char line[512];
-    snprintf(line, sizeof(line),
-             "TASK|COMPRESS|%ld|%s|\n", sz, path);
-    write_n_bytes(server_fd, line, strlen(line));
+    // En-tête de tâche : type, taille, chemin
+    if (client_submit(ui_conn, arg, PROTO_TASK_COMPRESS, NULL) < 0) {
+        mvprintw(13,4,"Erreur : %s", arg->error);
+        getch();
+        transfer_free(arg);
+        return;
+    }
 
     mvprintw(13,4,"Compression en cours, patientez...");
     refresh();
 
-    TransferArg *arg = malloc(sizeof(*arg));
-    arg->sockfd = server_fd;
-    arg->local_path = strdup(path);
-    arg->total_size = sz;
-    char out[512];
-    snprintf(out, sizeof(out), "%s.zst", path);
-    arg->output_path = strdup(out);
-
-    pthread_t stid, rtid;
-    pthread_create(&stid, NULL, thread_send_func, arg);
-    pthread_create(&rtid, NULL, thread_recv_func, arg);
-    pthread_join(stid, NULL);
-    pthread_join(rtid, NULL);
-
-    mvprintw(15,4,"Compression terminée → %s", out);
+    transfer_wait(arg);
+
+    if (arg->failed) mvprintw(15,4,"Échec de la compression : %s", arg->error);
+    else mvprintw(15,4,"Compression terminée → %s", arg->output_path);
+    if (arg->unreadable) mvprintw(16,4,"%d fichier(s) illisible(s), remplacés par des zéros", arg->unreadable);
     getch();
 
-    free(arg->local_path);
-    free(arg->output_path);
-    free(arg);
+    transfer_free(arg);
 }
 
 // ------------------------------------------------------------------------------------------------
 // UI ncurses pour « Convertir une vidéo »
 //   - Demande le chemin du fichier vidéo,
 //   - Demande le nom du fichier audio de sortie,
-//   - Envoie "TASK|CONVERT|<taille>|<chemin>|<nom_sortie>\n" au serveur,
-//   - Lance deux threads pour envoyer/réceptionner.
+//   - Envoie la trame FRAME_TASK (CONVERT, taille, chemin, nom de sortie) au serveur,
+//   - Lance le thread d'envoi, le thread de réception écrit le fichier audio.
 // ------------------------------------------------------------------------------------------------
 void convert_video_ui() {
     echo();
@@ -268,39 +982,264 @@ void convert_video_ui() {
     mvprintw(13,4,"Envoi de la tâche de conversion...");
     refresh();
 
-    // Préparer la ligne réseau : TASK|CONVERT|<taille>|<chemin>|<nom_sortie>\n
-    char line[512];
-    snprintf(line, sizeof(line),
-             "TASK|CONVERT|%ld|%s|%s\n", sz, path, outn);
-    write_n_bytes(server_fd, line, strlen(line));
+    TransferArg *arg = transfer_new(path, sz, outn);
+
+    // En-tête de tâche : type, taille, chemin, nom de sortie
+    if (!arg || client_submit(ui_conn, arg, PROTO_TASK_CONVERT, outn) < 0) {
+        mvprintw(14,4,"Erreur : %s", arg ? arg->error : "mémoire insuffisante");
+        getch();
+        if (arg) transfer_free(arg);
+        return;
+    }
 
     mvprintw(14,4,"Conversion en cours, patientez...");
     refresh();
 
-    TransferArg *arg = malloc(sizeof(*arg));
-    arg->sockfd = server_fd;
-    arg->local_path = strdup(path);
-    arg->total_size = sz;
-    arg->output_path = strdup(outn);
-
-    pthread_t stid, rtid;
-    pthread_create(&stid, NULL, thread_send_func, arg);
-    pthread_create(&rtid, NULL, thread_recv_func, arg);
-    pthread_join(stid, NULL);
-    pthread_join(rtid, NULL);
+    transfer_wait(arg);
 
-    mvprintw(16,4,"Conversion terminée → %s", outn);
+    if (arg->failed) mvprintw(16,4,"Échec de la conversion : %s", arg->error);
+    else mvprintw(16,4,"Conversion terminée → %s", outn);
     getch();
 
-    free(arg->local_path);
-    free(arg->output_path);
-    free(arg);
+    transfer_free(arg);
+}
+
+// ------------------------------------------------------------------------------------------------
+// Mode batch (sans terminal) : scheduler_client --batch [options] <ip_serveur> fichiers...
+//   Un seul pseudo pour toutes les connexions ; jusqu'à -j tâches en vol réparties sur -c
+//   connexions. Une ligne JSON par fichier sur la sortie standard, dans l'ordre de fin.
+// ------------------------------------------------------------------------------------------------
+static pthread_mutex_t batch_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t batch_cond = PTHREAD_COND_INITIALIZER;
+static TransferArg *batch_done = NULL;      // tâches terminées, pas encore rapportées
+
+static void batch_on_done(TransferArg *t) {
+    pthread_mutex_lock(&batch_lock);
+    t->next = batch_done;
+    batch_done = t;
+    pthread_cond_signal(&batch_cond);
+    pthread_mutex_unlock(&batch_lock);
+}
+
+static void json_string(FILE *f, const char *s) {
+    fputc('"', f);
+    for (; *s; s++) {
+        unsigned char ch = (unsigned char)*s;
+        if (ch == '"' || ch == '\\') fprintf(f, "\\%c", ch);
+        else if (ch < 0x20) fprintf(f, "\\u%04x", ch);
+        else fputc(ch, f);
+    }
+    fputc('"', f);
+}
+
+// Une ligne de résultat. t->error renseigné et t_start nul : tâche jamais lancée.
+static void batch_report(const char *path, const TransferArg *t, const char *error) {
+    printf("{\"file\":");
+    json_string(stdout, path);
+    if (t) {
+        printf(",\"output\":");
+        json_string(stdout, t->output_path);
+    }
+    printf(",\"status\":\"%s\"", error ? "error" : "ok");
+    if (t) {
+        double ms = t->t_start ? (t->t_end - t->t_start) / 1000.0 : 0.0;
+        printf(",\"bytes_in\":%llu,\"bytes_out\":%llu,\"duration_ms\":%.3f",
+               (unsigned long long)t->bytes_sent, (unsigned long long)t->bytes_recv, ms);
+        if (t->cached) printf(",\"cached\":true");
+        if (t->resumed) printf(",\"resumed_from\":%llu", (unsigned long long)t->resume_in);
+        if (t->archive) printf(",\"archive_entries\":%zu,\"unreadable\":%d", t->archive->count, t->unreadable);
+        if (t->dict_id) {
+            char path[PROTO_MAX_NAME + 64];
+            dict_cache_path(t->dict_id, path, sizeof(path));
+            printf(",\"dict_id\":%u,\"dict\":", t->dict_id);
+            json_string(stdout, path);
+        }
+    }
+    if (error) {
+        printf(",\"error\":");
+        json_string(stdout, error);
+    }
+    printf("}\n");
+    fflush(stdout);
+}
+
+// Connexion vivante la moins chargée (sous CLIENT_MAX_STREAMS), ou NULL
+static ClientConn *batch_pick(ClientConn **conns, int nconns) {
+    ClientConn *best = NULL;
+    int best_load = CLIENT_MAX_STREAMS;
+    for (int i = 0; i < nconns; i++) {
+        int load = conns[i] ? client_conn_load(conns[i]) : -1;
+        if (load >= 0 && load < best_load) {
+            best = conns[i];
+            best_load = load;
+        }
+    }
+    return best;
+}
+
+static void batch_usage(const char *argv0) {
+    fprintf(stderr,
+            "Usage : %s --batch [-P port] [-u pseudo] [-c connexions] [-j tâches_en_vol] [-a] [-p]\n"
+            "          <ip_serveur> fichiers...\n"
+            "  Un dossier est envoyé comme une archive tar (sortie <dossier>.tar.zst)\n"
+            "  Une petite sortie peut exiger un dictionnaire du serveur, rapatrié dans\n"
+            "  $XDG_CACHE_HOME/netsched/dicts (champ \"dict\" : zstd -d -D <dict>)\n"
+            "  -a : conversion vidéo → audio (sortie <fichier>.mp3) au lieu de la compression\n"
+            "  -p : compression par blocs parallèles (sortie seekable) dès 8 Mio, au lieu de 64 Mio\n",
+            argv0);
+}
+
+static int run_batch(int argc, char *argv[]) {
+    const char *argv0 = argv[0];
+    const char *pseudo = getenv("USER") ? getenv("USER") : "batch";
+    int port = DEFAULT_SERVER_PORT;
+    int nconns = DEFAULT_BATCH_CONNS;
+    int jobs = DEFAULT_BATCH_JOBS;
+    bool convert = false, parallel = false;
+    int opt;
+    // argv[0] = "--batch" pour getopt
+    argc--;
+    argv++;
+    while ((opt = getopt(argc, argv, "P:u:c:j:ap")) != -1) {
+        switch (opt) {
+            case 'P': port = atoi(optarg); break;
+            case 'u': pseudo = optarg; break;
+            case 'c': nconns = atoi(optarg); break;
+            case 'j': jobs = atoi(optarg); break;
+            case 'a': convert = true; break;
+            case 'p': parallel = true; break;
+            default: batch_usage(argv0); return EXIT_FAILURE;
+        }
+    }
+    if (argc - optind < 2 || nconns < 1 || jobs < 1 || jobs > nconns * CLIENT_MAX_STREAMS) {
+        batch_usage(argv0);
+        return EXIT_FAILURE;
+    }
+    const char *server_ip = argv[optind];
+    char **files = argv + optind + 1;
+    int nfiles = argc - optind - 1;
+
+    // Une connexion inutile au-delà d'une tâche en vol par connexion
+    if (nconns > jobs) nconns = jobs;
+    ClientConn **conns = calloc(nconns, sizeof(*conns));
+    if (!conns) return EXIT_FAILURE;
+    for (int i = 0; i < nconns; i++) {
+        int fd = open_server_socket(server_ip, port);
+        if (fd < 0) {
+            fprintf(stderr, "Erreur : impossible de se connecter à %s:%d\n", server_ip, port);
+            return EXIT_FAILURE;
+        }
+        char err[256];
+        int prio = authenticate(fd, pseudo, err, sizeof(err));
+        if (prio < 0 && i > 0) {
+            // Quota de connexions du serveur : on garde celles déjà ouvertes
+            fprintf(stderr, "Avertissement : %d connexion(s) sur %d (%s)\n", i, nconns, err);
+            close(fd);
+            nconns = i;
+            break;
+        }
+        if (prio < 0) {
+            fprintf(stderr, "Échec de l'authentification : %s\n", err);
+            close(fd);
+            return EXIT_FAILURE;
+        }
+        user_priority = prio;
+        conns[i] = client_conn_new(fd, batch_on_done);
+        if (!conns[i]) {
+            close(fd);
+            return EXIT_FAILURE;
+        }
+    }
+
+    uint64_t t0 = now_us();
+    uint64_t total_in = 0, total_out = 0;
+    int next = 0, inflight = 0, failures = 0;
+    while (next < nfiles || inflight > 0) {
+        // Remplir jusqu'à jobs tâches en vol
+        while (next < nfiles && inflight < jobs) {
+            ClientConn *c = batch_pick(conns, nconns);
+            if (!c) break;
+            const char *path = files[next++];
+            char err[128];
+            TransferArg *t = NULL;
+            if (!convert) {
+                t = transfer_open(path, err, sizeof(err));
+                if (t && parallel) t->parallel = true;
+            } else {
+                struct stat st;
+                char out[PROTO_MAX_NAME];
+                snprintf(err, sizeof(err), "introuvable ou pas un fichier régulier");
+                snprintf(out, sizeof(out), "%s.mp3", path);
+                if (stat(path, &st) == 0 && S_ISREG(st.st_mode)) {
+                    t = transfer_new(path, (long)st.st_size, out);
+                    if (!t) snprintf(err, sizeof(err), "mémoire insuffisante");
+                }
+            }
+            if (!t) {
+                batch_report(path, NULL, err);
+                failures++;
+                continue;
+            }
+            // Le serveur ne reçoit que le nom de sortie, pas le chemin local
+            const char *slash = strrchr(t->output_path, '/');
+            if (client_submit(c, t, convert ? PROTO_TASK_CONVERT : PROTO_TASK_COMPRESS,
+                              convert ? (slash ? slash + 1 : t->output_path) : NULL) < 0) {
+                batch_report(path, t, t->error);
+                transfer_free(t);
+                failures++;
+                continue;
+            }
+            inflight++;
+        }
+        if (inflight == 0) {
+            // Plus aucune connexion : le reste des fichiers échoue
+            for (; next < nfiles; next++) {
+                batch_report(files[next], NULL, "connexion perdue");
+                failures++;
+            }
+            break;
+        }
+
+        pthread_mutex_lock(&batch_lock);
+        while (!batch_done) pthread_cond_wait(&batch_cond, &batch_lock);
+        TransferArg *done = batch_done;
+        batch_done = NULL;
+        pthread_mutex_unlock(&batch_lock);
+
+        while (done) {
+            TransferArg *t = done;
+            done = t->next;
+            if (t->has_sender) pthread_join(t->sender, NULL);
+            batch_report(t->local_path, t, t->failed ? t->error : NULL);
+            if (t->failed) failures++;
+            total_in += t->bytes_sent;
+            total_out += t->bytes_recv;
+            transfer_free(t);
+            inflight--;
+        }
+    }
+
+    for (int i = 0; i < nconns; i++) client_conn_close(conns[i]);
+    free(conns);
+
+    double wall = (now_us() - t0) / 1e6;
+    fprintf(stderr, "%d fichier(s), %d erreur(s), %llu → %llu octets en %.3f s (prio %d)\n",
+            nfiles, failures, (unsigned long long)total_in, (unsigned long long)total_out,
+            wall, user_priority);
+    return failures ? 2 : EXIT_SUCCESS;
 }
 
 int main(int argc, char *argv[]) {
+    // Mode batch : pas de ncurses, pas d'installation interactive
+    if (argc >= 2 && strcmp(argv[1], "--batch") == 0) {
+        signal(SIGPIPE, SIG_IGN);
+        return run_batch(argc, argv);
+    }
+
     // 0) Vérification de l’argument : usage = ./scheduler_client <ip_serveur>
     if (argc < 2) {
         fprintf(stderr, "Usage : %s <ip_serveur>\n", argv[0]);
+        fprintf(stderr, "        %s --batch [options] <ip_serveur> fichiers...\n", argv[0]);
         return EXIT_FAILURE;
     }
     const char *server_ip = argv[1];
@@ -335,24 +1274,11 @@ int main(int argc, char *argv[]) {
     getnstr(pseudo, 64);
     noecho();
 
-    // Envoi de "AUTH|<pseudo>\n"
-    char auth_msg[128];
-    snprintf(auth_msg, sizeof(auth_msg), "AUTH|%s\n", pseudo);
-    write_n_bytes(server_fd, auth_msg, strlen(auth_msg));
-
-    // Lecture de la réponse du serveur
-    char resp[64];
-    ssize_t r = read(server_fd, resp, sizeof(resp)-1);
-    if (r <= 0) {
-        endwin();
-        fprintf(stderr, "Erreur : aucune réponse du serveur.\n");
-        close(server_fd);
-        return EXIT_FAILURE;
-    }
-    resp[r] = '\0';
-
-    if (strncmp(resp, "AUTH_OK|", 8) == 0) {
-        user_priority = atoi(resp + 8);
+    // Envoi de la trame AUTH (charge = pseudo) et lecture de la réponse
+    char resp[256];
+    int prio = authenticate(server_fd, pseudo, resp, sizeof(resp));
+    if (prio >= 0) {
+        user_priority = prio;
         mvprintw(17, 4, "Authentification réussie (prio = %d)", user_priority);
         refresh();
         sleep(1);
@@ -363,6 +1289,14 @@ int main(int argc, char *argv[]) {
         return EXIT_FAILURE;
     }
 
+    // Les réponses du serveur passent désormais par le thread de réception
+    ui_conn = client_conn_new(server_fd, NULL);
+    if (!ui_conn) {
+        endwin();
+        fprintf(stderr, "Erreur interne : thread de réception\n");
+        close(server_fd);
+        return EXIT_FAILURE;
+    }
     is_connected = true;
 
     // 6) Boucle principale : affichage du menu ncurses
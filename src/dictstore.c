@@ -0,0 +1,338 @@
+#include "dictstore.h"
+#include "log.h"
+#include "utils.h"
+#include <ctype.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zdict.h>
+
+#define EXT_MAX 16
+#define DICT_SUFFIX ".zdict"
+
+// Un type de fichier : ses échantillons (anneau) et son dictionnaire courant
+typedef struct {
+    char ext[EXT_MAX];
+    void *samples[DICT_MAX_SAMPLES];
+    size_t sample_len[DICT_MAX_SAMPLES];
+    int nsamples, next;
+    int fresh;                  // échantillons reçus depuis le dernier entraînement
+    bool queued;                // en attente du thread d'entraînement
+    ZstdDict *current;
+} DictClass;
+
+// Ancien dictionnaire encore dans le magasin : de quoi retrouver son fichier
+// sans parcourir le dossier
+typedef struct {
+    uint32_t id;
+    char ext[EXT_MAX];
+} DictRetired;
+
+static char *store_dir = NULL;
+static DictClass classes[DICT_MAX_CLASSES];
+static int nclasses = 0;
+static DictRetired *retired = NULL;
+static int nretired = 0, retired_cap = 0;
+static pthread_mutex_t store_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t store_cond = PTHREAD_COND_INITIALIZER;
+
+// Type d'un nom : extension en minuscules (alphanumérique, elle sert dans les
+// noms de fichiers du magasin), « _ » sinon
+static void class_key(const char *meta, char *ext) {
+    const char *dot = strrchr(meta, '.');
+    const char *slash = strrchr(meta, '/');
+    size_t n = 0;
+    if (dot && (!slash || dot > slash)) {
+        for (const char *p = dot + 1; *p && n < EXT_MAX - 1; p++) {
+            if (!isalnum((unsigned char)*p)) {
+                n = 0;
+                break;
+            }
+            ext[n++] = (char)tolower((unsigned char)*p);
+        }
+    }
+    if (n == 0) ext[n++] = '_';
+    ext[n] = '\0';
+}
+
+// Classe de ext, créée au besoin (verrou tenu). NULL si la table est pleine.
+static DictClass *class_get(const char *ext, bool create) {
+    for (int i = 0; i < nclasses; i++) {
+        if (strcmp(classes[i].ext, ext) == 0) return &classes[i];
+    }
+    if (!create || nclasses == DICT_MAX_CLASSES) return NULL;
+    DictClass *c = &classes[nclasses++];
+    memset(c, 0, sizeof(*c));
+    snprintf(c->ext, sizeof(c->ext), "%s", ext);
+    return c;
+}
+
+static ZstdDict *dict_new(void *data, size_t size) {
+    uint32_t id = ZDICT_getDictID(data, size);
+    if (id == 0) return NULL;
+    ZstdDict *d = calloc(1, sizeof(*d));
+    if (!d) return NULL;
+    d->cdict = ZSTD_createCDict(data, size, DICT_LEVEL);
+    if (!d->cdict) {
+        free(d);
+        return NULL;
+    }
+    d->id = id;
+    d->data = data;
+    d->size = size;
+    d->refs = 1;
+    return d;
+}
+
+void dictstore_release(ZstdDict *d) {
+    if (!d) return;
+    if (__atomic_sub_fetch(&d->refs, 1, __ATOMIC_ACQ_REL) > 0) return;
+    ZSTD_freeCDict(d->cdict);
+    free(d->data);
+    free(d);
+}
+
+static void *read_file(const char *path, size_t *len) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return NULL;
+    struct stat st;
+    void *buf = NULL;
+    if (fstat(fd, &st) == 0 && st.st_size > 0 && st.st_size <= 4 * DICT_CAPACITY) {
+        buf = malloc(st.st_size);
+        if (buf && read_n_bytes(fd, buf, st.st_size) != st.st_size) {
+            free(buf);
+            buf = NULL;
+        }
+        *len = st.st_size;
+    }
+    close(fd);
+    return buf;
+}
+
+// Écrit <dir>/<ext>.<id>.zdict (fichier temporaire puis rename)
+static void dict_persist(const char *ext, const ZstdDict *d) {
+    char path[512], tmp[520];
+    snprintf(path, sizeof(path), "%s/%s.%u" DICT_SUFFIX, store_dir, ext, d->id);
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0 || write_n_bytes(fd, d->data, d->size) < 0 || fsync(fd) < 0 ||
+        rename(tmp, path) < 0) {
+        log_internal("Dictionnaire %s : enregistrement impossible (%s)", path, strerror(errno));
+        if (fd >= 0) unlink(tmp);
+    }
+    if (fd >= 0) close(fd);
+}
+
+// Inscrit un dictionnaire du magasin à l'index des anciens (verrou tenu)
+static void retire(const char *ext, uint32_t id) {
+    if (nretired == retired_cap) {
+        int cap = retired_cap ? retired_cap * 2 : 64;
+        DictRetired *r = realloc(retired, cap * sizeof(*r));
+        if (!r) return;
+        retired = r;
+        retired_cap = cap;
+    }
+    retired[nretired].id = id;
+    snprintf(retired[nretired].ext, EXT_MAX, "%s", ext);
+    nretired++;
+}
+
+// Nom de fichier du magasin : <ext>.<id>.zdict
+static bool parse_name(const char *name, char *ext, uint32_t *id) {
+    size_t n = strlen(name), sl = strlen(DICT_SUFFIX);
+    if (n <= sl || strcmp(name + n - sl, DICT_SUFFIX) != 0) return false;
+    const char *dot = memchr(name, '.', n - sl);
+    if (!dot || dot == name || (size_t)(dot - name) >= EXT_MAX) return false;
+    char *end;
+    unsigned long v = strtoul(dot + 1, &end, 10);
+    if (end != name + n - sl || v == 0 || v > UINT32_MAX) return false;
+    memcpy(ext, name, dot - name);
+    ext[dot - name] = '\0';
+    *id = (uint32_t)v;
+    return true;
+}
+
+// Recharge le plus récent dictionnaire de chaque type et indexe tous les
+// autres (l'index couvre aussi les courants : fetch les cherche d'abord)
+static void load_store(void) {
+    DIR *dir = opendir(store_dir);
+    if (!dir) return;
+    time_t newest[DICT_MAX_CLASSES] = { 0 };
+    struct dirent *de;
+    int loaded = 0;
+    while ((de = readdir(dir))) {
+        char ext[EXT_MAX], path[512];
+        uint32_t id;
+        struct stat st;
+        if (!parse_name(de->d_name, ext, &id)) continue;
+        snprintf(path, sizeof(path), "%s/%s", store_dir, de->d_name);
+        if (stat(path, &st) < 0) continue;
+        retire(ext, id);
+        DictClass *c = class_get(ext, true);
+        if (!c || (c->current && st.st_mtime < newest[c - classes])) continue;
+        size_t len;
+        void *data = read_file(path, &len);
+        ZstdDict *d = data ? dict_new(data, len) : NULL;
+        if (!d) {
+            free(data);
+            continue;
+        }
+        dictstore_release(c->current);
+        c->current = d;
+        newest[c - classes] = st.st_mtime;
+        loaded++;
+    }
+    closedir(dir);
+    if (loaded) log_internal("Dictionnaires Zstd : %d type(s) rechargé(s) de %s", nclasses, store_dir);
+}
+
+static void train_class(DictClass *c) {
+    // Copie des échantillons sous verrou, entraînement hors verrou
+    pthread_mutex_lock(&store_mutex);
+    size_t total = 0;
+    int n = c->nsamples;
+    for (int i = 0; i < n; i++) total += c->sample_len[i];
+    char ext[EXT_MAX];
+    memcpy(ext, c->ext, EXT_MAX);
+    uint8_t *buf = malloc(total ? total : 1);
+    size_t *sizes = malloc(n * sizeof(size_t));
+    if (buf && sizes) {
+        size_t off = 0;
+        for (int i = 0; i < n; i++) {
+            memcpy(buf + off, c->samples[i], c->sample_len[i]);
+            sizes[i] = c->sample_len[i];
+            off += c->sample_len[i];
+        }
+    }
+    pthread_mutex_unlock(&store_mutex);
+
+    void *dict = buf && sizes ? malloc(DICT_CAPACITY) : NULL;
+    size_t len = dict ? ZDICT_trainFromBuffer(dict, DICT_CAPACITY, buf, sizes, (unsigned)n) : 0;
+    free(buf);
+    free(sizes);
+    if (!dict || ZDICT_isError(len)) {
+        log_msg(LOG_DEBUG, 0, "dictionary .%s not trained (%s)", ext,
+                dict ? ZDICT_getErrorName(len) : "no memory");
+        free(dict);
+        return;
+    }
+    void *shrunk = realloc(dict, len);
+    if (shrunk) dict = shrunk;
+    ZstdDict *d = dict_new(dict, len);
+    if (!d) {
+        free(dict);
+        return;
+    }
+    dict_persist(ext, d);
+    log_internal("Dictionnaire .%s entraîné : id %u, %zu octets, %d échantillons", ext, d->id, len, n);
+
+    pthread_mutex_lock(&store_mutex);
+    ZstdDict *old = c->current;
+    c->current = d;
+    if (old) retire(ext, old->id);
+    pthread_mutex_unlock(&store_mutex);
+    dictstore_release(old);
+}
+
+static void *trainer_thread(void *arg) {
+    (void)arg;
+    for (;;) {
+        pthread_mutex_lock(&store_mutex);
+        DictClass *c = NULL;
+        while (!c) {
+            for (int i = 0; i < nclasses && !c; i++) {
+                if (classes[i].queued) c = &classes[i];
+            }
+            if (!c) pthread_cond_wait(&store_cond, &store_mutex);
+        }
+        c->queued = false;
+        c->fresh = 0;
+        pthread_mutex_unlock(&store_mutex);
+        train_class(c);
+    }
+    return NULL;
+}
+
+int dictstore_init(const char *dir) {
+    if (mkdir(dir, 0755) < 0 && errno != EEXIST) return -1;
+    store_dir = strdup(dir);
+    if (!store_dir) return -1;
+    load_store();
+    pthread_t tid;
+    if (pthread_create(&tid, NULL, trainer_thread, NULL) != 0) return -1;
+    pthread_detach(tid);
+    return 0;
+}
+
+void dictstore_sample(const char *meta, const void *data, size_t len) {
+    if (!store_dir || len == 0) return;
+    if (len > DICT_SAMPLE_MAX) len = DICT_SAMPLE_MAX;
+    char ext[EXT_MAX];
+    class_key(meta, ext);
+    void *copy = malloc(len);
+    if (!copy) return;
+    memcpy(copy, data, len);
+
+    pthread_mutex_lock(&store_mutex);
+    DictClass *c = class_get(ext, true);
+    if (!c) {
+        pthread_mutex_unlock(&store_mutex);
+        free(copy);
+        return;
+    }
+    void *old = c->samples[c->next];
+    c->samples[c->next] = copy;
+    c->sample_len[c->next] = len;
+    c->next = (c->next + 1) % DICT_MAX_SAMPLES;
+    if (c->nsamples < DICT_MAX_SAMPLES) c->nsamples++;
+    c->fresh++;
+    if (!c->queued && c->fresh >= (c->current ? DICT_RETRAIN : DICT_TRAIN_MIN)) {
+        c->queued = true;
+        pthread_cond_signal(&store_cond);
+    }
+    pthread_mutex_unlock(&store_mutex);
+    free(old);
+}
+
+ZstdDict *dictstore_acquire(const char *meta) {
+    if (!store_dir) return NULL;
+    char ext[EXT_MAX];
+    class_key(meta, ext);
+    pthread_mutex_lock(&store_mutex);
+    DictClass *c = class_get(ext, false);
+    ZstdDict *d = c ? c->current : NULL;
+    if (d) __atomic_add_fetch(&d->refs, 1, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&store_mutex);
+    return d;
+}
+
+void *dictstore_fetch(uint32_t id, size_t *len) {
+    if (!store_dir || id == 0) return NULL;
+    void *copy = NULL;
+    char path[512] = "";
+    pthread_mutex_lock(&store_mutex);
+    for (int i = 0; i < nclasses && !copy; i++) {
+        ZstdDict *d = classes[i].current;
+        if (d && d->id == id && (copy = malloc(d->size))) {
+            memcpy(copy, d->data, d->size);
+            *len = d->size;
+        }
+    }
+    // Ancien dictionnaire : un seul petit fichier à lire. Un identifiant
+    // inconnu ne coûte aucun accès disque.
+    for (int i = nretired - 1; i >= 0 && !copy && !path[0]; i--) {
+        if (retired[i].id == id) {
+            snprintf(path, sizeof(path), "%s/%s.%u" DICT_SUFFIX, store_dir, retired[i].ext, id);
+        }
+    }
+    pthread_mutex_unlock(&store_mutex);
+    if (!copy && path[0]) copy = read_file(path, len);
+    return copy;
+}
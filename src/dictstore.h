@@ -0,0 +1,47 @@
+#ifndef DICTSTORE_H
+#define DICTSTORE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <zstd.h>
+
+// Dictionnaires Zstd par type de fichier (extension de t->meta). Les petites
+// tâches fournissent des échantillons ; un thread les entraîne en arrière-plan
+// (ZDICT_trainFromBuffer), digère le résultat en ZSTD_CDict et l'enregistre
+// dans le dossier du magasin (<ext>.<id>.zdict), rechargé au démarrage. Les
+// anciens dictionnaires y restent : le client peut toujours les demander.
+#define DICT_SMALL_TASK (128 * 1024)    // tâches compressées avec dictionnaire
+#define DICT_SAMPLE_MAX (8 * 1024)      // octets gardés par échantillon
+#define DICT_MAX_SAMPLES 128            // échantillons par type (anneau)
+#define DICT_TRAIN_MIN 64               // premier entraînement
+#define DICT_RETRAIN 512                // nouveaux échantillons avant réentraînement
+#define DICT_CAPACITY (16 * 1024)
+#define DICT_LEVEL 9                    // niveau des CDict (imposé aux trames)
+#define DICT_MAX_CLASSES 64
+#define DICT_DEFAULT_DIR "dicts"
+
+typedef struct {
+    uint32_t id;
+    void *data;
+    size_t size;
+    ZSTD_CDict *cdict;
+    int refs;
+} ZstdDict;
+
+// Charge les dictionnaires enregistrés dans dir (créé au besoin) et démarre
+// le thread d'entraînement. Sans appel, le magasin reste inactif.
+int dictstore_init(const char *dir);
+
+// Début du contenu d'une petite tâche nommée meta.
+void dictstore_sample(const char *meta, const void *data, size_t len);
+
+// Dictionnaire courant du type de meta, référence prise ; NULL si aucun.
+ZstdDict *dictstore_acquire(const char *meta);
+void dictstore_release(ZstdDict *d);
+
+// Copie (malloc) du dictionnaire id, courant ou ancien ; NULL si inconnu.
+// Appelé par les threads d'E/S : seul un ancien dictionnaire indexé au
+// chargement ou au remplacement est lu sur le disque.
+void *dictstore_fetch(uint32_t id, size_t *len);
+
+#endif // DICTSTORE_H
@@ -0,0 +1,144 @@
+#include "levelctl.h"
+#include "netqueue.h"
+#include "log.h"
+
+// Débit relatif de Zstd par niveau (Mo/s d'un cœur sur du texte, ordre de
+// grandeur) : sert à extrapoler le débit mesuré au niveau courant vers les
+// niveaux voisins.
+static const int level_speed[LEVELCTL_MAX + 1] = {
+    0, 510, 380, 300, 270, 160, 125, 100, 85, 70, 60,
+    45, 40, 18, 15, 11, 8, 6, 5, 3
+};
+
+// Attente tolérée avant un quantum, par priorité (µs)
+static const double wait_target_us[NETQUEUE_PRIORITIES] = { 50000, 250000, 1000000 };
+
+// Seuils de pression : attente / cible, tâches en attente par worker
+#define PRESSURE_HIGH 2.0
+#define PRESSURE_LOW 0.25
+#define BACKLOG_HIGH 4
+#define BACKLOG_MID 2
+// On remonte d'un niveau au plus toutes les CLIMB_PERIODS périodes : la
+// descente est immédiate, la montée prudente
+#define CLIMB_PERIODS 4
+// Capacité gardée en réserve : on ne monte que si le niveau suivant tient
+// deux fois la demande observée
+#define HEADROOM 2.0
+
+static int level = LEVELCTL_DEFAULT;
+static int level_min = LEVELCTL_MIN;
+static int level_max = LEVELCTL_CEILING;
+
+// Accumulateurs alimentés par les workers, vidés à chaque période
+static uint64_t wait_sum[NETQUEUE_PRIORITIES];
+static uint64_t wait_count[NETQUEUE_PRIORITIES];
+static uint64_t codec_bytes;
+static uint64_t codec_norm;     // octets ramenés à un niveau de vitesse 1000
+static uint64_t codec_us;
+
+// État du régulateur : un seul worker à la fois (levelctl_due)
+static uint64_t next_due;
+static uint64_t last_update;
+static uint64_t last_climb;
+static double wait_ewma[NETQUEUE_PRIORITIES];
+static double speed_factor;     // octets/µs pour une vitesse relative de 1000
+static double mbps;
+
+void levelctl_set_bounds(int min, int max) {
+    if (min < LEVELCTL_MIN) min = LEVELCTL_MIN;
+    if (max > LEVELCTL_MAX) max = LEVELCTL_MAX;
+    if (max < min) max = min;
+    level_min = min;
+    level_max = max;
+    int l = LEVELCTL_DEFAULT < min ? min : LEVELCTL_DEFAULT > max ? max : LEVELCTL_DEFAULT;
+    __atomic_store_n(&level, l, __ATOMIC_RELAXED);
+}
+
+void levelctl_observe_wait(int priority, uint64_t wait_us) {
+    if (priority < 0) priority = 0;
+    if (priority >= NETQUEUE_PRIORITIES) priority = NETQUEUE_PRIORITIES - 1;
+    __atomic_add_fetch(&wait_sum[priority], wait_us, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&wait_count[priority], 1, __ATOMIC_RELAXED);
+}
+
+void levelctl_observe_codec(int lvl, size_t bytes, uint64_t busy_us) {
+    if (lvl < LEVELCTL_MIN || lvl > LEVELCTL_MAX || bytes == 0) return;
+    __atomic_add_fetch(&codec_bytes, bytes, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&codec_norm, (uint64_t)bytes * 1000 / level_speed[lvl], __ATOMIC_RELAXED);
+    __atomic_add_fetch(&codec_us, busy_us, __ATOMIC_RELAXED);
+}
+
+bool levelctl_due(uint64_t now_us) {
+    uint64_t due = __atomic_load_n(&next_due, __ATOMIC_RELAXED);
+    if (now_us < due) return false;
+    return __atomic_compare_exchange_n(&next_due, &due, now_us + LEVELCTL_PERIOD_MS * 1000,
+                                       false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED);
+}
+
+// Débit agrégé estimé au niveau l (octets/µs), 0 tant que rien n'est mesuré
+static double capacity_at(int l, int nworkers) {
+    return speed_factor * level_speed[l] / 1000.0 * nworkers;
+}
+
+void levelctl_update(uint64_t now_us, int pending, int nworkers) {
+    if (nworkers < 1) nworkers = 1;
+    uint64_t elapsed = last_update ? now_us - last_update : LEVELCTL_PERIOD_MS * 1000;
+    if (elapsed == 0) elapsed = 1;
+    last_update = now_us;
+
+    double pressure = 0;
+    for (int p = 0; p < NETQUEUE_PRIORITIES; p++) {
+        uint64_t n = __atomic_exchange_n(&wait_count[p], 0, __ATOMIC_RELAXED);
+        uint64_t sum = __atomic_exchange_n(&wait_sum[p], 0, __ATOMIC_RELAXED);
+        // Sans quantum servi, l'attente passée s'efface peu à peu
+        wait_ewma[p] = n ? 0.5 * wait_ewma[p] + 0.5 * ((double)sum / n) : 0.5 * wait_ewma[p];
+        double r = wait_ewma[p] / wait_target_us[p];
+        if (r > pressure) pressure = r;
+    }
+    uint64_t bytes = __atomic_exchange_n(&codec_bytes, 0, __ATOMIC_RELAXED);
+    uint64_t norm = __atomic_exchange_n(&codec_norm, 0, __ATOMIC_RELAXED);
+    uint64_t us = __atomic_exchange_n(&codec_us, 0, __ATOMIC_RELAXED);
+    if (us > 0) {
+        double f = (double)norm / us;
+        speed_factor = speed_factor > 0 ? 0.7 * speed_factor + 0.3 * f : f;
+    }
+    double demand = (double)bytes / elapsed;
+    double backlog = (double)pending / nworkers;
+
+    int cur = __atomic_load_n(&level, __ATOMIC_RELAXED);
+    int next = cur;
+    bool known = speed_factor > 0;
+    if (pressure > PRESSURE_HIGH || backlog > BACKLOG_HIGH) {
+        next = cur - 2;
+    } else if (pressure > 1 || backlog > BACKLOG_MID ||
+               (known && demand > 0.9 * capacity_at(cur, nworkers))) {
+        next = cur - 1;
+    } else if (pressure < PRESSURE_LOW && pending < nworkers &&
+               now_us - last_climb >= (uint64_t)CLIMB_PERIODS * LEVELCTL_PERIOD_MS * 1000) {
+        // Aucun quantum depuis longtemps (pool inactif) : plusieurs crans d'un
+        // coup, mais un seul tant que le débit n'a jamais été mesuré
+        int steps = 1 + (int)(elapsed / ((uint64_t)CLIMB_PERIODS * LEVELCTL_PERIOD_MS * 1000));
+        if (!known) steps = 1;
+        while (steps-- > 0 && next < level_max &&
+               (!known || demand * HEADROOM < capacity_at(next + 1, nworkers))) {
+            next++;
+        }
+        last_climb = now_us;
+    }
+    if (next < level_min) next = level_min;
+    if (next > level_max) next = level_max;
+    if (known) mbps = speed_factor * level_speed[next] / 1000.0 * 1e6 / (1024 * 1024);
+    if (next != cur) {
+        __atomic_store_n(&level, next, __ATOMIC_RELAXED);
+        log_msg(LOG_DEBUG, 0, "zstd level %d -> %d (pressure %.2f, backlog %.1f, demand %.1f MB/s)",
+                cur, next, pressure, backlog, demand);
+    }
+}
+
+int levelctl_level(void) {
+    return __atomic_load_n(&level, __ATOMIC_RELAXED);
+}
+
+double levelctl_mbps(void) {
+    return mbps;
+}
@@ -0,0 +1,41 @@
+#ifndef LEVELCTL_H
+#define LEVELCTL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Régulateur du niveau Zstd selon la charge. Les workers rapportent l'attente
+// de chaque quantum (par priorité) et le débit mesuré du codec ; toutes les
+// LEVELCTL_PERIOD_MS, l'un d'eux recalcule le niveau à partir de ces mesures
+// et de la profondeur de file : on descend vers les niveaux rapides dès qu'une
+// priorité dépasse sa cible d'attente ou que la file s'allonge, on remonte
+// vers les forts taux de compression quand le pool a de la marge.
+#define LEVELCTL_DEFAULT 9
+#define LEVELCTL_MIN 1
+#define LEVELCTL_MAX 19
+// Plafond par défaut : au-delà de 12 (stratégies btlazy2 et plus), le débit
+// s'effondre et une grosse tâche seule dure plusieurs fois plus longtemps
+#define LEVELCTL_CEILING 12
+#define LEVELCTL_PERIOD_MS 250
+
+// Bornes du niveau (min == max : niveau fixe, régulateur inactif).
+void levelctl_set_bounds(int min, int max);
+
+// Attente en file avant un quantum de priorité priority.
+void levelctl_observe_wait(int priority, uint64_t wait_us);
+
+// bytes octets compressés en busy_us au niveau level.
+void levelctl_observe_codec(int level, size_t bytes, uint64_t busy_us);
+
+// Vrai pour un seul appelant par période : c'est lui qui appelle update.
+bool levelctl_due(uint64_t now_us);
+void levelctl_update(uint64_t now_us, int pending, int nworkers);
+
+// Niveau à utiliser pour une nouvelle trame.
+int levelctl_level(void);
+
+// Débit Zstd lissé par worker occupé (Mio/s), pour la console.
+double levelctl_mbps(void);
+
+#endif // LEVELCTL_H
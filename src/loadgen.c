@@ -0,0 +1,550 @@
+// src/loadgen.c
+//
+// Générateur de charge sans interface : N connexions simultanées vers un
+// scheduler_server local, chacune authentifiée sous un utilisateur de
+// users.txt (priorités mélangées), qui envoient des tâches synthétiques
+// (texte compressible, aléatoire incompressible, audio WAV à convertir) de tailles
+// tirées d'une distribution. Le résultat est une ligne JSON : débit, temps
+// jusqu'au premier octet et latence de bout en bout par priorité.
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <math.h>
+#include <poll.h>
+#include <pthread.h>
+#include <time.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+#include "utils.h"
+#include "protocol.h"
+
+#define DEFAULT_SERVER_PORT 5000
+#define MAX_USERS 64
+#define MAX_PIPELINE 64                 // CONN_MAX_STREAMS côté serveur
+#define CORPUS_SIZE (16 * 1024 * 1024)  // au-delà de la fenêtre Zstd niveau 9
+#define NPRIO 3
+#define WAV_HEADER_SIZE 44
+#define WAV_RATE 44100
+#define TWO_PI 6.283185307179586
+
+typedef enum { KIND_TEXT, KIND_RANDOM, KIND_MEDIA, KIND_COUNT } PayloadKind;
+static const char *kind_names[KIND_COUNT] = { "text", "random", "media" };
+
+// Distribution des tailles : fixed:N, uniform:A-B, exp:MOYENNE
+typedef struct {
+    char law;
+    uint64_t a, b;
+} SizeDist;
+
+typedef struct {
+    char name[64];
+} User;
+
+typedef struct {
+    int priority;
+    bool error;
+    uint64_t bytes_in, bytes_out;
+    double ttfb_ms, latency_ms;
+} TaskResult;
+
+// Une tâche en cours sur une connexion
+typedef struct {
+    uint32_t id;
+    PayloadKind kind;
+    uint64_t size, sent;
+    uint64_t window;
+    uint64_t corpus_off;
+    uint64_t t_submit, t_first;
+    bool end_sent;
+    TaskResult *res;
+} LiveTask;
+
+typedef struct {
+    int index;
+    const char *user;
+    TaskResult *results;        // tranche de cette connexion
+    uint64_t rng;
+    int failed;                 // connexion perdue ou refusée avant la fin
+} ConnArg;
+
+// Paramètres de la campagne
+static const char *host = "127.0.0.1";
+static int port = DEFAULT_SERVER_PORT;
+static int nconns = 4;
+static int tasks_per_conn = 8;
+static int pipeline = 1;
+static SizeDist dist = { 'u', 64 * 1024, 1024 * 1024 };
+static int mix[KIND_COUNT] = { 60, 30, 10 };
+static const char *label = "default";
+static User users[MAX_USERS];
+static int nusers = 0;
+
+static char *corpus[KIND_COUNT];
+
+static uint64_t now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000u + (uint64_t)ts.tv_nsec / 1000u;
+}
+
+static uint64_t xorshift(uint64_t *s) {
+    uint64_t x = *s;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    return *s = x;
+}
+
+static double uniform01(uint64_t *s) {
+    return (double)(xorshift(s) >> 11) / (double)(1ULL << 53);
+}
+
+// "64K", "4M", "1G" -> octets
+static uint64_t parse_size(const char *s) {
+    char *end;
+    double v = strtod(s, &end);
+    switch (*end) {
+        case 'k': case 'K': v *= 1024; break;
+        case 'm': case 'M': v *= 1024 * 1024; break;
+        case 'g': case 'G': v *= 1024.0 * 1024 * 1024; break;
+    }
+    return (uint64_t)v;
+}
+
+static int parse_dist(const char *s, SizeDist *d) {
+    if (strncmp(s, "fixed:", 6) == 0) {
+        d->law = 'f';
+        d->a = d->b = parse_size(s + 6);
+    } else if (strncmp(s, "uniform:", 8) == 0) {
+        const char *dash = strchr(s + 8, '-');
+        if (!dash) return -1;
+        d->law = 'u';
+        d->a = parse_size(s + 8);
+        d->b = parse_size(dash + 1);
+        if (d->b < d->a) return -1;
+    } else if (strncmp(s, "exp:", 4) == 0) {
+        d->law = 'e';
+        d->a = parse_size(s + 4);
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+// "text:60,random:30,media:10"
+static int parse_mix(const char *s) {
+    int m[KIND_COUNT] = { 0 };
+    char *copy = strdup(s);
+    char *save = NULL;
+    for (char *tok = strtok_r(copy, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+        char *colon = strchr(tok, ':');
+        int k;
+        for (k = 0; k < KIND_COUNT; k++) {
+            if (colon && strncmp(tok, kind_names[k], colon - tok) == 0 &&
+                strlen(kind_names[k]) == (size_t)(colon - tok)) break;
+        }
+        if (k == KIND_COUNT) {
+            free(copy);
+            return -1;
+        }
+        m[k] = atoi(colon + 1);
+    }
+    free(copy);
+    if (m[0] + m[1] + m[2] <= 0) return -1;
+    memcpy(mix, m, sizeof(mix));
+    return 0;
+}
+
+static int load_user_names(const char *path) {
+    FILE *f = fopen(path, "r");
+    if (!f) return -1;
+    char line[256];
+    while (nusers < MAX_USERS && fgets(line, sizeof(line), f)) {
+        if (line[0] == '#' || line[0] == '\n') continue;
+        char *colon = strchr(line, ':');
+        if (!colon) continue;
+        *colon = '\0';
+        size_t n = strnlen(line, sizeof(users[0].name) - 1);
+        memcpy(users[nusers].name, line, n);
+        users[nusers++].name[n] = '\0';
+    }
+    fclose(f);
+    return nusers;
+}
+
+static uint64_t draw_size(uint64_t *rng) {
+    switch (dist.law) {
+        case 'f': return dist.a;
+        case 'u': return dist.a + (uint64_t)(uniform01(rng) * (double)(dist.b - dist.a + 1));
+        default:  return (uint64_t)(-log(1.0 - uniform01(rng)) * (double)dist.a);
+    }
+}
+
+static PayloadKind draw_kind(uint64_t *rng) {
+    int total = mix[0] + mix[1] + mix[2];
+    int r = (int)(xorshift(rng) % (uint64_t)total);
+    for (int k = 0; k < KIND_COUNT; k++) {
+        if (r < mix[k]) return (PayloadKind)k;
+        r -= mix[k];
+    }
+    return KIND_TEXT;
+}
+
+static void put_le16(char *p, uint16_t v) {
+    p[0] = (char)v; p[1] = (char)(v >> 8);
+}
+
+static void put_le32(char *p, uint32_t v) {
+    put_le16(p, (uint16_t)v); put_le16(p + 2, (uint16_t)(v >> 16));
+}
+
+// Audio : WAV PCM 16 bits stéréo que ffmpeg sait vraiment convertir. Tailles
+// RIFF et data maximales, comme un WAV diffusé en flux : ffmpeg lit jusqu'à
+// la fin de l'entrée, quelle que soit la taille de la tâche.
+static void build_wav(char *buf, uint64_t *s) {
+    memcpy(buf, "RIFF", 4);
+    put_le32(buf + 4, UINT32_MAX);
+    memcpy(buf + 8, "WAVEfmt ", 8);
+    put_le32(buf + 16, 16);
+    put_le16(buf + 20, 1);                      // PCM
+    put_le16(buf + 22, 2);                      // stéréo
+    put_le32(buf + 24, WAV_RATE);
+    put_le32(buf + 28, WAV_RATE * 4);           // octets par seconde
+    put_le16(buf + 32, 4);                      // octets par échantillon stéréo
+    put_le16(buf + 34, 16);
+    memcpy(buf + 36, "data", 4);
+    put_le32(buf + 40, UINT32_MAX - WAV_HEADER_SIZE + 8);
+    // Deux sons purs et un peu de bruit : assez de contenu pour l'encodeur
+    for (size_t i = WAV_HEADER_SIZE; i + 4 <= CORPUS_SIZE; i += 4) {
+        double x = (double)(i - WAV_HEADER_SIZE) / 4 / WAV_RATE;
+        double noise = (double)(xorshift(s) % 2001) - 1000;
+        put_le16(buf + i, (uint16_t)(int16_t)(8000 * sin(TWO_PI * 440 * x) + noise));
+        put_le16(buf + i + 2, (uint16_t)(int16_t)(8000 * sin(TWO_PI * 660 * x) + noise));
+    }
+}
+
+// Données de référence partagées : les tâches y lisent à un décalage aléatoire
+// (le flux audio, lui, part toujours de son en-tête)
+static int build_corpus(void) {
+    uint64_t s = 0x9E3779B97F4A7C15ULL;
+    for (int k = 0; k < KIND_COUNT; k++) {
+        corpus[k] = malloc(CORPUS_SIZE);
+        if (!corpus[k]) return -1;
+    }
+    // Texte : lignes de journal variées, compressibles (~5-10x)
+    static const char *words[] = {
+        "tâche", "client", "quantum", "priorité", "octets", "serveur", "flux",
+        "compression", "trame", "fenêtre", "worker", "file", "latence", "débit"
+    };
+    size_t off = 0;
+    uint64_t line = 0;
+    while (off < CORPUS_SIZE) {
+        char buf[160];
+        int n = snprintf(buf, sizeof(buf), "%llu %s %s %s=%llu\n",
+                         (unsigned long long)line++, words[xorshift(&s) % 14],
+                         words[xorshift(&s) % 14], words[xorshift(&s) % 14],
+                         (unsigned long long)(xorshift(&s) % 100000));
+        size_t k = (size_t)n < CORPUS_SIZE - off ? (size_t)n : CORPUS_SIZE - off;
+        memcpy(corpus[KIND_TEXT] + off, buf, k);
+        off += k;
+    }
+    // Aléatoire : incompressible
+    uint64_t *p = (uint64_t *)corpus[KIND_RANDOM];
+    for (size_t i = 0; i < CORPUS_SIZE / 8; i++) p[i] = xorshift(&s);
+    build_wav(corpus[KIND_MEDIA], &s);
+    return 0;
+}
+
+static int connect_server(void) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_port = htons(port) };
+    if (inet_pton(AF_INET, host, &addr.sin_addr) != 1 ||
+        connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static int send_task_header(int fd, LiveTask *t) {
+    ProtoTask pt = { 0 };
+    pt.type = t->kind == KIND_MEDIA ? PROTO_TASK_CONVERT : PROTO_TASK_COMPRESS;
+    pt.total_size = t->size;
+    snprintf(pt.meta, sizeof(pt.meta), "loadgen-%u.%s", t->id,
+             t->kind == KIND_MEDIA ? "wav" : t->kind == KIND_TEXT ? "log" : "bin");
+    if (t->kind == KIND_MEDIA) snprintf(pt.out, sizeof(pt.out), "loadgen-%u.mp3", t->id);
+    uint8_t buf[PROTO_TASK_FIXED + 2 * PROTO_MAX_NAME];
+    ssize_t n = proto_encode_task(&pt, buf, sizeof(buf));
+    if (n < 0) return -1;
+    t->t_submit = now_us();
+    return proto_send(fd, FRAME_TASK, t->id, buf, (uint32_t)n);
+}
+
+// Envoie une trame DATA de la tâche (et END à la fin) ; fenêtre respectée
+static int send_chunk(int fd, LiveTask *t) {
+    uint64_t n = t->size - t->sent;
+    if (n > PROTO_DATA_CHUNK) n = PROTO_DATA_CHUNK;
+    if (n > t->window) n = t->window;
+    if (n) {
+        uint64_t off = (t->corpus_off + t->sent) % CORPUS_SIZE;
+        // Audio plus long que le corpus : les échantillons bouclent, sans
+        // répéter l'en-tête
+        if (t->kind == KIND_MEDIA && t->sent >= WAV_HEADER_SIZE) {
+            off = WAV_HEADER_SIZE + (t->sent - WAV_HEADER_SIZE) % (CORPUS_SIZE - WAV_HEADER_SIZE);
+        }
+        if (off + n > CORPUS_SIZE) n = CORPUS_SIZE - off;
+        if (proto_send(fd, FRAME_DATA, t->id, corpus[t->kind] + off, (uint32_t)n) < 0) return -1;
+        t->sent += n;
+        t->window -= n;
+    }
+    if (t->sent == t->size && !t->end_sent) {
+        if (proto_send(fd, FRAME_END, t->id, NULL, 0) < 0) return -1;
+        t->end_sent = true;
+    }
+    return 0;
+}
+
+static LiveTask *find_live(LiveTask *live, int nlive, uint32_t id) {
+    for (int i = 0; i < nlive; i++) {
+        if (live[i].id == id) return &live[i];
+    }
+    return NULL;
+}
+
+// Connexion refusée ou perdue : ses tâches non terminées comptent en erreurs
+static void conn_failed(ConnArg *ca, int from) {
+    ca->failed = 1;
+    for (int i = from; i < tasks_per_conn; i++) ca->results[i].error = true;
+}
+
+static void *conn_thread(void *arg) {
+    ConnArg *ca = arg;
+    int fd = connect_server();
+    if (fd < 0) {
+        conn_failed(ca, 0);
+        return NULL;
+    }
+    uint8_t *rbuf = malloc(PROTO_HEADER_SIZE + PROTO_MAX_PAYLOAD);
+    size_t rlen = 0;
+    ProtoHeader h;
+    int priority = 2;
+    if (!rbuf || proto_send(fd, FRAME_AUTH, 0, ca->user, (uint32_t)strlen(ca->user)) < 0 ||
+        proto_recv(fd, &h, rbuf, PROTO_MAX_PAYLOAD) < 0 || h.type != FRAME_AUTH_OK) {
+        conn_failed(ca, 0);
+        free(rbuf);
+        close(fd);
+        return NULL;
+    }
+    if (h.length >= 4) priority = (int)get_u32(rbuf);
+
+    LiveTask live[MAX_PIPELINE];
+    int nlive = 0, started = 0, finished = 0, rr = 0;
+    uint32_t next_id = 1;
+
+    while (finished < tasks_per_conn) {
+        while (nlive < pipeline && started < tasks_per_conn) {
+            LiveTask *t = &live[nlive++];
+            memset(t, 0, sizeof(*t));
+            t->id = next_id++;
+            t->kind = draw_kind(&ca->rng);
+            t->size = draw_size(&ca->rng);
+            t->window = PROTO_INITIAL_WINDOW;
+            t->corpus_off = xorshift(&ca->rng) % CORPUS_SIZE;
+            if (t->kind == KIND_MEDIA) t->corpus_off = 0;
+            t->res = &ca->results[started++];
+            t->res->priority = priority;
+            t->res->bytes_in = t->size;
+            if (send_task_header(fd, t) < 0 || (t->size == 0 && send_chunk(fd, t) < 0)) goto lost;
+        }
+
+        bool sendable = false;
+        for (int i = 0; i < nlive && !sendable; i++) {
+            sendable = !live[i].end_sent && (live[i].window > 0 || live[i].sent == live[i].size);
+        }
+        struct pollfd pfd = { .fd = fd, .events = POLLIN | (sendable ? POLLOUT : 0) };
+        if (poll(&pfd, 1, 5000) < 0 && errno != EINTR) goto lost;
+
+        if (pfd.revents & (POLLIN | POLLHUP | POLLERR)) {
+            ssize_t n = recv(fd, rbuf + rlen, PROTO_HEADER_SIZE + PROTO_MAX_PAYLOAD - rlen, MSG_DONTWAIT);
+            if (n == 0 || (n < 0 && errno != EAGAIN && errno != EINTR)) goto lost;
+            if (n > 0) rlen += n;
+            size_t off = 0;
+            while (rlen - off >= PROTO_HEADER_SIZE) {
+                if (proto_parse_header(rbuf + off, &h) < 0) goto lost;
+                if (rlen - off < PROTO_HEADER_SIZE + h.length) break;
+                const uint8_t *p = rbuf + off + PROTO_HEADER_SIZE;
+                LiveTask *t = find_live(live, nlive, h.task_id);
+                if (t && h.type == FRAME_DATA) {
+                    if (!t->t_first) t->t_first = now_us();
+                    t->res->bytes_out += h.length;
+                } else if (t && h.type == FRAME_WINDOW && h.length >= 4) {
+                    t->window += get_u32(p);
+                } else if (t && (h.type == FRAME_END || h.type == FRAME_ERROR)) {
+                    uint64_t end = now_us();
+                    t->res->error = h.type == FRAME_ERROR;
+                    t->res->latency_ms = (end - t->t_submit) / 1000.0;
+                    t->res->ttfb_ms = ((t->t_first ? t->t_first : end) - t->t_submit) / 1000.0;
+                    *t = live[--nlive];
+                    finished++;
+                } else if (!t && h.type == FRAME_ERROR && h.task_id == 0) {
+                    goto lost;
+                }
+                off += PROTO_HEADER_SIZE + h.length;
+            }
+            memmove(rbuf, rbuf + off, rlen - off);
+            rlen -= off;
+        }
+        if ((pfd.revents & POLLOUT) && nlive > 0) {
+            // Tourniquet entre les tâches de la connexion
+            for (int i = 0; i < nlive; i++) {
+                LiveTask *t = &live[(rr + i) % nlive];
+                if (!t->end_sent && (t->window > 0 || t->sent == t->size)) {
+                    if (send_chunk(fd, t) < 0) goto lost;
+                    rr = (rr + i + 1) % nlive;
+                    break;
+                }
+            }
+        }
+    }
+    proto_send(fd, FRAME_BYE, 0, NULL, 0);
+    free(rbuf);
+    close(fd);
+    return NULL;
+
+lost:
+    for (int i = 0; i < nlive; i++) live[i].res->error = true;
+    conn_failed(ca, started);
+    free(rbuf);
+    close(fd);
+    return NULL;
+}
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+static double pct(const double *v, size_t n, double q) {
+    if (n == 0) return 0;
+    size_t i = (size_t)(q * (double)n);
+    return v[i < n ? i : n - 1];
+}
+
+static void usage(const char *argv0) {
+    fprintf(stderr,
+            "Usage : %s [-H hôte] [-P port] [-c connexions] [-n tâches_par_connexion]\n"
+            "          [-p tâches_en_parallèle] [-s fixed:N|uniform:A-B|exp:MOY]\n"
+            "          [-m text:P,random:P,media:P] [-U users.txt] [-l nom] [-S graine]\n",
+            argv0);
+}
+
+int main(int argc, char *argv[]) {
+    const char *users_file = "users.txt";
+    uint64_t seed = 42;
+    int opt;
+    while ((opt = getopt(argc, argv, "H:P:c:n:p:s:m:U:l:S:")) != -1) {
+        switch (opt) {
+            case 'H': host = optarg; break;
+            case 'P': port = atoi(optarg); break;
+            case 'c': nconns = atoi(optarg); break;
+            case 'n': tasks_per_conn = atoi(optarg); break;
+            case 'p': pipeline = atoi(optarg); break;
+            case 's': if (parse_dist(optarg, &dist) < 0) { usage(argv[0]); return 1; } break;
+            case 'm': if (parse_mix(optarg) < 0) { usage(argv[0]); return 1; } break;
+            case 'U': users_file = optarg; break;
+            case 'l': label = optarg; break;
+            case 'S': seed = strtoull(optarg, NULL, 10); break;
+            default: usage(argv[0]); return 1;
+        }
+    }
+    if (nconns < 1 || tasks_per_conn < 1 || pipeline < 1 || pipeline > MAX_PIPELINE) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (load_user_names(users_file) <= 0) {
+        fprintf(stderr, "Aucun utilisateur dans %s\n", users_file);
+        return 1;
+    }
+    if (build_corpus() < 0) {
+        fprintf(stderr, "Mémoire insuffisante\n");
+        return 1;
+    }
+
+    TaskResult *results = calloc((size_t)nconns * tasks_per_conn, sizeof(TaskResult));
+    ConnArg *args = calloc(nconns, sizeof(ConnArg));
+    pthread_t *threads = calloc(nconns, sizeof(pthread_t));
+    if (!results || !args || !threads) return 1;
+
+    uint64_t t0 = now_us();
+    for (int i = 0; i < nconns; i++) {
+        args[i].index = i;
+        args[i].user = users[i % nusers].name;
+        args[i].results = results + (size_t)i * tasks_per_conn;
+        args[i].rng = seed * 0x100000001B3ULL + (uint64_t)i * 0x9E3779B97F4A7C15ULL + 1;
+        pthread_create(&threads[i], NULL, conn_thread, &args[i]);
+    }
+    int failed_conns = 0;
+    for (int i = 0; i < nconns; i++) {
+        pthread_join(threads[i], NULL);
+        failed_conns += args[i].failed;
+    }
+    double wall = (now_us() - t0) / 1e6;
+
+    // Agrégats globaux et par priorité
+    size_t total = (size_t)nconns * tasks_per_conn;
+    uint64_t bytes_in = 0, bytes_out = 0;
+    size_t errors = 0;
+    double *lat[NPRIO], *ttfb[NPRIO];
+    size_t cnt[NPRIO] = { 0 };
+    uint64_t cls_in[NPRIO] = { 0 };
+    for (int p = 0; p < NPRIO; p++) {
+        lat[p] = calloc(total, sizeof(double));
+        ttfb[p] = calloc(total, sizeof(double));
+    }
+    for (size_t i = 0; i < total; i++) {
+        TaskResult *r = &results[i];
+        if (r->error) {
+            errors++;
+            continue;
+        }
+        int p = r->priority < 0 ? 0 : r->priority >= NPRIO ? NPRIO - 1 : r->priority;
+        bytes_in += r->bytes_in;
+        bytes_out += r->bytes_out;
+        cls_in[p] += r->bytes_in;
+        lat[p][cnt[p]] = r->latency_ms;
+        ttfb[p][cnt[p]] = r->ttfb_ms;
+        cnt[p]++;
+    }
+
+    printf("{\"scenario\":\"%s\",\"connections\":%d,\"tasks\":%zu,\"errors\":%zu,"
+           "\"failed_connections\":%d,\"wall_s\":%.3f,\"bytes_in\":%llu,\"bytes_out\":%llu,"
+           "\"throughput_MBps\":%.2f,\"tasks_per_s\":%.2f,\"classes\":[",
+           label, nconns, total, errors, failed_conns, wall,
+           (unsigned long long)bytes_in, (unsigned long long)bytes_out,
+           wall > 0 ? bytes_in / wall / 1e6 : 0.0, wall > 0 ? (total - errors) / wall : 0.0);
+    bool first = true;
+    for (int p = 0; p < NPRIO; p++) {
+        if (cnt[p] == 0) continue;
+        qsort(lat[p], cnt[p], sizeof(double), cmp_double);
+        qsort(ttfb[p], cnt[p], sizeof(double), cmp_double);
+        printf("%s{\"priority\":%d,\"tasks\":%zu,\"bytes_in\":%llu,"
+               "\"ttfb_ms\":{\"p50\":%.3f,\"p99\":%.3f,\"p999\":%.3f},"
+               "\"latency_ms\":{\"p50\":%.3f,\"p99\":%.3f,\"p999\":%.3f,\"max\":%.3f}}",
+               first ? "" : ",", p, cnt[p], (unsigned long long)cls_in[p],
+               pct(ttfb[p], cnt[p], 0.5), pct(ttfb[p], cnt[p], 0.99), pct(ttfb[p], cnt[p], 0.999),
+               pct(lat[p], cnt[p], 0.5), pct(lat[p], cnt[p], 0.99), pct(lat[p], cnt[p], 0.999),
+               lat[p][cnt[p] - 1]);
+        first = false;
+    }
+    printf("]}\n");
+    return errors || failed_conns ? 2 : 0;
+}
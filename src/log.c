@@ -1,16 +1,176 @@
 #include "log.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
 #include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
 
 #define LOGFILE "/tmp/scheduler_network.log"
+// Nombre d'entrées de l'anneau (puissance de 2)
+#define LOG_RING_SIZE 4096
+// Taille max d'un message (tronqué au-delà)
+#define LOG_MSG_MAX 224
+// Le thread d'écriture regroupe jusqu'à LOG_BATCH_BYTES par write()
+#define LOG_BATCH_BYTES (64 * 1024)
+#define LOG_LINE_MAX (LOG_MSG_MAX + 64)
+// Pause du thread d'écriture quand l'anneau est vide
+#define LOG_IDLE_MS 10
+
+// Une entrée de l'anneau. seq (file bornée de Vyukov) : == position quand
+// l'entrée est libre pour ce tour, == position + 1 quand elle est remplie.
+typedef struct {
+    size_t seq;
+    struct timespec ts;
+    int level;
+    int task_id;
+    char msg[LOG_MSG_MAX];
+} LogRecord;
+
+static LogRecord ring[LOG_RING_SIZE];
+static size_t ring_tail = 0;    // atomique : prochaine position à réserver
+static size_t ring_head = 0;    // atomique : prochaine position à écrire (thread d'écriture)
+static long overflows = 0;      // atomique
+static int min_level = LOG_INFO;
+static int log_fd = -1;
+static pthread_once_t log_once = PTHREAD_ONCE_INIT;
+
+static const char *level_name[] = { "DEBUG", "INFO", "WARN", "ERROR" };
+
+// Formate une entrée en ligne de journal ; retourne sa longueur
+static size_t format_record(char *out, size_t cap, const LogRecord *r) {
+    static time_t last_sec = -1;
+    static char stamp[32];
+    if (r->ts.tv_sec != last_sec) {
+        struct tm tm;
+        localtime_r(&r->ts.tv_sec, &tm);
+        strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", &tm);
+        last_sec = r->ts.tv_sec;
+    }
+    int n;
+    if (r->task_id >= 0) {
+        n = snprintf(out, cap, "%s.%03ld %-5s [task %d] %s\n", stamp, r->ts.tv_nsec / 1000000L,
+                     level_name[r->level], r->task_id, r->msg);
+    } else {
+        n = snprintf(out, cap, "%s.%03ld %-5s %s\n", stamp, r->ts.tv_nsec / 1000000L,
+                     level_name[r->level], r->msg);
+    }
+    if (n < 0) return 0;
+    return (size_t)n < cap ? (size_t)n : cap - 1;
+}
+
+static void write_batch(const char *buf, size_t len) {
+    if (log_fd < 0) log_fd = open(LOGFILE, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+    while (log_fd >= 0 && len > 0) {
+        ssize_t w = write(log_fd, buf, len);
+        if (w < 0 && errno == EINTR) continue;
+        if (w <= 0) return;
+        buf += w;
+        len -= w;
+    }
+}
+
+static void *log_thread(void *arg) {
+    (void)arg;
+    static char out[LOG_BATCH_BYTES];
+    long reported = 0;
+    for (;;) {
+        size_t len = 0;
+        size_t head = __atomic_load_n(&ring_head, __ATOMIC_RELAXED);
+        while (len + LOG_LINE_MAX <= sizeof(out)) {
+            LogRecord *r = &ring[head & (LOG_RING_SIZE - 1)];
+            if (__atomic_load_n(&r->seq, __ATOMIC_ACQUIRE) != head + 1) break;
+            len += format_record(out + len, sizeof(out) - len, r);
+            // L'entrée redevient libre pour le tour suivant de l'anneau
+            __atomic_store_n(&r->seq, head + LOG_RING_SIZE, __ATOMIC_RELEASE);
+            head++;
+        }
+        long lost = __atomic_load_n(&overflows, __ATOMIC_RELAXED);
+        if (lost != reported && len + LOG_LINE_MAX <= sizeof(out)) {
+            LogRecord r = { .level = LOG_WARN, .task_id = -1 };
+            clock_gettime(CLOCK_REALTIME, &r.ts);
+            snprintf(r.msg, sizeof(r.msg), "log: %ld messages perdus (anneau plein)", lost - reported);
+            len += format_record(out + len, sizeof(out) - len, &r);
+            reported = lost;
+        }
+        if (len) write_batch(out, len);
+        __atomic_store_n(&ring_head, head, __ATOMIC_RELEASE);
+        if (len == 0) {
+            struct timespec idle = { 0, LOG_IDLE_MS * 1000000L };
+            nanosleep(&idle, NULL);
+        }
+    }
+    return NULL;
+}
+
+static void log_start(void) {
+    for (size_t i = 0; i < LOG_RING_SIZE; i++) ring[i].seq = i;
+    pthread_t tid;
+    if (pthread_create(&tid, NULL, log_thread, NULL) != 0) return;
+    pthread_detach(tid);
+    atexit(log_flush);
+}
+
+static void log_push(LogLevel level, int task_id, const char *format, va_list args) {
+    if ((int)level < __atomic_load_n(&min_level, __ATOMIC_RELAXED)) return;
+    pthread_once(&log_once, log_start);
+
+    size_t pos = __atomic_load_n(&ring_tail, __ATOMIC_RELAXED);
+    LogRecord *r;
+    for (;;) {
+        r = &ring[pos & (LOG_RING_SIZE - 1)];
+        size_t seq = __atomic_load_n(&r->seq, __ATOMIC_ACQUIRE);
+        intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&ring_tail, &pos, pos + 1, true,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) break;
+        } else if (diff < 0) {
+            // Tour précédent pas encore écrit : anneau plein
+            __atomic_add_fetch(&overflows, 1, __ATOMIC_RELAXED);
+            return;
+        } else {
+            pos = __atomic_load_n(&ring_tail, __ATOMIC_RELAXED);
+        }
+    }
+    clock_gettime(CLOCK_REALTIME, &r->ts);
+    r->level = level;
+    r->task_id = task_id;
+    vsnprintf(r->msg, sizeof(r->msg), format, args);
+    __atomic_store_n(&r->seq, pos + 1, __ATOMIC_RELEASE);
+}
 
 void log_internal(const char *format, ...) {
     va_list args;
     va_start(args, format);
-    FILE *f = fopen(LOGFILE, "a");
-    if (!f) { va_end(args); return; }
-    vfprintf(f, format, args);
-    fprintf(f, "\n");
-    fclose(f);
+    log_push(LOG_INFO, -1, format, args);
+    va_end(args);
+}
+
+void log_msg(LogLevel level, int task_id, const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    log_push(level, task_id, format, args);
     va_end(args);
 }
+
+void log_set_level(LogLevel level) {
+    __atomic_store_n(&min_level, (int)level, __ATOMIC_RELAXED);
+}
+
+long log_overflows(void) {
+    return __atomic_load_n(&overflows, __ATOMIC_RELAXED);
+}
+
+void log_flush(void) {
+    size_t target = __atomic_load_n(&ring_tail, __ATOMIC_ACQUIRE);
+    // Borné : un thread d'écriture bloqué ne doit pas empêcher l'arrêt
+    for (int i = 0; i < 200 && __atomic_load_n(&ring_head, __ATOMIC_ACQUIRE) < target; i++) {
+        struct timespec ms = { 0, 5 * 1000000L };
+        nanosleep(&ms, NULL);
+    }
+}
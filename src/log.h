@@ -1,6 +1,31 @@
 #ifndef LOG_H
 #define LOG_H
 
-void log_internal(const char *format, ...);
+typedef enum {
+    LOG_DEBUG,
+    LOG_INFO,
+    LOG_WARN,
+    LOG_ERROR
+} LogLevel;
+
+// Journal asynchrone : l'appelant formate son message dans un anneau sans
+// verrou et repart aussitôt ; un thread dédié écrit les lignes par lots.
+// Anneau plein : le message est compté comme perdu, jamais attendu.
+
+// Niveau INFO, sans tâche (compatible avec les appels existants).
+void log_internal(const char *format, ...) __attribute__((format(printf, 1, 2)));
+
+// task_id < 0 : message sans tâche.
+void log_msg(LogLevel level, int task_id, const char *format, ...)
+    __attribute__((format(printf, 3, 4)));
+
+// Les messages sous ce niveau sont ignorés dès l'appel (défaut : LOG_INFO).
+void log_set_level(LogLevel level);
+
+// Messages perdus faute de place dans l'anneau.
+long log_overflows(void);
+
+// Attend que tout ce qui a été journalisé soit écrit (arrêt du serveur).
+void log_flush(void);
 
 #endif // LOG_H
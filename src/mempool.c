@@ -0,0 +1,206 @@
+#include "mempool.h"
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Taille visée d'un bloc demandé à malloc
+#define SLAB_BLOCK_BYTES (256 * 1024)
+// Octets gardés au plus dans le cache d'un thread, par slab
+#define SLAB_CACHE_BYTES (512 * 1024)
+
+typedef struct {
+    void *head;
+    size_t n;
+} SlabCache;
+
+static __thread SlabCache tls_cache[SLAB_MAX];
+static int slab_count = 0;      // atomique
+static Slab *slab_registry[SLAB_MAX];
+
+static size_t slab_stride(const Slab *s) {
+    size_t a = s->align < sizeof(void *) ? sizeof(void *) : s->align;
+    return (s->obj_size + a - 1) & ~(a - 1);
+}
+
+// Objets gardés par thread : assez pour absorber les rafales, borné en octets
+static size_t slab_cache_limit(const Slab *s) {
+    size_t n = SLAB_CACHE_BYTES / slab_stride(s);
+    if (n < 2) n = 2;
+    if (n > 64) n = 64;
+    return n;
+}
+
+static SlabCache *slab_cache(Slab *s) {
+    int id = __atomic_load_n(&s->id, __ATOMIC_ACQUIRE);
+    if (id == 0) {
+        pthread_mutex_lock(&s->lock);
+        id = s->id;
+        if (id == 0) {
+            id = __atomic_add_fetch(&slab_count, 1, __ATOMIC_RELAXED);
+            // Plus de caches disponibles : ce slab passe toujours par la liste commune
+            if (id > SLAB_MAX) id = -1;
+            else __atomic_store_n(&slab_registry[id - 1], s, __ATOMIC_RELEASE);
+            __atomic_store_n(&s->id, id, __ATOMIC_RELEASE);
+        }
+        pthread_mutex_unlock(&s->lock);
+    }
+    return id > 0 ? &tls_cache[id - 1] : NULL;
+}
+
+static inline void push(void **head, void *obj) {
+    *(void **)obj = *head;
+    *head = obj;
+}
+
+static inline void *pop(void **head) {
+    void *obj = *head;
+    if (obj) *head = *(void **)obj;
+    return obj;
+}
+
+// Nouveau bloc : tous ses objets vont dans la liste commune (verrou tenu)
+static int slab_grow(Slab *s) {
+    size_t stride = slab_stride(s);
+    size_t per = SLAB_BLOCK_BYTES / stride;
+    if (per < 1) per = 1;
+    void *block;
+    size_t a = s->align < sizeof(void *) ? sizeof(void *) : s->align;
+    if (posix_memalign(&block, a, per * stride) != 0) return -1;
+    for (size_t i = 0; i < per; i++) push(&s->free, (char *)block + i * stride);
+    s->nfree += per;
+    __atomic_add_fetch(&s->misses, 1, __ATOMIC_RELAXED);
+    return 0;
+}
+
+// Objet libre tel quel, sans mise à zéro
+static void *slab_take(Slab *s) {
+    SlabCache *c = slab_cache(s);
+    void *obj = c ? pop(&c->head) : NULL;
+    if (obj) {
+        c->n--;
+        __atomic_add_fetch(&s->hits, 1, __ATOMIC_RELAXED);
+    } else {
+        pthread_mutex_lock(&s->lock);
+        bool grown = false;
+        if (!s->free) {
+            if (slab_grow(s) < 0) {
+                pthread_mutex_unlock(&s->lock);
+                return NULL;
+            }
+            grown = true;
+        }
+        obj = pop(&s->free);
+        s->nfree--;
+        // Un lot d'avance pour les prochaines allocations de ce thread
+        if (c) {
+            size_t batch = slab_cache_limit(s) / 2;
+            while (c->n < batch && s->free) {
+                push(&c->head, pop(&s->free));
+                s->nfree--;
+                c->n++;
+            }
+        }
+        pthread_mutex_unlock(&s->lock);
+        if (!grown) __atomic_add_fetch(&s->hits, 1, __ATOMIC_RELAXED);
+    }
+    __atomic_add_fetch(&s->in_use, 1, __ATOMIC_RELAXED);
+    return obj;
+}
+
+void *slab_alloc(Slab *s) {
+    void *obj = slab_take(s);
+    if (obj) memset(obj, 0, s->obj_size);
+    return obj;
+}
+
+void slab_free(Slab *s, void *obj) {
+    if (!obj) return;
+    __atomic_sub_fetch(&s->in_use, 1, __ATOMIC_RELAXED);
+    SlabCache *c = slab_cache(s);
+    if (c) {
+        push(&c->head, obj);
+        if (++c->n <= slab_cache_limit(s)) return;
+        // Trop d'objets en local (libérés par un autre thread que celui qui
+        // alloue) : la moitié repart vers la liste commune
+        size_t batch = slab_cache_limit(s) / 2;
+        pthread_mutex_lock(&s->lock);
+        while (batch-- > 0 && c->head) {
+            push(&s->free, pop(&c->head));
+            s->nfree++;
+            c->n--;
+        }
+        pthread_mutex_unlock(&s->lock);
+        return;
+    }
+    pthread_mutex_lock(&s->lock);
+    push(&s->free, obj);
+    s->nfree++;
+    pthread_mutex_unlock(&s->lock);
+}
+
+static Slab buf_classes[BUFPOOL_CLASSES];
+static char buf_names[BUFPOOL_CLASSES][16];
+static pthread_once_t buf_once = PTHREAD_ONCE_INIT;
+
+static void bufpool_init(void) {
+    for (int i = 0; i < BUFPOOL_CLASSES; i++) {
+        size_t size = (size_t)1 << (BUFPOOL_MIN_SHIFT + i);
+        if (size >= 1024 * 1024) snprintf(buf_names[i], sizeof(buf_names[i]), "buf-%zuM", size >> 20);
+        else if (size >= 1024) snprintf(buf_names[i], sizeof(buf_names[i]), "buf-%zuK", size >> 10);
+        else snprintf(buf_names[i], sizeof(buf_names[i]), "buf-%zu", size);
+        Slab s = SLAB_INITIALIZER(buf_names[i], size, size >= 4096 ? 4096 : 64);
+        buf_classes[i] = s;
+    }
+}
+
+// Classe de taille de size, -1 si trop grand pour le pool
+static int buf_class(size_t size) {
+    int shift = BUFPOOL_MIN_SHIFT;
+    while (shift <= BUFPOOL_MAX_SHIFT && ((size_t)1 << shift) < size) shift++;
+    return shift > BUFPOOL_MAX_SHIFT ? -1 : shift - BUFPOOL_MIN_SHIFT;
+}
+
+void *bufpool_get(size_t size) {
+    pthread_once(&buf_once, bufpool_init);
+    int k = buf_class(size);
+    if (k < 0) return malloc(size);
+    // Pas de mise à zéro inutile pour un tampon d'E/S
+    return slab_take(&buf_classes[k]);
+}
+
+void bufpool_put(void *buf, size_t size) {
+    if (!buf) return;
+    int k = buf_class(size);
+    if (k < 0) {
+        free(buf);
+        return;
+    }
+    slab_free(&buf_classes[k], buf);
+}
+
+char *bufpool_strndup(const char *s, size_t n) {
+    size_t len = strnlen(s, n);
+    char *d = bufpool_get(len + 1);
+    if (!d) return NULL;
+    memcpy(d, s, len);
+    d[len] = '\0';
+    return d;
+}
+
+char *bufpool_strdup(const char *s) {
+    return bufpool_strndup(s, strlen(s));
+}
+
+void bufpool_strfree(char *s) {
+    if (s) bufpool_put(s, strlen(s) + 1);
+}
+
+void slab_foreach(void (*fn)(const Slab *s, void *ctx), void *ctx) {
+    int n = __atomic_load_n(&slab_count, __ATOMIC_ACQUIRE);
+    if (n > SLAB_MAX) n = SLAB_MAX;
+    for (int i = 0; i < n; i++) {
+        Slab *s = __atomic_load_n(&slab_registry[i], __ATOMIC_ACQUIRE);
+        if (s) fn(s, ctx);
+    }
+}
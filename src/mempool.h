@@ -0,0 +1,53 @@
+#ifndef MEMPOOL_H
+#define MEMPOOL_H
+
+#include <stddef.h>
+#include <pthread.h>
+
+// Nombre max de slabs (caches par thread indexés par slab)
+#define SLAB_MAX 32
+
+// Allocateur d'objets de taille fixe. Chaque thread garde une petite liste
+// d'objets libres ; les surplus et les manques s'échangent par lots avec la
+// liste commune. Les blocs obtenus de malloc ne sont jamais rendus : en
+// régime établi, allouer et libérer ne touche plus au tas.
+typedef struct Slab {
+    const char *name;
+    size_t obj_size;
+    size_t align;
+    int id;                     // attribué au premier usage (atomique)
+    pthread_mutex_t lock;
+    void *free;                 // liste commune des objets libres
+    size_t nfree;
+    long hits;                  // atomique : allocation servie sans malloc
+    long misses;                // atomique : nouveau bloc demandé à malloc
+    long in_use;                // atomique
+} Slab;
+
+#define SLAB_INITIALIZER(n, size, al) \
+    { .name = (n), .obj_size = (size), .align = (al), .id = 0, \
+      .lock = PTHREAD_MUTEX_INITIALIZER }
+
+// Objet mis à zéro, ou NULL si la mémoire manque.
+void *slab_alloc(Slab *s);
+void slab_free(Slab *s, void *obj);
+
+// Tampons d'E/S par classes de taille (puissances de 2, 64 o à 4 Mio, un
+// bloc de compression parallèle), alignés sur 64 o (4 Kio à partir de
+// 4 Kio). Au-delà : malloc direct. Le contenu n'est pas mis à zéro.
+#define BUFPOOL_MIN_SHIFT 6
+#define BUFPOOL_MAX_SHIFT 22
+#define BUFPOOL_CLASSES (BUFPOOL_MAX_SHIFT - BUFPOOL_MIN_SHIFT + 1)
+
+void *bufpool_get(size_t size);
+// size : la taille demandée à bufpool_get.
+void bufpool_put(void *buf, size_t size);
+
+char *bufpool_strdup(const char *s);
+char *bufpool_strndup(const char *s, size_t n);
+void bufpool_strfree(char *s);
+
+// Appelle fn pour chaque slab déjà utilisé (objets et classes de tampons).
+void slab_foreach(void (*fn)(const Slab *s, void *ctx), void *ctx);
+
+#endif // MEMPOOL_H
@@ -0,0 +1,344 @@
+#include "metrics.h"
+#include "log.h"
+#include "utils.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+
+// Histogramme log-linéaire : 8 sous-classes par puissance de 2, valeurs
+// bornées à 2^40 µs (~12 jours)
+#define HIST_SUB_BITS 3
+#define HIST_SUB (1 << HIST_SUB_BITS)
+#define HIST_MAX_EXP 40
+#define HIST_BUCKETS ((HIST_MAX_EXP - HIST_SUB_BITS + 2) * HIST_SUB)
+#define MAX_GAUGES 16
+
+// Compteurs d'un thread. Un seul écrivain : lecture + écriture relâchées
+// suffisent (pas d'instruction verrouillée), les lecteurs voient des
+// valeurs entières grâce aux accès atomiques.
+typedef struct Shard {
+    uint64_t counters[M_COUNTER_COUNT];
+    uint64_t hist[H_HIST_COUNT][HIST_BUCKETS];
+    uint64_t hist_sum[H_HIST_COUNT];
+    uint64_t hist_max[H_HIST_COUNT];
+    struct Shard *next;
+} Shard;
+
+typedef struct {
+    const char *name;
+    const char *help;
+    double (*fn)(void *ctx);
+    void *ctx;
+} Gauge;
+
+static __thread Shard *my_shard = NULL;
+static Shard *shards = NULL;
+static pthread_mutex_t shards_mutex = PTHREAD_MUTEX_INITIALIZER;
+static Gauge gauges[MAX_GAUGES];
+static int gauge_count = 0;
+
+static const struct {
+    const char *name;
+    const char *help;
+} counter_info[M_COUNTER_COUNT] = {
+    [M_CONNS_ACCEPTED]  = { "netsched_connections_accepted_total", "Connexions acceptées" },
+    [M_NET_BYTES_IN]    = { "netsched_network_received_bytes_total", "Octets reçus des clients" },
+    [M_TASKS_ACCEPTED]  = { "netsched_tasks_accepted_total", "Tâches acceptées" },
+    [M_TASKS_DONE]      = { "netsched_tasks_done_total", "Tâches terminées" },
+    [M_TASKS_ABORTED]   = { "netsched_tasks_aborted_total", "Tâches retirées ou abandonnées" },
+    [M_QUANTA]          = { "netsched_quanta_total", "Quanta exécutés" },
+    [M_ZSTD_BYTES_IN]   = { "netsched_zstd_in_bytes_total", "Octets compressés par Zstd (entrée)" },
+    [M_ZSTD_BYTES_OUT]  = { "netsched_zstd_out_bytes_total", "Octets produits par Zstd" },
+    [M_MEDIA_BYTES_IN]  = { "netsched_media_in_bytes_total", "Octets transcodés par ffmpeg (entrée)" },
+    [M_MEDIA_BYTES_OUT] = { "netsched_media_out_bytes_total", "Octets produits par ffmpeg" },
+    [M_RCACHE_HITS]     = { "netsched_result_cache_hits_total", "Tâches servies depuis le cache de résultats" },
+    [M_RCACHE_MISSES]   = { "netsched_result_cache_misses_total", "Tâches empreintées absentes du cache" },
+    [M_RCACHE_BYTES_OUT] = { "netsched_result_cache_out_bytes_total", "Octets envoyés depuis le cache" },
+    [M_TASKS_SUSPENDED] = { "netsched_tasks_suspended_total", "Tâches suspendues après une coupure" },
+    [M_TASKS_RESUMED]   = { "netsched_tasks_resumed_total", "Tâches reprises à un point de reprise" },
+    [M_QUOTA_REJECTED]  = { "netsched_quota_rejections_total", "Connexions et tâches refusées hors quota" },
+};
+
+static const struct {
+    const char *name;
+    const char *label;          // étiquette Prometheus, ou NULL
+    const char *help;
+} hist_info[H_HIST_COUNT] = {
+    [H_QUANTUM_US] = { "netsched_quantum_seconds", NULL, "Temps de service d'un quantum" },
+    [H_WAIT_P0_US] = { "netsched_queue_wait_seconds", "priority=\"0\"", "Attente en file avant un quantum" },
+    [H_WAIT_P1_US] = { "netsched_queue_wait_seconds", "priority=\"1\"", "Attente en file avant un quantum" },
+    [H_WAIT_P2_US] = { "netsched_queue_wait_seconds", "priority=\"2\"", "Attente en file avant un quantum" },
+    [H_TASK_US]    = { "netsched_task_seconds", NULL, "Durée d'une tâche, acceptation comprise" },
+};
+
+static Shard *shard(void) {
+    if (my_shard) return my_shard;
+    Shard *s = calloc(1, sizeof(*s));
+    if (!s) return NULL;
+    pthread_mutex_lock(&shards_mutex);
+    s->next = shards;
+    __atomic_store_n(&shards, s, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&shards_mutex);
+    my_shard = s;
+    return s;
+}
+
+static inline void bump(uint64_t *slot, uint64_t n) {
+    __atomic_store_n(slot, __atomic_load_n(slot, __ATOMIC_RELAXED) + n, __ATOMIC_RELAXED);
+}
+
+void metrics_add(MetricCounter c, uint64_t n) {
+    Shard *s = shard();
+    if (s) bump(&s->counters[c], n);
+}
+
+static int hist_bucket(uint64_t v) {
+    if (v < HIST_SUB) return (int)v;
+    int e = 63 - __builtin_clzll(v);
+    if (e > HIST_MAX_EXP) return HIST_BUCKETS - 1;
+    int sub = (int)((v >> (e - HIST_SUB_BITS)) & (HIST_SUB - 1));
+    return (e - HIST_SUB_BITS + 1) * HIST_SUB + sub;
+}
+
+// Borne haute des valeurs rangées dans le seau b
+static uint64_t hist_upper(int b) {
+    if (b < HIST_SUB) return (uint64_t)b;
+    int e = b / HIST_SUB + HIST_SUB_BITS - 1;
+    int sub = b % HIST_SUB;
+    uint64_t width = (uint64_t)1 << (e - HIST_SUB_BITS);
+    return ((uint64_t)(HIST_SUB + sub) << (e - HIST_SUB_BITS)) + width - 1;
+}
+
+void metrics_observe(MetricHist h, uint64_t value_us) {
+    Shard *s = shard();
+    if (!s) return;
+    bump(&s->hist[h][hist_bucket(value_us)], 1);
+    bump(&s->hist_sum[h], value_us);
+    if (value_us > __atomic_load_n(&s->hist_max[h], __ATOMIC_RELAXED)) {
+        __atomic_store_n(&s->hist_max[h], value_us, __ATOMIC_RELAXED);
+    }
+}
+
+uint64_t metrics_now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000u + (uint64_t)ts.tv_nsec / 1000u;
+}
+
+uint64_t metrics_thread_cpu_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+void metrics_gauge(const char *name, const char *help, double (*fn)(void *ctx), void *ctx) {
+    pthread_mutex_lock(&shards_mutex);
+    if (gauge_count < MAX_GAUGES) {
+        gauges[gauge_count] = (Gauge){ name, help, fn, ctx };
+        __atomic_store_n(&gauge_count, gauge_count + 1, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&shards_mutex);
+}
+
+// Somme de tous les threads, prise à la lecture
+typedef struct {
+    uint64_t counters[M_COUNTER_COUNT];
+    uint64_t hist[H_HIST_COUNT][HIST_BUCKETS];
+    uint64_t count[H_HIST_COUNT];
+    uint64_t sum[H_HIST_COUNT];
+    uint64_t max[H_HIST_COUNT];
+} Snapshot;
+
+static void snapshot(Snapshot *snap) {
+    memset(snap, 0, sizeof(*snap));
+    for (Shard *s = __atomic_load_n(&shards, __ATOMIC_ACQUIRE); s; s = s->next) {
+        for (int c = 0; c < M_COUNTER_COUNT; c++) {
+            snap->counters[c] += __atomic_load_n(&s->counters[c], __ATOMIC_RELAXED);
+        }
+        for (int h = 0; h < H_HIST_COUNT; h++) {
+            for (int b = 0; b < HIST_BUCKETS; b++) {
+                uint64_t n = __atomic_load_n(&s->hist[h][b], __ATOMIC_RELAXED);
+                snap->hist[h][b] += n;
+                snap->count[h] += n;
+            }
+            snap->sum[h] += __atomic_load_n(&s->hist_sum[h], __ATOMIC_RELAXED);
+            uint64_t m = __atomic_load_n(&s->hist_max[h], __ATOMIC_RELAXED);
+            if (m > snap->max[h]) snap->max[h] = m;
+        }
+    }
+}
+
+static uint64_t quantile(const Snapshot *snap, int h, double q) {
+    if (snap->count[h] == 0) return 0;
+    uint64_t rank = (uint64_t)(q * (double)snap->count[h]);
+    if (rank >= snap->count[h]) rank = snap->count[h] - 1;
+    uint64_t seen = 0;
+    for (int b = 0; b < HIST_BUCKETS; b++) {
+        seen += snap->hist[h][b];
+        if (seen > rank) {
+            uint64_t v = hist_upper(b);
+            return v < snap->max[h] ? v : snap->max[h];
+        }
+    }
+    return snap->max[h];
+}
+
+static double ratio(uint64_t out, uint64_t in) {
+    return in ? (double)out / (double)in : 0.0;
+}
+
+static const double quantiles[] = { 0.5, 0.9, 0.99, 0.999 };
+#define NQUANTILES (sizeof(quantiles) / sizeof(quantiles[0]))
+
+static void write_human(FILE *out, const Snapshot *snap) {
+    for (int c = 0; c < M_COUNTER_COUNT; c++) {
+        fprintf(out, "%s : %llu\n", counter_info[c].help, (unsigned long long)snap->counters[c]);
+    }
+    fprintf(out, "%s : %.3f\n", "Ratio Zstd (sortie/entrée)",
+            ratio(snap->counters[M_ZSTD_BYTES_OUT], snap->counters[M_ZSTD_BYTES_IN]));
+    fprintf(out, "%s : %.3f\n", "Ratio ffmpeg (sortie/entrée)",
+            ratio(snap->counters[M_MEDIA_BYTES_OUT], snap->counters[M_MEDIA_BYTES_IN]));
+    int ng = __atomic_load_n(&gauge_count, __ATOMIC_ACQUIRE);
+    for (int i = 0; i < ng; i++) {
+        fprintf(out, "%s : %.0f\n", gauges[i].help, gauges[i].fn(gauges[i].ctx));
+    }
+    for (int h = 0; h < H_HIST_COUNT; h++) {
+        char title[96];
+        snprintf(title, sizeof(title), "%s%s%s%s", hist_info[h].help,
+                 hist_info[h].label ? " {" : "", hist_info[h].label ? hist_info[h].label : "",
+                 hist_info[h].label ? "}" : "");
+        fprintf(out, "%s (µs) : n=%llu p50=%llu p99=%llu p999=%llu max=%llu\n", title,
+                (unsigned long long)snap->count[h],
+                (unsigned long long)quantile(snap, h, 0.5),
+                (unsigned long long)quantile(snap, h, 0.99),
+                (unsigned long long)quantile(snap, h, 0.999),
+                (unsigned long long)snap->max[h]);
+    }
+}
+
+static void write_prometheus(FILE *out, const Snapshot *snap) {
+    for (int c = 0; c < M_COUNTER_COUNT; c++) {
+        fprintf(out, "# HELP %s %s\n# TYPE %s counter\n%s %llu\n",
+                counter_info[c].name, counter_info[c].help, counter_info[c].name,
+                counter_info[c].name, (unsigned long long)snap->counters[c]);
+    }
+    fprintf(out, "# HELP netsched_compression_ratio Octets produits / octets consommés\n"
+                 "# TYPE netsched_compression_ratio gauge\n"
+                 "netsched_compression_ratio{codec=\"zstd\"} %.6f\n"
+                 "netsched_compression_ratio{codec=\"ffmpeg\"} %.6f\n",
+            ratio(snap->counters[M_ZSTD_BYTES_OUT], snap->counters[M_ZSTD_BYTES_IN]),
+            ratio(snap->counters[M_MEDIA_BYTES_OUT], snap->counters[M_MEDIA_BYTES_IN]));
+    int ng = __atomic_load_n(&gauge_count, __ATOMIC_ACQUIRE);
+    for (int i = 0; i < ng; i++) {
+        fprintf(out, "# HELP %s %s\n# TYPE %s gauge\n%s %.0f\n",
+                gauges[i].name, gauges[i].help, gauges[i].name,
+                gauges[i].name, gauges[i].fn(gauges[i].ctx));
+    }
+    for (int h = 0; h < H_HIST_COUNT; h++) {
+        const char *name = hist_info[h].name;
+        const char *label = hist_info[h].label;
+        // En-têtes une seule fois par nom (les priorités partagent le leur)
+        if (h == 0 || strcmp(hist_info[h - 1].name, name) != 0) {
+            fprintf(out, "# HELP %s %s\n# TYPE %s summary\n", name, hist_info[h].help, name);
+        }
+        for (size_t i = 0; i < NQUANTILES; i++) {
+            fprintf(out, "%s{%s%squantile=\"%g\"} %.6f\n", name,
+                    label ? label : "", label ? "," : "", quantiles[i],
+                    quantile(snap, h, quantiles[i]) / 1e6);
+        }
+        fprintf(out, "%s_sum%s%s%s %.6f\n%s_count%s%s%s %llu\n",
+                name, label ? "{" : "", label ? label : "", label ? "}" : "", snap->sum[h] / 1e6,
+                name, label ? "{" : "", label ? label : "", label ? "}" : "",
+                (unsigned long long)snap->count[h]);
+    }
+}
+
+void metrics_write(FILE *out, bool prometheus) {
+    // ~20 Kio par histogramme : pas sur la pile
+    Snapshot *snap = malloc(sizeof(*snap));
+    if (!snap) return;
+    snapshot(snap);
+    if (prometheus) write_prometheus(out, snap);
+    else write_human(out, snap);
+    free(snap);
+}
+
+static void serve_one(int fd) {
+    char req[1024];
+    struct timeval tv = { 1, 0 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    ssize_t n = read(fd, req, sizeof(req) - 1);
+    if (n <= 0) return;
+    req[n] = '\0';
+
+    char *body = NULL;
+    size_t len = 0;
+    FILE *f = open_memstream(&body, &len);
+    if (!f) return;
+    bool found = strncmp(req, "GET /metrics", 12) == 0 || strncmp(req, "GET / ", 6) == 0;
+    if (found) metrics_write(f, true);
+    fclose(f);
+
+    char hdr[160];
+    int hl = snprintf(hdr, sizeof(hdr),
+                      "HTTP/1.0 %s\r\nContent-Type: text/plain; version=0.0.4\r\n"
+                      "Content-Length: %zu\r\nConnection: close\r\n\r\n",
+                      found ? "200 OK" : "404 Not Found", len);
+    write_n_bytes(fd, hdr, hl);
+    write_n_bytes(fd, body, len);
+    free(body);
+}
+
+typedef struct {
+    int fd;
+    bool *running;
+} MetricsServer;
+
+static void *metrics_thread(void *arg) {
+    MetricsServer *ms = arg;
+    while (*ms->running) {
+        struct pollfd pfd = { .fd = ms->fd, .events = POLLIN };
+        if (poll(&pfd, 1, 500) <= 0) continue;
+        int c = accept(ms->fd, NULL, NULL);
+        if (c < 0) continue;
+        serve_one(c);
+        close(c);
+    }
+    close(ms->fd);
+    free(ms);
+    return NULL;
+}
+
+int metrics_serve(int port, bool *running) {
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_port = htons(port) };
+    // Boucle locale seulement : les métriques ne sortent pas de la machine
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    MetricsServer *ms = malloc(sizeof(*ms));
+    if (!ms || bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, 16) < 0) {
+        free(ms);
+        close(fd);
+        return -1;
+    }
+    ms->fd = fd;
+    ms->running = running;
+    pthread_t tid;
+    if (pthread_create(&tid, NULL, metrics_thread, ms) != 0) {
+        free(ms);
+        close(fd);
+        return -1;
+    }
+    pthread_detach(tid);
+    log_internal("metrics: http://127.0.0.1:%d/metrics", port);
+    return 0;
+}
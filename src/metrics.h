@@ -0,0 +1,59 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Compteurs cumulés. Chaque thread écrit dans ses propres compteurs, les
+// lectures (console, endpoint) font la somme : aucune contention en écriture.
+typedef enum {
+    M_CONNS_ACCEPTED,
+    M_NET_BYTES_IN,             // octets reçus des clients (copie ou splice)
+    M_TASKS_ACCEPTED,
+    M_TASKS_DONE,
+    M_TASKS_ABORTED,
+    M_QUANTA,
+    M_ZSTD_BYTES_IN,
+    M_ZSTD_BYTES_OUT,
+    M_MEDIA_BYTES_IN,
+    M_MEDIA_BYTES_OUT,
+    M_RCACHE_HITS,              // résultats resservis depuis le cache
+    M_RCACHE_MISSES,
+    M_RCACHE_BYTES_OUT,
+    M_TASKS_SUSPENDED,          // tâches reprenables arrêtées par une coupure
+    M_TASKS_RESUMED,
+    M_QUOTA_REJECTED,           // connexions et tâches refusées hors quota
+    M_COUNTER_COUNT
+} MetricCounter;
+
+// Histogrammes de durées en microsecondes (log-linéaires, façon HDR :
+// erreur relative < 1/8 sur toute la plage).
+typedef enum {
+    H_QUANTUM_US,               // temps de service d'un quantum
+    H_WAIT_P0_US,               // attente en file avant un quantum, par priorité
+    H_WAIT_P1_US,
+    H_WAIT_P2_US,
+    H_TASK_US,                  // durée totale d'une tâche (acceptation -> fin)
+    H_HIST_COUNT
+} MetricHist;
+
+void metrics_add(MetricCounter c, uint64_t n);
+static inline void metrics_inc(MetricCounter c) { metrics_add(c, 1); }
+void metrics_observe(MetricHist h, uint64_t value_us);
+
+// Horloge monotone en microsecondes, pour les durées.
+uint64_t metrics_now_us(void);
+// Temps CPU consommé par le thread appelant, en nanosecondes.
+uint64_t metrics_thread_cpu_ns(void);
+
+// Jauge lue à la demande (profondeur de file, connexions...).
+void metrics_gauge(const char *name, const char *help, double (*fn)(void *ctx), void *ctx);
+
+// Rendu texte : lisible pour la console, ou format d'exposition Prometheus.
+void metrics_write(FILE *out, bool prometheus);
+
+// Sert le format Prometheus en HTTP sur 127.0.0.1:port (GET /metrics).
+int metrics_serve(int port, bool *running);
+
+#endif // METRICS_H
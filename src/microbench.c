@@ -0,0 +1,431 @@
+// src/microbench.c
+//
+// Microbenchmarks des primitives qui dominent le CPU du serveur, isolées du
+// réseau et de l'ordonnancement : file de tâches sous contention, quantum
+// de compression Zstd pour chaque taille de quantum du scheduler, lecture/
+// écriture exactes sur socketpair, et recherches is_media_file /
+// find_user_priority.
+//
+// Chaque mesure : calibrage (le nombre d'itérations double jusqu'à ce
+// qu'une passe dure MIN_RUN_MS, ce qui sert aussi de chauffe), puis
+// plusieurs passes identiques dont on garde la médiane. Les threads sont
+// épinglés sur des cœurs fixes. Une ligne par mesure : ns/op, Go/s quand
+// la mesure déplace des octets, et l'écart min-max en % de la médiane.
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <sys/socket.h>
+
+#include "netqueue.h"
+#include "netio.h"
+#include "scheduler_helpers.h"
+#include "taskbuf.h"
+#include "userauth.h"
+#include "utils.h"
+#include "mempool.h"
+
+#define MIN_RUN_MS 50
+#define MAX_RUNS 31
+#define CORPUS_SIZE (16 * 1024 * 1024)
+// Tâches déjà en file pendant la mesure de contention (profondeur réaliste)
+#define QUEUE_PREFILL 1024
+#define QUEUE_USERS 64          // sessions distinctes (rondes DRR)
+#define BENCH_USERS 50000
+
+typedef uint64_t (*BenchFn)(void *arg, uint64_t iters, uint64_t *ops, uint64_t *bytes);
+
+static int ncpu = 1;
+static int runs = 5;
+static int max_threads = 0;
+static const char *filter = NULL;
+
+static char *corpus_text;
+static char *corpus_random;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+static uint64_t xorshift(uint64_t *s) {
+    uint64_t x = *s;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    return *s = x;
+}
+
+// Épingle le thread appelant sur le cœur slot (modulo le nombre de cœurs)
+static void pin_cpu(int slot) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(slot % ncpu, &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+static int cmp_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static void run_bench(const char *name, BenchFn fn, void *arg) {
+    if (filter && !strstr(name, filter)) return;
+    uint64_t ops = 0, bytes = 0, iters = 1;
+    // Calibrage et chauffe (caches, pools, contextes Zstd)
+    for (;;) {
+        uint64_t ns = fn(arg, iters, &ops, &bytes);
+        if (ns >= MIN_RUN_MS * 1000000ull || iters >= (1ull << 32)) break;
+        iters *= 2;
+    }
+    uint64_t per_op[MAX_RUNS], elapsed[MAX_RUNS];
+    for (int r = 0; r < runs; r++) {
+        elapsed[r] = fn(arg, iters, &ops, &bytes);
+        per_op[r] = ops ? elapsed[r] * 1000 / ops : 0;   // en ps/op
+    }
+    qsort(per_op, runs, sizeof(per_op[0]), cmp_u64);
+    qsort(elapsed, runs, sizeof(elapsed[0]), cmp_u64);
+    double median = per_op[runs / 2] / 1000.0;
+    double spread = per_op[runs / 2] ? 100.0 * (per_op[runs - 1] - per_op[0]) / per_op[runs / 2] : 0;
+    char gbps[32] = "-";
+    if (bytes) snprintf(gbps, sizeof(gbps), "%.3f", (double)bytes / elapsed[runs / 2]);
+    printf("%-34s %14.1f %10s %7.1f\n", name, median, gbps, spread);
+    fflush(stdout);
+}
+
+// ---------------------------------------------------------------------------
+// NetQueue : chaque thread remet en file la tâche qu'il tient puis en retire
+// une autre (la meilleure, pas forcément la sienne). Une op = un couple
+// netqueue_enqueue + netqueue_dequeue.
+
+typedef struct {
+    NetQueue queue;
+    int nthreads;
+    uint64_t iters;
+    pthread_barrier_t start;
+} QueueBench;
+
+typedef struct {
+    QueueBench *qb;
+    int slot;
+    NetTask *held;
+} QueueWorker;
+
+static void *queue_worker(void *arg) {
+    QueueWorker *w = arg;
+    QueueBench *qb = w->qb;
+    pin_cpu(w->slot);
+    pthread_barrier_wait(&qb->start);
+    NetTask *t = w->held;
+    for (uint64_t i = 0; i < qb->iters; i++) {
+        netqueue_enqueue(&qb->queue, t);
+        t = netqueue_dequeue(&qb->queue);
+        // Un quantum traité : la clé (octets restants) change
+        t->processed_bytes = (t->processed_bytes + 16384) % t->total_size;
+    }
+    w->held = t;
+    return NULL;
+}
+
+static long bench_sessions[QUEUE_USERS][2];
+
+static NetTask *bench_task(int id, uint64_t *rng) {
+    NetTask *t = nettask_new();
+    if (!t) {
+        perror("nettask_new");
+        exit(1);
+    }
+    t->task_id = id;
+    t->user_priority = (int)(xorshift(rng) % NETQUEUE_PRIORITIES);
+    t->total_size = 65536 + (long)(xorshift(rng) % (64 * 1024 * 1024));
+    t->session = bench_sessions[id % QUEUE_USERS];
+    return t;
+}
+
+static uint64_t bench_netqueue(void *arg, uint64_t iters, uint64_t *ops, uint64_t *bytes) {
+    QueueBench *qb = arg;
+    int n = qb->nthreads;
+    static QueueWorker workers[256];
+    static pthread_t tids[256];
+    static NetTask *held[256];
+    static uint64_t rng = 0x9E3779B97F4A7C15ULL;
+    static int next_id = QUEUE_PREFILL;
+
+    for (int i = 0; i < n; i++) {
+        if (!held[i]) held[i] = bench_task(next_id++, &rng);
+        workers[i] = (QueueWorker){ qb, i + 1, held[i] };
+    }
+    qb->iters = iters;
+    pthread_barrier_init(&qb->start, NULL, n + 1);
+    for (int i = 0; i < n; i++) pthread_create(&tids[i], NULL, queue_worker, &workers[i]);
+    pthread_barrier_wait(&qb->start);
+    uint64_t t0 = now_ns();
+    for (int i = 0; i < n; i++) pthread_join(tids[i], NULL);
+    uint64_t ns = now_ns() - t0;
+    pthread_barrier_destroy(&qb->start);
+    for (int i = 0; i < n; i++) held[i] = workers[i].held;
+
+    *ops = iters * n;
+    *bytes = 0;
+    return ns;
+}
+
+// ---------------------------------------------------------------------------
+// Quantum de compression : handle_streaming_compress_partial sur une tâche
+// dont le tampon d'entrée est déjà rempli ; la sortie (trames DATA,
+// PROGRESS, WINDOW) part vers /dev/null. Une op = un quantum.
+
+typedef struct {
+    size_t quantum;
+    const char *corpus;
+} CompressBench;
+
+static Conn sink_conn;
+
+static uint64_t bench_compress(void *arg, uint64_t iters, uint64_t *ops, uint64_t *bytes) {
+    CompressBench *cb = arg;
+    NetTask *t = nettask_new();
+    t->task_id = 1;
+    t->stream_id = 1;
+    t->total_size = (long)(iters * cb->quantum);
+    t->meta = bufpool_strdup("bench.txt");
+    t->input = taskbuf_new(1);
+    t->conn = &sink_conn;
+
+    uint64_t ns = 0;
+    size_t off = 0;
+    for (uint64_t i = 0; i < iters; i++) {
+        // Remplissage hors mesure : c'est le travail du thread d'E/S
+        if (off + cb->quantum > CORPUS_SIZE) off = 0;
+        taskbuf_append(t->input, cb->corpus + off, cb->quantum);
+        off += cb->quantum;
+        uint64_t t0 = now_ns();
+        handle_streaming_compress_partial(t, cb->quantum);
+        ns += now_ns() - t0;
+    }
+    nettask_free(t);
+
+    *ops = iters;
+    *bytes = iters * cb->quantum;
+    return ns;
+}
+
+// ---------------------------------------------------------------------------
+// read_n_bytes / write_n_bytes : un thread écrit des blocs de taille fixe
+// dans un socketpair, le thread principal les lit. Une op = un bloc.
+
+typedef struct {
+    size_t block;
+    uint64_t iters;
+    int fd;
+    char *buf;
+} PairBench;
+
+static void *pair_writer(void *arg) {
+    PairBench *pb = arg;
+    pin_cpu(1);
+    for (uint64_t i = 0; i < pb->iters; i++) {
+        if (write_n_bytes(pb->fd, pb->buf, pb->block) < 0) break;
+    }
+    return NULL;
+}
+
+static uint64_t bench_socketpair(void *arg, uint64_t iters, uint64_t *ops, uint64_t *bytes) {
+    PairBench *pb = arg;
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0) {
+        perror("socketpair");
+        exit(1);
+    }
+    char *rbuf = malloc(pb->block);
+    pb->iters = iters;
+    pb->fd = sv[1];
+    pthread_t tid;
+    uint64_t t0 = now_ns();
+    pthread_create(&tid, NULL, pair_writer, pb);
+    for (uint64_t i = 0; i < iters; i++) {
+        if (read_n_bytes(sv[0], rbuf, pb->block) <= 0) break;
+    }
+    uint64_t ns = now_ns() - t0;
+    pthread_join(tid, NULL);
+    close(sv[0]);
+    close(sv[1]);
+    free(rbuf);
+
+    *ops = iters;
+    *bytes = iters * pb->block;
+    return ns;
+}
+
+// ---------------------------------------------------------------------------
+// Recherches : extension média (succès et échecs mélangés) et priorité
+// d'un utilisateur dans un annuaire de BENCH_USERS entrées.
+
+static const char *media_names[] = {
+    "film.mp4", "notes.txt", "archive.tar.gz", "Concert.FLAC",
+    "rapport.pdf", "voix.m4a", "sans_extension", "clip.MKV"
+};
+
+static volatile int lookup_sink;
+
+static uint64_t bench_media(void *arg, uint64_t iters, uint64_t *ops, uint64_t *bytes) {
+    (void)arg;
+    int hits = 0;
+    uint64_t t0 = now_ns();
+    for (uint64_t i = 0; i < iters; i++) hits += is_media_file(media_names[i & 7]);
+    uint64_t ns = now_ns() - t0;
+    lookup_sink = hits;
+    *ops = iters;
+    *bytes = 0;
+    return ns;
+}
+
+static uint64_t bench_user(void *arg, uint64_t iters, uint64_t *ops, uint64_t *bytes) {
+    const char *pseudo = arg;
+    int prio = 0, found = 0;
+    uint64_t t0 = now_ns();
+    for (uint64_t i = 0; i < iters; i++) found += find_user_priority(pseudo, &prio);
+    uint64_t ns = now_ns() - t0;
+    lookup_sink = found + prio;
+    *ops = iters;
+    *bytes = 0;
+    return ns;
+}
+
+// ---------------------------------------------------------------------------
+
+static int build_corpus(void) {
+    corpus_text = malloc(CORPUS_SIZE);
+    corpus_random = malloc(CORPUS_SIZE);
+    if (!corpus_text || !corpus_random) return -1;
+    // Même forme que le corpus texte de scheduler_loadgen
+    static const char *words[] = {
+        "tâche", "client", "quantum", "priorité", "octets", "serveur", "flux",
+        "compression", "trame", "fenêtre", "worker", "file", "latence", "débit"
+    };
+    uint64_t s = 0x9E3779B97F4A7C15ULL;
+    size_t off = 0;
+    uint64_t line = 0;
+    while (off < CORPUS_SIZE) {
+        char buf[160];
+        int n = snprintf(buf, sizeof(buf), "%llu %s %s %s=%llu\n",
+                         (unsigned long long)line++, words[xorshift(&s) % 14],
+                         words[xorshift(&s) % 14], words[xorshift(&s) % 14],
+                         (unsigned long long)(xorshift(&s) % 100000));
+        size_t k = (size_t)n < CORPUS_SIZE - off ? (size_t)n : CORPUS_SIZE - off;
+        memcpy(corpus_text + off, buf, k);
+        off += k;
+    }
+    uint64_t *p = (uint64_t *)corpus_random;
+    for (size_t i = 0; i < CORPUS_SIZE / sizeof(uint64_t); i++) p[i] = xorshift(&s);
+    return 0;
+}
+
+static int build_users(void) {
+    char path[] = "/tmp/microbench_users_XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) return -1;
+    FILE *f = fdopen(fd, "w");
+    fprintf(f, "# Format : pseudo:priorite\n");
+    for (int i = 0; i < BENCH_USERS; i++) fprintf(f, "user%05d:%d\n", i, i % 3);
+    fclose(f);
+    int n = load_users(path);
+    unlink(path);
+    return n;
+}
+
+static void usage(const char *argv0) {
+    fprintf(stderr,
+            "Usage : %s [-t threads_max] [-r passes] [-f filtre]\n"
+            "  -t : nombre max de threads pour la contention de file (défaut : max(4, cœurs))\n"
+            "  -r : passes mesurées par benchmark, médiane retenue (défaut 5)\n"
+            "  -f : ne lance que les benchmarks dont le nom contient ce texte\n",
+            argv0);
+}
+
+int main(int argc, char *argv[]) {
+    int opt;
+    while ((opt = getopt(argc, argv, "t:r:f:")) != -1) {
+        switch (opt) {
+            case 't': max_threads = atoi(optarg); break;
+            case 'r': runs = atoi(optarg); break;
+            case 'f': filter = optarg; break;
+            default: usage(argv[0]); return 1;
+        }
+    }
+    ncpu = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (ncpu < 1) ncpu = 1;
+    if (max_threads <= 0) max_threads = ncpu > 4 ? ncpu : 4;
+    if (runs < 1 || runs > MAX_RUNS || max_threads > 256) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (build_corpus() < 0 || build_users() <= 0) {
+        fprintf(stderr, "Initialisation impossible\n");
+        return 1;
+    }
+    sink_conn.fd = open("/dev/null", O_WRONLY);
+    pthread_mutex_init(&sink_conn.wlock, NULL);
+    pin_cpu(0);
+
+    printf("# %d cœur(s), %d passes, médiane\n", ncpu, runs);
+    printf("%-34s %14s %10s %7s\n", "benchmark", "ns/op", "GB/s", "+-%");
+
+    char name[64];
+    static QueueBench qb;
+    netqueue_init(&qb.queue);
+    uint64_t rng = 42;
+    for (int i = 0; i < QUEUE_PREFILL; i++) netqueue_enqueue(&qb.queue, bench_task(i, &rng));
+    // 1, 2, 4... puis threads_max
+    for (int n = 1;; n = n * 2 < max_threads ? n * 2 : max_threads) {
+        qb.nthreads = n;
+        snprintf(name, sizeof(name), "netqueue/threads=%d", n);
+        run_bench(name, bench_netqueue, &qb);
+        if (n == max_threads) break;
+    }
+    // Même charge en deficit round robin (QUEUE_USERS utilisateurs)
+    static QueueBench qd;
+    netqueue_init(&qd.queue);
+    if (netqueue_set_policy(&qd.queue, NETQUEUE_DRR) < 0) return 1;
+    for (int i = 0; i < QUEUE_PREFILL; i++) netqueue_enqueue(&qd.queue, bench_task(i, &rng));
+    for (int n = 1;; n = n * 2 < max_threads ? n * 2 : max_threads) {
+        qd.nthreads = n;
+        snprintf(name, sizeof(name), "netqueue-drr/threads=%d", n);
+        run_bench(name, bench_netqueue, &qd);
+        if (n == max_threads) break;
+    }
+
+    // Tailles de quantum du worker pool (priorités 0, 1, 2)
+    static const size_t quanta[] = { 48 * 1024, 32 * 1024, 16 * 1024 };
+    for (int i = 0; i < 3; i++) {
+        CompressBench text = { quanta[i], corpus_text };
+        CompressBench rnd = { quanta[i], corpus_random };
+        snprintf(name, sizeof(name), "compress/%zuK/text", quanta[i] / 1024);
+        run_bench(name, bench_compress, &text);
+        snprintf(name, sizeof(name), "compress/%zuK/random", quanta[i] / 1024);
+        run_bench(name, bench_compress, &rnd);
+    }
+
+    static const size_t blocks[] = { 4096, 65536, 1024 * 1024 };
+    for (int i = 0; i < 3; i++) {
+        PairBench pb = { .block = blocks[i], .buf = corpus_random };
+        snprintf(name, sizeof(name), "socketpair/%zuK", blocks[i] / 1024);
+        run_bench(name, bench_socketpair, &pb);
+    }
+
+    run_bench("is_media_file", bench_media, NULL);
+    run_bench("find_user_priority/first", bench_user, "user00000");
+    run_bench("find_user_priority/last", bench_user, "user49999");
+    run_bench("find_user_priority/miss", bench_user, "inconnu");
+    return 0;
+}
@@ -0,0 +1,452 @@
+#define _GNU_SOURCE
+#include "netio.h"
+#include "log.h"
+#include "protocol.h"
+#include "taskbuf.h"
+#include "utils.h"
+#include "mempool.h"
+#include "metrics.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define MAX_EVENTS 64
+#define EPOLL_TIMEOUT_MS 500
+
+typedef struct IoThread {
+    int id;
+    int epfd;
+    pthread_t thread;
+} IoThread;
+
+// Morceau de sortie différée : octets en mémoire, ou segment d'un fichier
+// repris par sendfile()
+typedef struct OutChunk {
+    struct OutChunk *next;
+    size_t cap;                 // taille demandée à bufpool_get
+    size_t len, off;            // off : octets déjà envoyés
+    int file_fd;                // -1 : octets dans data
+    off_t file_off;
+    char data[];
+} OutChunk;
+
+static IoThread *io_threads = NULL;
+static int io_count = 0;
+static int listen_sock = -1;
+static int active_conns = 0;    // atomique
+static const NetioHandlers *handlers = NULL;
+static bool *netio_running = NULL;
+
+void conn_get(Conn *c) {
+    __atomic_add_fetch(&c->refs, 1, __ATOMIC_RELAXED);
+}
+
+void conn_put(void *arg) {
+    Conn *c = arg;
+    if (!c) return;
+    if (__atomic_sub_fetch(&c->refs, 1, __ATOMIC_ACQ_REL) > 0) return;
+    while (c->out_head) {
+        OutChunk *o = c->out_head;
+        c->out_head = o->next;
+        if (o->file_fd >= 0) close(o->file_fd);
+        bufpool_put(o, o->cap);
+    }
+    close(c->fd);
+    bufpool_strfree(c->pseudo);
+    pthread_mutex_destroy(&c->wlock);
+    free(c);
+    __atomic_sub_fetch(&active_conns, 1, __ATOMIC_RELAXED);
+}
+
+int netio_active_conns(void) {
+    return __atomic_load_n(&active_conns, __ATOMIC_RELAXED);
+}
+
+void netio_consume(Conn *c, size_t n) {
+    if (n >= c->rlen) {
+        c->rlen = 0;
+        return;
+    }
+    memmove(c->rbuf, c->rbuf + n, c->rlen - n);
+    c->rlen -= n;
+}
+
+// EPOLLOUT demandé ou non pour c (wlock tenu). Une connexion pas encore
+// surveillée (réponse de on_accept) est armée par accept_all.
+static void out_arm(Conn *c, bool on) {
+    if (c->out_armed == on) return;
+    struct epoll_event ev = { .events = EPOLLIN | EPOLLRDHUP | (on ? EPOLLOUT : 0), .data.ptr = c };
+    if (epoll_ctl(c->io->epfd, EPOLL_CTL_MOD, c->fd, &ev) == 0) c->out_armed = on;
+}
+
+// Trame tronquée ou client arrêté : le flux n'est plus décodable (wlock tenu)
+static int out_fail(Conn *c) {
+    c->out_dead = true;
+    shutdown(c->fd, SHUT_RDWR);
+    return -1;
+}
+
+static OutChunk *out_chunk(Conn *c, size_t len) {
+    OutChunk *o = bufpool_get(sizeof(*o) + len);
+    if (!o) return NULL;
+    o->next = NULL;
+    o->cap = sizeof(*o) + len;
+    o->len = len;
+    o->off = 0;
+    o->file_fd = -1;
+    o->file_off = 0;
+    if (c->out_tail) c->out_tail->next = o;
+    else c->out_head = o;
+    c->out_tail = o;
+    __atomic_add_fetch(&c->out_bytes, len, __ATOMIC_RELAXED);
+    return o;
+}
+
+// Après une mise en attente : borne et réveil du thread d'E/S (wlock tenu)
+static int out_check(Conn *c) {
+    if (c->out_bytes > CONN_OUT_MAX) {
+        log_msg(LOG_WARN, -1, "netio: %s stopped reading (%zu bytes pending), closing",
+                c->pseudo ? c->pseudo : "?", c->out_bytes);
+        return out_fail(c);
+    }
+    if (c->out_head) out_arm(c, true);
+    return 0;
+}
+
+// Écrit ce que le socket accepte sans attendre ; 0 sur EAGAIN, -1 sur erreur
+static ssize_t out_try_writev(Conn *c, const struct iovec *iov, int n) {
+    for (;;) {
+        ssize_t w = writev(c->fd, iov, n);
+        if (w >= 0) return w;
+        if (errno == EINTR) continue;
+        return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+    }
+}
+
+// Envoie les iovec, directement si rien n'attend, le reste en attente
+// (wlock tenu)
+static int out_send_locked(Conn *c, const struct iovec *iov, int n) {
+    if (c->out_dead) return -1;
+    size_t total = 0, done = 0;
+    for (int i = 0; i < n; i++) total += iov[i].iov_len;
+    if (!c->out_head) {
+        ssize_t w = out_try_writev(c, iov, n);
+        if (w < 0) return out_fail(c);
+        done = (size_t)w;
+    }
+    if (done == total) return 0;
+    OutChunk *o = out_chunk(c, total - done);
+    if (!o) return out_fail(c);
+    size_t k = 0;
+    for (int i = 0; i < n; i++) {
+        size_t skip = done < iov[i].iov_len ? done : iov[i].iov_len;
+        done -= skip;
+        memcpy(o->data + k, (const char *)iov[i].iov_base + skip, iov[i].iov_len - skip);
+        k += iov[i].iov_len - skip;
+    }
+    return out_check(c);
+}
+
+int netio_send_frame(Conn *c, uint8_t type, uint32_t task_id, const void *payload, uint32_t len) {
+    uint8_t hdr[PROTO_HEADER_SIZE];
+    proto_pack_header(hdr, type, task_id, len);
+    struct iovec iov[2] = {
+        { .iov_base = hdr, .iov_len = sizeof(hdr) },
+        { .iov_base = (void *)payload, .iov_len = len },
+    };
+    pthread_mutex_lock(&c->wlock);
+    int rc = out_send_locked(c, iov, len ? 2 : 1);
+    pthread_mutex_unlock(&c->wlock);
+    return rc;
+}
+
+int netio_send_frame_from_fd(Conn *c, uint8_t type, uint32_t task_id, int pipe_fd, uint32_t len) {
+    uint8_t hdr[PROTO_HEADER_SIZE];
+    proto_pack_header(hdr, type, task_id, len);
+    struct iovec iov = { .iov_base = hdr, .iov_len = sizeof(hdr) };
+    pthread_mutex_lock(&c->wlock);
+    int rc = out_send_locked(c, &iov, 1);
+    size_t left = len;
+    while (rc == 0 && left > 0 && !c->out_head) {
+        ssize_t s = splice(pipe_fd, NULL, c->fd, NULL, left,
+                           SPLICE_F_MOVE | SPLICE_F_NONBLOCK | SPLICE_F_MORE);
+        if (s > 0) left -= (size_t)s;
+        else if (s < 0 && errno == EINTR) continue;
+        else if (s == 0 || (errno != EAGAIN && errno != EINVAL && errno != ENOSYS)) rc = out_fail(c);
+        else break;     // socket plein, ou splice refusé : par copie
+    }
+    if (rc == 0 && left > 0) {
+        OutChunk *o = out_chunk(c, left);
+        if (!o || read_n_bytes(pipe_fd, o->data, left) != (ssize_t)left) rc = out_fail(c);
+        else rc = out_check(c);
+    }
+    pthread_mutex_unlock(&c->wlock);
+    return rc;
+}
+
+int netio_send_frame_from_file(Conn *c, uint8_t type, uint32_t task_id, int file_fd, off_t offset,
+                               uint32_t len) {
+    uint8_t hdr[PROTO_HEADER_SIZE];
+    proto_pack_header(hdr, type, task_id, len);
+    struct iovec iov = { .iov_base = hdr, .iov_len = sizeof(hdr) };
+    pthread_mutex_lock(&c->wlock);
+    int rc = out_send_locked(c, &iov, 1);
+    size_t left = len;
+    while (rc == 0 && left > 0 && !c->out_head) {
+        ssize_t s = sendfile(c->fd, file_fd, &offset, left);
+        if (s > 0) left -= (size_t)s;
+        else if (s < 0 && errno == EINTR) continue;
+        else if (s == 0 || (errno != EAGAIN && errno != EINVAL && errno != ENOSYS)) rc = out_fail(c);
+        else break;     // socket plein, ou sendfile refusé : repris par le thread d'E/S
+    }
+    if (rc == 0 && left > 0) {
+        OutChunk *o = out_chunk(c, 0);
+        int fd = o ? dup(file_fd) : -1;
+        if (fd < 0) {
+            rc = out_fail(c);
+        } else {
+            o->file_fd = fd;
+            o->file_off = offset;
+            o->len = left;
+            __atomic_add_fetch(&c->out_bytes, left, __ATOMIC_RELAXED);
+            rc = out_check(c);
+        }
+    }
+    pthread_mutex_unlock(&c->wlock);
+    return rc;
+}
+
+size_t netio_output_pending(Conn *c) {
+    return __atomic_load_n(&c->out_bytes, __ATOMIC_RELAXED);
+}
+
+bool netio_park_output(Conn *c, void (*fn)(void *a, void *b), void *a, void *b) {
+    pthread_mutex_lock(&c->wlock);
+    bool park = !c->out_dead && c->out_bytes > CONN_OUT_HIGH && c->out_nwait < CONN_MAX_STREAMS;
+    if (park) c->out_wait[c->out_nwait++] = (OutWaiter){ fn, a, b };
+    pthread_mutex_unlock(&c->wlock);
+    return park;
+}
+
+bool netio_unpark_output(Conn *c, void *b) {
+    pthread_mutex_lock(&c->wlock);
+    bool found = false;
+    for (int i = 0; i < c->out_nwait && !found; i++) {
+        if (c->out_wait[i].b != b) continue;
+        c->out_wait[i] = c->out_wait[--c->out_nwait];
+        found = true;
+    }
+    pthread_mutex_unlock(&c->wlock);
+    return found;
+}
+
+// Producteurs à réveiller, retirés de c (wlock tenu) ; appelés après coup,
+// verrou relâché
+static int out_take_waiters(Conn *c, OutWaiter *out) {
+    int n = c->out_nwait;
+    memcpy(out, c->out_wait, (size_t)n * sizeof(*out));
+    c->out_nwait = 0;
+    return n;
+}
+
+// Segment de fichier en attente : sendfile(), ou pread + write s'il est refusé
+static ssize_t out_write_file(Conn *c, OutChunk *o) {
+    off_t pos = o->file_off + (off_t)o->off;
+    size_t n = o->len - o->off;
+    ssize_t s = sendfile(c->fd, o->file_fd, &pos, n);
+    if (s == 0) {
+        errno = EIO;            // fichier tronqué entre-temps
+        return -1;
+    }
+    if (s > 0 || (errno != EINVAL && errno != ENOSYS)) return s;
+    char buf[16384];
+    ssize_t r = pread(o->file_fd, buf, n < sizeof(buf) ? n : sizeof(buf), pos);
+    if (r <= 0) return -1;
+    return write(c->fd, buf, (size_t)r);
+}
+
+// EPOLLOUT : envoie la sortie en attente tant que le socket l'accepte.
+// Retourne -1 si la connexion doit être fermée.
+static int conn_writable(Conn *c) {
+    pthread_mutex_lock(&c->wlock);
+    int rc = 0;
+    while (c->out_head && !c->out_dead) {
+        OutChunk *o = c->out_head;
+        ssize_t w = o->file_fd < 0 ? write(c->fd, o->data + o->off, o->len - o->off)
+                                   : out_write_file(c, o);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) rc = out_fail(c);
+            break;
+        }
+        o->off += (size_t)w;
+        __atomic_sub_fetch(&c->out_bytes, (size_t)w, __ATOMIC_RELAXED);
+        if (o->off < o->len) continue;
+        c->out_head = o->next;
+        if (!c->out_head) c->out_tail = NULL;
+        if (o->file_fd >= 0) close(o->file_fd);
+        bufpool_put(o, o->cap);
+    }
+    if (!c->out_head) out_arm(c, false);
+    OutWaiter wake[CONN_MAX_STREAMS];
+    int n = c->out_bytes <= CONN_OUT_LOW || c->out_dead ? out_take_waiters(c, wake) : 0;
+    pthread_mutex_unlock(&c->wlock);
+    for (int i = 0; i < n; i++) wake[i].fn(wake[i].a, wake[i].b);
+    return rc;
+}
+
+// Charge DATA en cours vers un tampon en mode tube : le noyau la déplace du
+// socket au tube sans passer par rbuf. Retourne 1 si des octets ont été
+// déplacés, 0 s'il faut repasser par read().
+static int conn_splice_data(Conn *c) {
+    ssize_t n = taskbuf_splice_from(c->data_dst, c->fd, c->data_left);
+    if (n > 0) {
+        metrics_add(M_NET_BYTES_IN, n);
+        c->data_left -= (uint32_t)n;
+        return 1;
+    }
+    if (n < 0) {
+        if (errno == EPIPE) c->data_dst = NULL;     // tâche finie : le reste est jeté
+        else c->no_splice = true;                   // socket non supporté : copie
+    }
+    return 0;
+}
+
+// Le thread d'E/S lâche la connexion (fermeture effective au dernier conn_put)
+static void conn_drop(Conn *c) {
+    epoll_ctl(c->io->epfd, EPOLL_CTL_DEL, c->fd, NULL);
+    shutdown(c->fd, SHUT_RDWR);
+    // Plus rien ne partira : les producteurs garés repartent (et échouent)
+    OutWaiter wake[CONN_MAX_STREAMS];
+    pthread_mutex_lock(&c->wlock);
+    c->out_dead = true;
+    int n = out_take_waiters(c, wake);
+    pthread_mutex_unlock(&c->wlock);
+    for (int i = 0; i < n; i++) wake[i].fn(wake[i].a, wake[i].b);
+    if (handlers->on_close) handlers->on_close(c);
+    conn_put(c);
+}
+
+static void accept_all(IoThread *io) {
+    for (;;) {
+        int fd = accept4(listen_sock, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR) continue;
+            // EAGAIN : un autre thread a pris la connexion, ou plus rien
+            return;
+        }
+        Conn *c = calloc(1, sizeof(*c));
+        if (!c) {
+            close(fd);
+            continue;
+        }
+        c->fd = fd;
+        c->refs = 1;
+        c->io = io;
+        pthread_mutex_init(&c->wlock, NULL);
+        __atomic_add_fetch(&active_conns, 1, __ATOMIC_RELAXED);
+
+        if (handlers->on_accept && handlers->on_accept(c) < 0) {
+            conn_put(c);
+            continue;
+        }
+        // Réponse de on_accept restée en attente : EPOLLOUT d'emblée
+        pthread_mutex_lock(&c->wlock);
+        c->out_armed = c->out_head != NULL;
+        struct epoll_event ev = { .events = EPOLLIN | EPOLLRDHUP | (c->out_armed ? EPOLLOUT : 0),
+                                  .data.ptr = c };
+        int rc = epoll_ctl(io->epfd, EPOLL_CTL_ADD, fd, &ev);
+        pthread_mutex_unlock(&c->wlock);
+        if (rc < 0) conn_put(c);
+    }
+}
+
+// Lit tout ce qui est disponible et le passe au protocole.
+// Retourne -1 si la connexion doit être fermée.
+static int conn_readable(Conn *c) {
+    for (;;) {
+        if (c->rlen == sizeof(c->rbuf)) {
+            // Tampon plein : le protocole doit consommer avant de relire
+            if (handlers->on_input(c) < 0) return -1;
+            if (c->rlen == sizeof(c->rbuf)) return -1;
+        }
+        if (c->rlen == 0 && c->data_left > 0 && c->data_dst &&
+            taskbuf_is_pipe(c->data_dst) && !c->no_splice) {
+            if (conn_splice_data(c) > 0) continue;
+        }
+        ssize_t n = read(c->fd, c->rbuf + c->rlen, sizeof(c->rbuf) - c->rlen);
+        if (n > 0) {
+            metrics_add(M_NET_BYTES_IN, n);
+            c->rlen += n;
+            continue;
+        }
+        if (n == 0) {
+            // Fin de flux : on traite ce qui reste puis on ferme
+            if (c->rlen) handlers->on_input(c);
+            return -1;
+        }
+        if (errno == EINTR) continue;
+        if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+        return -1;
+    }
+    if (c->rlen == 0) return 0;
+    return handlers->on_input(c);
+}
+
+static void *io_thread_func(void *arg) {
+    IoThread *io = arg;
+    struct epoll_event events[MAX_EVENTS];
+
+    while (*netio_running) {
+        int n = epoll_wait(io->epfd, events, MAX_EVENTS, EPOLL_TIMEOUT_MS);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            log_msg(LOG_ERROR, -1, "netio %d: epoll_wait failed", io->id);
+            break;
+        }
+        for (int i = 0; i < n; i++) {
+            Conn *c = events[i].data.ptr;
+            if (!c) {
+                accept_all(io);
+                continue;
+            }
+            int rc = 0;
+            if (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+                rc = conn_readable(c);
+            }
+            if (rc == 0 && (events[i].events & EPOLLOUT)) rc = conn_writable(c);
+            if (rc < 0) conn_drop(c);
+        }
+    }
+    return NULL;
+}
+
+int netio_start(int listen_fd, int nthreads, const NetioHandlers *h, bool *running) {
+    if (nthreads < 1) nthreads = 1;
+    listen_sock = listen_fd;
+    handlers = h;
+    netio_running = running;
+    fcntl(listen_fd, F_SETFL, fcntl(listen_fd, F_GETFL, 0) | O_NONBLOCK);
+
+    io_threads = calloc(nthreads, sizeof(IoThread));
+    if (!io_threads) return -1;
+    for (int i = 0; i < nthreads; i++) {
+        IoThread *io = &io_threads[i];
+        io->id = i;
+        io->epfd = epoll_create1(EPOLL_CLOEXEC);
+        if (io->epfd < 0) return -1;
+        // EPOLLEXCLUSIVE : une connexion entrante ne réveille qu'un thread
+        struct epoll_event ev = { .events = EPOLLIN | EPOLLEXCLUSIVE, .data.ptr = NULL };
+        if (epoll_ctl(io->epfd, EPOLL_CTL_ADD, listen_fd, &ev) < 0) return -1;
+        if (pthread_create(&io->thread, NULL, io_thread_func, io) != 0) return -1;
+        io_count++;
+    }
+    log_internal("netio: %d I/O threads", nthreads);
+    return 0;
+}
@@ -0,0 +1,113 @@
+#ifndef NETIO_H
+#define NETIO_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/types.h>
+
+#define CONN_RBUF_SIZE 16384
+#define CONN_MAX_STREAMS 64
+// Sortie en attente au-delà de laquelle le client est jugé arrêté : la
+// connexion est coupée plutôt que de retenir la mémoire indéfiniment
+#define CONN_OUT_MAX (64 * 1024 * 1024)
+// Une tâche dont la connexion a plus de CONN_OUT_HIGH octets en attente cède
+// son tour jusqu'à ce qu'il en reste moins de CONN_OUT_LOW
+#define CONN_OUT_HIGH (1024 * 1024)
+#define CONN_OUT_LOW (256 * 1024)
+
+struct IoThread;
+struct TaskBuf;
+struct Session;
+struct OutChunk;
+
+// Producteur garé sur la sortie d'une connexion
+typedef struct {
+    void (*fn)(void *a, void *b);
+    void *a, *b;
+} OutWaiter;
+
+// Une connexion cliente. Compteur de références : le thread d'E/S en tient
+// une tant qu'il surveille le socket, chaque tâche qui l'utilise une autre.
+typedef struct Conn {
+    int fd;
+    int refs;                   // atomique
+    int state;                  // état du protocole, géré par le serveur
+    char rbuf[CONN_RBUF_SIZE];  // octets reçus non encore consommés
+    size_t rlen;
+    char *pseudo;
+    int priority;
+    struct Session *session;    // ouverte à l'authentification (ou NULL)
+    // Tâches dont le client envoie encore les données (thread d'E/S seul)
+    struct TaskBuf *streams[CONN_MAX_STREAMS];
+    struct TaskBuf *data_dst;   // destination de la trame DATA en cours (NULL = jetée)
+    uint32_t data_left;         // octets restants de cette trame
+    bool no_splice;             // splice() refusé pour ce socket : copie
+    pthread_mutex_t wlock;      // une trame sortante à la fois
+    // Sortie différée (wlock) : ce que le socket n'a pas pris tout de suite,
+    // envoyé dans l'ordre par le thread d'E/S sur EPOLLOUT
+    struct OutChunk *out_head, *out_tail;
+    size_t out_bytes;           // écrit sous wlock, lu aussi sans verrou
+    bool out_armed;             // EPOLLOUT demandé
+    bool out_dead;              // erreur d'écriture : plus rien ne part
+    OutWaiter out_wait[CONN_MAX_STREAMS];
+    int out_nwait;
+    struct IoThread *io;
+} Conn;
+
+typedef struct {
+    // Appelé par le thread d'E/S quand c->rbuf a reçu des octets.
+    // Retourne 0 pour continuer, -1 pour fermer la connexion.
+    int (*on_input)(Conn *c);
+    // Appelé à l'acceptation ; retourne -1 pour refuser (réponse déjà envoyée).
+    int (*on_accept)(Conn *c);
+    // Appelé par le thread d'E/S quand il abandonne la connexion.
+    void (*on_close)(Conn *c);
+} NetioHandlers;
+
+// Lance nthreads threads epoll se partageant listen_fd (passé non bloquant).
+int netio_start(int listen_fd, int nthreads, const NetioHandlers *h, bool *running);
+
+// Retire les n premiers octets de c->rbuf.
+void netio_consume(Conn *c, size_t n);
+
+// Les envois ne bloquent jamais : ce que le socket ne prend pas tout de suite
+// est mis en attente sur la connexion, derrière les trames déjà en attente.
+// -1 : connexion coupée (erreur d'écriture, ou sortie en attente au-delà de
+// CONN_OUT_MAX).
+
+// Envoie une trame du protocole, sérialisée avec les autres écrivains.
+int netio_send_frame(Conn *c, uint8_t type, uint32_t task_id, const void *payload, uint32_t len);
+
+// Trame dont la charge (len octets lisibles sur le tube pipe_fd) passe
+// directement du tube au socket par splice() ; la part que le socket refuse
+// est lue du tube et mise en attente. Coupe la connexion sur échec.
+int netio_send_frame_from_fd(Conn *c, uint8_t type, uint32_t task_id, int pipe_fd, uint32_t len);
+
+// Trame dont la charge est lue dans le fichier file_fd (len octets à partir
+// de offset) par sendfile() ; la part que le socket refuse attend sous forme
+// de segment du fichier (descripteur dupliqué). Coupe la connexion sur échec.
+int netio_send_frame_from_file(Conn *c, uint8_t type, uint32_t task_id, int file_fd, off_t offset,
+                               uint32_t len);
+
+// Sortie en attente de c (lecture sans verrou, indicative).
+size_t netio_output_pending(Conn *c);
+
+// Gare un producteur tant que la sortie en attente de c dépasse
+// CONN_OUT_LOW : fn(a, b) sera appelé une fois, depuis le thread d'E/S,
+// quand elle est redescendue ou que la connexion tombe. Retourne false,
+// sans rien enregistrer, si elle est déjà sous CONN_OUT_HIGH (ou la
+// connexion coupée) : le producteur peut continuer.
+bool netio_park_output(Conn *c, void (*fn)(void *a, void *b), void *a, void *b);
+// Annule le réveil enregistré pour b. Retourne false s'il est déjà parti.
+bool netio_unpark_output(Conn *c, void *b);
+
+void conn_get(Conn *c);
+// Relâche une référence ; à zéro, ferme le socket (signature de NetTask.conn_put).
+void conn_put(void *c);
+
+// Nombre de connexions ouvertes.
+int netio_active_conns(void);
+
+#endif // NETIO_H
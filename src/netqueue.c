@@ -1,54 +1,413 @@
 #include "netqueue.h"
+#include "mempool.h"
 #include <stdlib.h>
-#include <unistd.h>
+
+#define INDEX_INITIAL_CAP 64
+#define DRR_FLOW_BUCKETS 256    // puissance de 2
+
+static Slab nettask_slab = SLAB_INITIALIZER("nettask", sizeof(NetTask), 64);
+static Slab drrflow_slab = SLAB_INITIALIZER("drrflow", sizeof(DrrFlow), 64);
 
 void netqueue_init(NetQueue *q) {
-    q->head = NULL;
-    q->tail = NULL;
+    q->policy = NETQUEUE_SRPT;
+    for (int p = 0; p < NETQUEUE_PRIORITIES; p++) {
+        q->buckets[p].items = NULL;
+        q->buckets[p].size = 0;
+        q->buckets[p].cap = 0;
+        q->rings[p].head = q->rings[p].tail = NULL;
+    }
+    q->flows = NULL;
+    q->index = NULL;
+    q->index_cap = 0;
     q->size = 0;
     pthread_mutex_init(&q->mutex, NULL);
     pthread_cond_init(&q->cond, NULL);
 }
 
-void netqueue_enqueue(NetQueue *q, NetTask *t) {
-    t->next = NULL;
+static int bucket_of(const NetTask *t) {
+    if (t->user_priority < 0) return 0;
+    if (t->user_priority >= NETQUEUE_PRIORITIES) return NETQUEUE_PRIORITIES - 1;
+    return t->user_priority;
+}
+
+static long remaining(const NetTask *t) {
+    return t->total_size - t->processed_bytes;
+}
+
+// ---------------------------------------------------------------------------
+// Tas min (verrou tenu par l'appelant)
+
+static void heap_set(TaskHeap *h, int i, NetTask *t) {
+    h->items[i] = t;
+    t->heap_pos = i;
+}
+
+static void sift_up(TaskHeap *h, int i) {
+    NetTask *t = h->items[i];
+    while (i > 0) {
+        int parent = (i - 1) / 2;
+        if (remaining(h->items[parent]) <= remaining(t)) break;
+        heap_set(h, i, h->items[parent]);
+        i = parent;
+    }
+    heap_set(h, i, t);
+}
+
+static void sift_down(TaskHeap *h, int i) {
+    NetTask *t = h->items[i];
+    for (;;) {
+        int child = 2 * i + 1;
+        if (child >= h->size) break;
+        if (child + 1 < h->size &&
+            remaining(h->items[child + 1]) < remaining(h->items[child])) child++;
+        if (remaining(t) <= remaining(h->items[child])) break;
+        heap_set(h, i, h->items[child]);
+        i = child;
+    }
+    heap_set(h, i, t);
+}
+
+static bool heap_push(TaskHeap *h, NetTask *t) {
+    if (h->size == h->cap) {
+        int ncap = h->cap ? h->cap * 2 : 16;
+        NetTask **n = realloc(h->items, sizeof(NetTask *) * ncap);
+        if (!n) return false;
+        h->items = n;
+        h->cap = ncap;
+    }
+    heap_set(h, h->size++, t);
+    sift_up(h, h->size - 1);
+    return true;
+}
+
+static void heap_delete(TaskHeap *h, int i) {
+    NetTask *gone = h->items[i];
+    NetTask *last = h->items[--h->size];
+    gone->heap_pos = -1;
+    if (i == h->size) return;
+    heap_set(h, i, last);
+    sift_up(h, i);
+    sift_down(h, last->heap_pos);
+}
+
+// ---------------------------------------------------------------------------
+// Index id -> tâche, sondage linéaire (verrou tenu par l'appelant)
+
+static unsigned slot_of(int id, int cap) {
+    return ((unsigned)id * 2654435761u) & (unsigned)(cap - 1);
+}
+
+static bool index_insert(NetQueue *q, NetTask *t);
+
+static bool index_grow(NetQueue *q) {
+    int ncap = q->index_cap ? q->index_cap * 2 : INDEX_INITIAL_CAP;
+    NetTask **old = q->index;
+    int ocap = q->index_cap;
+    q->index = calloc(ncap, sizeof(NetTask *));
+    if (!q->index) {
+        q->index = old;
+        return false;
+    }
+    q->index_cap = ncap;
+    for (int i = 0; i < ocap; i++) {
+        if (old[i]) index_insert(q, old[i]);
+    }
+    free(old);
+    return true;
+}
+
+static bool index_insert(NetQueue *q, NetTask *t) {
+    // Facteur de charge max 1/2
+    if ((q->size + 1) * 2 > q->index_cap && !index_grow(q)) return false;
+    unsigned i = slot_of(t->task_id, q->index_cap);
+    while (q->index[i]) i = (i + 1) & (q->index_cap - 1);
+    q->index[i] = t;
+    return true;
+}
+
+static int index_find(NetQueue *q, int id) {
+    if (!q->index_cap) return -1;
+    unsigned i = slot_of(id, q->index_cap);
+    while (q->index[i]) {
+        if (q->index[i]->task_id == id) return (int)i;
+        i = (i + 1) & (q->index_cap - 1);
+    }
+    return -1;
+}
+
+// Suppression par décalage arrière : pas de pierres tombales
+static void index_erase(NetQueue *q, int id) {
+    int hole = index_find(q, id);
+    if (hole < 0) return;
+    unsigned mask = q->index_cap - 1;
+    unsigned i = hole;
+    q->index[hole] = NULL;
+    for (;;) {
+        i = (i + 1) & mask;
+        NetTask *t = q->index[i];
+        if (!t) break;
+        unsigned home = slot_of(t->task_id, q->index_cap);
+        // t peut combler le trou si son slot d'origine n'est pas dans ]hole, i]
+        if (((i - home) & mask) >= ((i - (unsigned)hole) & mask)) {
+            q->index[hole] = t;
+            q->index[i] = NULL;
+            hole = i;
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Deficit round robin (verrou tenu par l'appelant)
+
+// Crédit d'un tour de ronde : la tranche de temps du niveau
+static long drr_credit(int level) {
+    return NETQUEUE_SLICE_NS(level);
+}
+
+static unsigned flow_slot(const void *key, int level) {
+    uint64_t k = (uint64_t)(uintptr_t)key >> 4;
+    return (unsigned)((k * 0x9E3779B97F4A7C15ull) >> 40 ^ (unsigned)level) & (DRR_FLOW_BUCKETS - 1);
+}
+
+static DrrFlow *flow_find(NetQueue *q, const void *key, int level) {
+    for (DrrFlow *f = q->flows[flow_slot(key, level)]; f; f = f->hnext) {
+        if (f->key == key && f->level == level) return f;
+    }
+    return NULL;
+}
+
+// Nouvel utilisateur actif : en fin de ronde, crédité pour son premier tour
+static DrrFlow *flow_new(NetQueue *q, const void *key, int level) {
+    DrrFlow *f = slab_alloc(&drrflow_slab);
+    if (!f) return NULL;
+    unsigned slot = flow_slot(key, level);
+    f->key = key;
+    f->level = level;
+    f->deficit = drr_credit(level);
+    f->hnext = q->flows[slot];
+    q->flows[slot] = f;
+    DrrRing *r = &q->rings[level];
+    if (r->tail) r->tail->next = f;
+    else r->head = f;
+    r->tail = f;
+    return f;
+}
+
+// Utilisateur sans tâche en attente : quitte la ronde, son crédit est perdu
+static void flow_release(NetQueue *q, DrrFlow *f) {
+    for (DrrFlow **pp = &q->flows[flow_slot(f->key, f->level)]; *pp; pp = &(*pp)->hnext) {
+        if (*pp == f) {
+            *pp = f->hnext;
+            break;
+        }
+    }
+    DrrRing *r = &q->rings[f->level];
+    DrrFlow *prev = NULL;
+    for (DrrFlow *x = r->head; x; prev = x, x = x->next) {
+        if (x != f) continue;
+        if (prev) prev->next = f->next;
+        else r->head = f->next;
+        if (r->tail == f) r->tail = prev;
+        break;
+    }
+    slab_free(&drrflow_slab, f);
+}
+
+static void flow_append(DrrFlow *f, NetTask *t) {
+    t->drr_next = NULL;
+    if (f->tail) f->tail->drr_next = t;
+    else f->head = t;
+    f->tail = t;
+}
+
+static bool drr_push(NetQueue *q, NetTask *t) {
+    int level = bucket_of(t);
+    DrrFlow *f = flow_find(q, t->session, level);
+    if (!f) f = flow_new(q, t->session, level);
+    if (!f) return false;
+    // Régularisation : le quantum est débité d'une estimation au départ, le
+    // temps réel n'est connu qu'au retour (ou plus tard pour les blocs
+    // parallèles encore en compression)
+    long service = (long)__atomic_load_n(&t->service_ns, __ATOMIC_RELAXED);
+    long delta = service - t->drr_billed;
+    f->deficit -= delta;
+    t->drr_deficit -= delta;
+    t->drr_billed = service;
+    t->drr_deficit += drr_credit(level);
+    flow_append(f, t);
+    return true;
+}
+
+// Tête de la ronde dont le crédit est positif ; les autres passent en fin
+// de ronde avec le crédit d'un tour
+static DrrFlow *drr_pick_flow(DrrRing *r) {
+    for (;;) {
+        DrrFlow *f = r->head;
+        if (f->deficit > 0) return f;
+        f->deficit += drr_credit(f->level);
+        if (f->next) {
+            r->head = f->next;
+            f->next = NULL;
+            r->tail->next = f;
+            r->tail = f;
+        }
+    }
+}
+
+// Même règle entre les tâches de l'utilisateur
+static NetTask *drr_pick_task(DrrFlow *f) {
+    for (;;) {
+        NetTask *t = f->head;
+        if (t->drr_deficit > 0) return t;
+        t->drr_deficit += drr_credit(f->level);
+        if (t->drr_next) {
+            f->head = t->drr_next;
+            t->drr_next = NULL;
+            f->tail->drr_next = t;
+            f->tail = t;
+        }
+    }
+}
+
+static void drr_unlink(NetQueue *q, NetTask *t) {
+    DrrFlow *f = flow_find(q, t->session, bucket_of(t));
+    if (!f) return;
+    NetTask *prev = NULL;
+    for (NetTask *x = f->head; x; prev = x, x = x->drr_next) {
+        if (x != t) continue;
+        if (prev) prev->drr_next = t->drr_next;
+        else f->head = t->drr_next;
+        if (f->tail == t) f->tail = prev;
+        break;
+    }
+    t->drr_next = NULL;
+    if (!f->head) flow_release(q, f);
+}
+
+// Prochaine tâche DRR, débitée d'avance du quantum qu'elle va recevoir
+static NetTask *drr_take(NetQueue *q) {
+    for (int p = 0; p < NETQUEUE_PRIORITIES; p++) {
+        if (!q->rings[p].head) continue;
+        DrrFlow *f = drr_pick_flow(&q->rings[p]);
+        NetTask *t = drr_pick_task(f);
+        long est = drr_credit(p);
+        if (t->cost_ns > 0 && remaining(t) * t->cost_ns < est) est = (long)(remaining(t) * t->cost_ns);
+        f->deficit -= est;
+        t->drr_deficit -= est;
+        t->drr_billed += est;
+        return t;
+    }
+    return NULL;
+}
+
+// ---------------------------------------------------------------------------
+
+int netqueue_set_policy(NetQueue *q, NetQueuePolicy policy) {
+    if (policy == NETQUEUE_DRR && !q->flows) {
+        q->flows = calloc(DRR_FLOW_BUCKETS, sizeof(DrrFlow *));
+        if (!q->flows) return -1;
+    }
+    q->policy = policy;
+    return 0;
+}
+
+static NetTask *best_locked(NetQueue *q) {
+    for (int p = 0; p < NETQUEUE_PRIORITIES; p++) {
+        if (q->policy == NETQUEUE_DRR && q->rings[p].head) return q->rings[p].head->head;
+        if (q->buckets[p].size) return q->buckets[p].items[0];
+    }
+    return NULL;
+}
+
+static void remove_locked(NetQueue *q, NetTask *t) {
+    index_erase(q, t->task_id);
+    if (q->policy == NETQUEUE_DRR) drr_unlink(q, t);
+    else heap_delete(&q->buckets[bucket_of(t)], t->heap_pos);
+    q->size--;
+}
+
+bool netqueue_enqueue(NetQueue *q, NetTask *t) {
     pthread_mutex_lock(&q->mutex);
-    if (!q->tail) {
-        q->head = q->tail = t;
-    } else {
-        q->tail->next = t;
-        q->tail = t;
+    if (!index_insert(q, t)) {
+        pthread_mutex_unlock(&q->mutex);
+        return false;
+    }
+    bool ok = q->policy == NETQUEUE_DRR ? drr_push(q, t) : heap_push(&q->buckets[bucket_of(t)], t);
+    if (!ok) {
+        index_erase(q, t->task_id);
+        pthread_mutex_unlock(&q->mutex);
+        return false;
     }
     q->size++;
     pthread_cond_signal(&q->cond);
     pthread_mutex_unlock(&q->mutex);
+    return true;
 }
 
 NetTask *netqueue_dequeue(NetQueue *q) {
     pthread_mutex_lock(&q->mutex);
-    if (!q->head) {
-        pthread_mutex_unlock(&q->mutex);
-        return NULL;
-    }
-    NetTask *t = q->head;
-    q->head = t->next;
-    if (!q->head) q->tail = NULL;
-    q->size--;
+    NetTask *t = q->policy == NETQUEUE_DRR ? drr_take(q) : best_locked(q);
+    if (t) remove_locked(q, t);
     pthread_mutex_unlock(&q->mutex);
     return t;
 }
 
+NetTask *netqueue_remove(NetQueue *q, int task_id) {
+    pthread_mutex_lock(&q->mutex);
+    int slot = index_find(q, task_id);
+    NetTask *t = slot >= 0 ? q->index[slot] : NULL;
+    if (t) remove_locked(q, t);
+    pthread_mutex_unlock(&q->mutex);
+    return t;
+}
+
+bool netqueue_peek(NetQueue *q, int *priority, long *rem) {
+    pthread_mutex_lock(&q->mutex);
+    NetTask *t = best_locked(q);
+    if (t) {
+        *priority = bucket_of(t);
+        *rem = remaining(t);
+    }
+    pthread_mutex_unlock(&q->mutex);
+    return t != NULL;
+}
+
+void netqueue_foreach(NetQueue *q, void (*fn)(NetTask *t, void *ctx), void *ctx) {
+    pthread_mutex_lock(&q->mutex);
+    for (int p = 0; p < NETQUEUE_PRIORITIES; p++) {
+        for (int i = 0; i < q->buckets[p].size; i++) fn(q->buckets[p].items[i], ctx);
+        for (DrrFlow *f = q->rings[p].head; f; f = f->next) {
+            for (NetTask *t = f->head; t; t = t->drr_next) fn(t, ctx);
+        }
+    }
+    pthread_mutex_unlock(&q->mutex);
+}
+
 bool netqueue_is_empty(NetQueue *q) {
     pthread_mutex_lock(&q->mutex);
-    bool empty = (q->head == NULL);
+    bool empty = (q->size == 0);
     pthread_mutex_unlock(&q->mutex);
     return empty;
 }
 
+NetTask *nettask_new(void) {
+    NetTask *t = slab_alloc(&nettask_slab);
+    if (t) t->heap_pos = -1;
+    return t;
+}
+
 void nettask_free(NetTask *t) {
     if (!t) return;
-    if (t->client_fd >= 0) close(t->client_fd);
-    if (t->meta) free(t->meta);
-    if (t->output_name) free(t->output_name);
-    free(t);
+    if (t->codec && t->codec_free) t->codec_free(t->codec);
+    if (t->cache && t->cache_free) t->cache_free(t->cache);
+    if (t->resume && t->resume_free) t->resume_free(t->resume);
+    if (t->session && t->session_release) t->session_release(t->session, t->session_bytes);
+    if (t->input) {
+        taskbuf_close(t->input);
+        taskbuf_put(t->input);
+    }
+    if (t->conn && t->conn_put) t->conn_put(t->conn);
+    bufpool_strfree(t->meta);
+    bufpool_strfree(t->output_name);
+    slab_free(&nettask_slab, t);
 }
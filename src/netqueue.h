@@ -2,37 +2,135 @@
 #define NETQUEUE_H
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <pthread.h>
+#include "taskbuf.h"
+
+// Niveaux de priorité utilisateur (0 = la plus haute)
+#define NETQUEUE_PRIORITIES 3
+// Durée visée d'un quantum selon le niveau : 3, 2 puis 1 ms
+#define NETQUEUE_SLICE_NS(level) ((long)(NETQUEUE_PRIORITIES - (level)) * 1000000L)
 
 typedef enum {
     TASK_COMPRESS,
     TASK_CONVERT
 } TaskType;
 
+// Politique de service au sein d'un niveau de priorité
+typedef enum {
+    NETQUEUE_SRPT,              // moins d'octets restants d'abord
+    NETQUEUE_DRR                // deficit round robin : utilisateurs, puis leurs tâches
+} NetQueuePolicy;
+
+// Ce qu'attend une tâche garée hors file
+typedef enum {
+    PARK_INPUT,                 // les données de son prochain quantum
+    PARK_OUTPUT,                // la lecture de sa sortie par le client
+    PARK_BLOCKS                 // l'émission de ses blocs parallèles en cours
+} TaskPark;
+
 typedef struct NetTask {
     int task_id;
-    int client_fd;
+    uint32_t stream_id;         // identifiant de la tâche sur sa connexion
     int user_priority;
     TaskType type;
+    bool parallel;              // compression par blocs sur plusieurs workers
+    int level;                  // niveau Zstd de la trame en cours (0 : pas encore choisi)
+    uint32_t dict_id;           // dictionnaire Zstd de la trame (0 : aucun)
+    bool cached;                // résultat resservi depuis le cache (codec = fichier)
     long total_size;
     long processed_bytes;
+    long bytes_out;             // octets renvoyés au client
+    long progress_sent;         // processed_bytes au dernier FRAME_PROGRESS
+    long window_unacked;        // octets consommés pas encore rendus (FRAME_WINDOW)
     char *meta;
     char *output_name;
-    struct NetTask *next;
+    int heap_pos;               // position dans le tas de sa file, -1 hors file
+    struct NetTask *drr_next;   // suivante du même utilisateur (file DRR)
+    long drr_deficit;           // crédit de la tâche auprès de son utilisateur (ns)
+    long drr_billed;            // service_ns déjà débité (estimation comprise)
+    struct NetTask *park_prev, *park_next;  // garée hors file (registre du pool)
+    TaskPark park;              // ce qu'elle attend (registre du pool)
+    uint64_t cpu_ns;            // temps CPU des workers pour cette tâche (atomique)
+    uint64_t service_ns;        // temps d'occupation des workers (atomique)
+    double cost_ns;             // coût d'un octet, moyenne mobile (0 : inconnu)
+    void *codec;                // état de codage propre à la tâche (ou NULL)
+    void (*codec_free)(void *codec);
+    void *cache;                // résultat en cours d'écriture dans le cache (ou NULL)
+    void (*cache_free)(void *cache);
+    void *resume;               // journal de reprise (ResumeLog) ou NULL
+    void (*resume_free)(void *resume);
+    void *session;              // session de l'utilisateur, quota tenu (ou NULL)
+    long session_bytes;         // octets comptés à l'admission
+    void (*session_release)(void *session, long bytes);
+    void *conn;                 // connexion d'origine, référence tenue (ou NULL)
+    void (*conn_put)(void *conn);
+    TaskBuf *input;             // données reçues, remplies par le thread d'E/S
+    uint64_t created_us;        // acceptation (horloge monotone, métriques)
+    uint64_t ready_us;          // dernière mise en file
 } NetTask;
 
+// Tas binaire min sur les octets restants (total_size - processed_bytes)
+typedef struct {
+    NetTask **items;
+    int size;
+    int cap;
+} TaskHeap;
+
+// Utilisateur ayant des tâches en attente dans un niveau (file DRR)
+typedef struct DrrFlow {
+    const void *key;            // session de l'utilisateur
+    int level;                  // niveau de priorité de la ronde
+    long deficit;
+    NetTask *head, *tail;       // ses tâches, dans l'ordre de service
+    struct DrrFlow *next;       // suivant dans la ronde du niveau
+    struct DrrFlow *hnext;      // chaînage de la table des utilisateurs
+} DrrFlow;
+
+typedef struct {
+    DrrFlow *head, *tail;       // ronde des utilisateurs actifs
+} DrrRing;
+
+// File indexée : un tas par priorité + table id -> tâche (adressage ouvert).
+// Insertion, extraction de la meilleure et retrait par id en O(log n).
+// En politique DRR, chaque niveau sert ses utilisateurs à tour de rôle au
+// lieu du tas : chacun reçoit à son tour un crédit de temps (la tranche de
+// son niveau) et n'est servi que tant que ce crédit est positif ; le temps
+// réellement passé sur chaque quantum (service_ns) est débité à la remise
+// en file. Même règle entre les tâches d'un utilisateur. Un utilisateur qui
+// soumet cinquante tâches n'obtient pas plus que son voisin qui en a une.
 typedef struct {
-    NetTask *head;
-    NetTask *tail;
+    NetQueuePolicy policy;
+    TaskHeap buckets[NETQUEUE_PRIORITIES];
+    DrrRing rings[NETQUEUE_PRIORITIES];
+    DrrFlow **flows;            // utilisateurs actifs par (session, niveau)
+    NetTask **index;
+    int index_cap;              // puissance de 2
     int size;
     pthread_mutex_t mutex;
     pthread_cond_t cond;
 } NetQueue;
 
 void netqueue_init(NetQueue *q);
-void netqueue_enqueue(NetQueue *q, NetTask *t);
+// Choisit la politique ; file encore vide. Retourne -1 si mémoire insuffisante.
+int netqueue_set_policy(NetQueue *q, NetQueuePolicy policy);
+bool netqueue_enqueue(NetQueue *q, NetTask *t);
 NetTask *netqueue_dequeue(NetQueue *q);
 bool netqueue_is_empty(NetQueue *q);
+// Tâche mise à zéro, prise dans le slab des tâches. meta et output_name
+// doivent venir de bufpool_strdup : nettask_free les rend au pool.
+NetTask *nettask_new(void);
 void nettask_free(NetTask *t);
 
+// Retire la tâche d'identifiant task_id, NULL si absente.
+NetTask *netqueue_remove(NetQueue *q, int task_id);
+
+// Clé de la prochaine tâche servie par netqueue_dequeue (priorité, octets
+// restants ; en DRR, ceux de la tâche en tête de la ronde). Retourne false
+// si la file est vide.
+bool netqueue_peek(NetQueue *q, int *priority, long *remaining);
+
+// Appelle fn sur chaque tâche en attente, verrou de la file tenu.
+void netqueue_foreach(NetQueue *q, void (*fn)(NetTask *t, void *ctx), void *ctx);
+
 #endif // NETQUEUE_H
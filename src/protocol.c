@@ -0,0 +1,92 @@
+#include "protocol.h"
+#include "utils.h"
+#include <string.h>
+#include <sys/uio.h>
+
+void proto_pack_header(uint8_t *buf, uint8_t type, uint32_t task_id, uint32_t length) {
+    buf[0] = PROTO_VERSION;
+    buf[1] = type;
+    put_u16(buf + 2, 0);
+    put_u32(buf + 4, task_id);
+    put_u32(buf + 8, length);
+}
+
+int proto_parse_header(const uint8_t *buf, ProtoHeader *h) {
+    h->version = buf[0];
+    h->type = buf[1];
+    h->flags = get_u16(buf + 2);
+    h->task_id = get_u32(buf + 4);
+    h->length = get_u32(buf + 8);
+    if (h->version != PROTO_VERSION) return -1;
+    if (h->length > PROTO_MAX_PAYLOAD) return -1;
+    return 0;
+}
+
+int proto_send(int fd, uint8_t type, uint32_t task_id, const void *payload, uint32_t len) {
+    uint8_t hdr[PROTO_HEADER_SIZE];
+    proto_pack_header(hdr, type, task_id, len);
+    struct iovec iov[2] = {
+        { .iov_base = hdr, .iov_len = sizeof(hdr) },
+        { .iov_base = (void *)payload, .iov_len = len },
+    };
+    return writev_all(fd, iov, len ? 2 : 1) < 0 ? -1 : 0;
+}
+
+int proto_send_file(int fd, uint8_t type, uint32_t task_id, int file_fd, off_t offset, uint32_t len) {
+    uint8_t hdr[PROTO_HEADER_SIZE];
+    proto_pack_header(hdr, type, task_id, len);
+    struct iovec iov = { .iov_base = hdr, .iov_len = sizeof(hdr) };
+    if (writev_all(fd, &iov, 1) < 0) return -1;
+    return sendfile_n_bytes(fd, file_fd, offset, len) < 0 ? -1 : 0;
+}
+
+int proto_recv(int fd, ProtoHeader *h, void *buf, size_t cap) {
+    uint8_t hdr[PROTO_HEADER_SIZE];
+    if (read_n_bytes(fd, hdr, sizeof(hdr)) != (ssize_t)sizeof(hdr)) return -1;
+    if (proto_parse_header(hdr, h) < 0) return -1;
+    if (h->length > cap) return -1;
+    if (h->length && read_n_bytes(fd, buf, h->length) != (ssize_t)h->length) return -1;
+    return 0;
+}
+
+ssize_t proto_encode_task(const ProtoTask *t, uint8_t *buf, size_t cap) {
+    size_t ml = strlen(t->meta), ol = strlen(t->out);
+    if (ml > PROTO_MAX_NAME || ol > PROTO_MAX_NAME) return -1;
+    size_t hl = (t->flags & PROTO_TASK_HASHED) ? 8 : 0;
+    size_t rl = (t->flags & PROTO_TASK_RESUME) ? 16 : 0;
+    if (PROTO_TASK_FIXED + ml + ol + hl + rl > cap) return -1;
+    buf[0] = t->type;
+    buf[1] = t->flags;
+    put_u16(buf + 2, (uint16_t)ml);
+    put_u16(buf + 4, (uint16_t)ol);
+    put_u16(buf + 6, 0);
+    put_u64(buf + 8, t->total_size);
+    memcpy(buf + PROTO_TASK_FIXED, t->meta, ml);
+    memcpy(buf + PROTO_TASK_FIXED + ml, t->out, ol);
+    if (hl) put_u64(buf + PROTO_TASK_FIXED + ml + ol, t->hash);
+    if (rl) {
+        put_u64(buf + PROTO_TASK_FIXED + ml + ol + hl, t->resume_token);
+        put_u64(buf + PROTO_TASK_FIXED + ml + ol + hl + 8, t->resume_have);
+    }
+    return PROTO_TASK_FIXED + ml + ol + hl + rl;
+}
+
+int proto_decode_task(const uint8_t *buf, size_t len, ProtoTask *t) {
+    if (len < PROTO_TASK_FIXED) return -1;
+    size_t ml = get_u16(buf + 2), ol = get_u16(buf + 4);
+    if (ml > PROTO_MAX_NAME || ol > PROTO_MAX_NAME) return -1;
+    size_t hl = (buf[1] & PROTO_TASK_HASHED) ? 8 : 0;
+    size_t rl = (buf[1] & PROTO_TASK_RESUME) ? 16 : 0;
+    if (PROTO_TASK_FIXED + ml + ol + hl + rl > len) return -1;
+    t->type = buf[0];
+    t->flags = buf[1];
+    t->hash = hl ? get_u64(buf + PROTO_TASK_FIXED + ml + ol) : 0;
+    t->resume_token = rl ? get_u64(buf + PROTO_TASK_FIXED + ml + ol + hl) : 0;
+    t->resume_have = rl ? get_u64(buf + PROTO_TASK_FIXED + ml + ol + hl + 8) : 0;
+    t->total_size = get_u64(buf + 8);
+    memcpy(t->meta, buf + PROTO_TASK_FIXED, ml);
+    t->meta[ml] = '\0';
+    memcpy(t->out, buf + PROTO_TASK_FIXED + ml, ol);
+    t->out[ol] = '\0';
+    return 0;
+}
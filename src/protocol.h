@@ -0,0 +1,119 @@
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+// Protocole binaire NetScheduler : chaque message est une trame
+//   u8 version | u8 type | u16 flags | u32 task_id | u32 longueur | charge utile
+// (entiers en ordre réseau). task_id est choisi par le client et identifie
+// une tâche au sein de la connexion ; 0 = trame de connexion.
+#define PROTO_VERSION      1
+#define PROTO_HEADER_SIZE  12
+#define PROTO_MAX_PAYLOAD  (1u << 20)
+#define PROTO_DATA_CHUNK   (64 * 1024)     // taille conseillée des trames DATA
+#define PROTO_MAX_NAME     1024
+// Contrôle de flux par tâche : le client n'envoie pas plus de données que la
+// fenêtre accordée. Elle vaut PROTO_INITIAL_WINDOW au départ et le serveur
+// la rouvre (FRAME_WINDOW) au fur et à mesure que les workers consomment.
+#define PROTO_INITIAL_WINDOW (1024 * 1024)
+
+typedef enum {
+    FRAME_AUTH      = 1,   // C→S  pseudo
+    FRAME_AUTH_OK   = 2,   // S→C  u32 priorité
+    FRAME_AUTH_FAIL = 3,   // S→C  message
+    FRAME_TASK      = 4,   // C→S  en-tête de tâche (ProtoTask)
+    FRAME_ACCEPT    = 5,   // S→C  u32 identifiant serveur de la tâche
+                           //      [u8 flags PROTO_ACCEPT_*, voir plus bas]
+    FRAME_DATA      = 6,   // C↔S  octets de la tâche
+    FRAME_END       = 7,   // C→S  fin d'envoi ; S→C u64 octets produits
+                           //      [u32 id du dictionnaire Zstd utilisé]
+    FRAME_PROGRESS  = 8,   // S→C  u64 traités, u64 total
+    FRAME_ERROR     = 9,   // S→C  message (tâche ou connexion)
+    FRAME_BYE       = 10,  // C→S  déconnexion
+    FRAME_WINDOW    = 11,  // S→C  u32 octets supplémentaires autorisés
+    FRAME_DICT_GET  = 12,  // C→S  u32 id de dictionnaire
+    FRAME_DICT      = 13   // S→C  u32 id | contenu (vide si inconnu)
+} FrameType;
+
+typedef struct {
+    uint8_t version;
+    uint8_t type;
+    uint16_t flags;
+    uint32_t task_id;
+    uint32_t length;
+} ProtoHeader;
+
+// Charge utile de FRAME_TASK :
+//   u8 type | u8 flags | u16 len(meta) | u16 len(out) | u16 0 | u64 taille | meta | out
+//   [| u64 empreinte du contenu si PROTO_TASK_HASHED]
+//   [| u64 jeton | u64 octets de sortie déjà reçus si PROTO_TASK_RESUME]
+#define PROTO_TASK_FIXED 16
+#define PROTO_TASK_COMPRESS 0
+#define PROTO_TASK_CONVERT  1
+// flags de FRAME_TASK
+#define PROTO_TASK_ARCHIVE  0x01   // flux tar d'un dossier (compression seulement)
+#define PROTO_TASK_PARALLEL 0x02   // gros fichier : blocs compressés en parallèle,
+                                   // sortie au format Zstd seekable
+#define PROTO_TASK_HASHED   0x04   // empreinte XXH64 du contenu jointe : le
+                                   // serveur peut resservir un résultat en cache
+#define PROTO_TASK_RESUMABLE 0x08  // le client sait reprendre après une coupure
+#define PROTO_TASK_RESUME   0x10   // reprise d'une tâche suspendue (jeton joint) ;
+                                   // jeton refusé : la tâche repart de zéro
+// FRAME_ACCEPT : u32 id | u8 flags | [u64 jeton] | [u64 entrée | u64 sortie]
+#define PROTO_ACCEPT_CACHED 0x01   // résultat servi depuis le cache du serveur :
+                                   // ne plus envoyer
+#define PROTO_ACCEPT_RESUMABLE 0x02 // jeton de reprise joint
+#define PROTO_ACCEPT_RESUMED 0x04  // reprise acceptée : envoyer l'entrée à partir
+                                   // de l'offset joint, sortie tronquée à l'autre
+
+typedef struct {
+    uint8_t type;
+    uint8_t flags;
+    uint64_t total_size;
+    uint64_t hash;          // si PROTO_TASK_HASHED
+    uint64_t resume_token;  // si PROTO_TASK_RESUME
+    uint64_t resume_have;
+    char meta[PROTO_MAX_NAME + 1];
+    char out[PROTO_MAX_NAME + 1];
+} ProtoTask;
+
+static inline void put_u16(uint8_t *p, uint16_t v) { p[0] = v >> 8; p[1] = v; }
+static inline void put_u32(uint8_t *p, uint32_t v) {
+    p[0] = v >> 24; p[1] = v >> 16; p[2] = v >> 8; p[3] = v;
+}
+static inline void put_u64(uint8_t *p, uint64_t v) {
+    put_u32(p, (uint32_t)(v >> 32)); put_u32(p + 4, (uint32_t)v);
+}
+static inline uint16_t get_u16(const uint8_t *p) { return (uint16_t)(p[0] << 8 | p[1]); }
+static inline uint32_t get_u32(const uint8_t *p) {
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+static inline uint64_t get_u64(const uint8_t *p) {
+    return (uint64_t)get_u32(p) << 32 | get_u32(p + 4);
+}
+
+void proto_pack_header(uint8_t *buf, uint8_t type, uint32_t task_id, uint32_t length);
+
+// Décode un en-tête ; retourne -1 si version ou longueur invalide.
+int proto_parse_header(const uint8_t *buf, ProtoHeader *h);
+
+// Envoie une trame complète (en-tête + charge) ; gère EINTR et EAGAIN.
+// Retourne 0, ou -1 en cas d'erreur.
+int proto_send(int fd, uint8_t type, uint32_t task_id, const void *payload, uint32_t len);
+
+// Envoie une trame dont la charge est lue directement dans le fichier file_fd
+// (len octets à partir de offset) par sendfile(). Une erreur après l'en-tête
+// laisse le flux indécodable : l'appelant doit couper la connexion.
+int proto_send_file(int fd, uint8_t type, uint32_t task_id, int file_fd, off_t offset, uint32_t len);
+
+// Lit une trame (bloquant). La charge est écrite dans buf (cap octets max).
+// Retourne 0, ou -1 en cas d'erreur / fin de flux / trame trop grande.
+int proto_recv(int fd, ProtoHeader *h, void *buf, size_t cap);
+
+// Encode / décode la charge de FRAME_TASK. encode retourne la longueur ou -1.
+ssize_t proto_encode_task(const ProtoTask *t, uint8_t *buf, size_t cap);
+int proto_decode_task(const uint8_t *buf, size_t len, ProtoTask *t);
+
+#endif // PROTOCOL_H
@@ -0,0 +1,281 @@
+#include "resultcache.h"
+#include "log.h"
+#include "metrics.h"
+#include "utils.h"
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define RCACHE_BUCKETS 4096         // puissance de 2
+#define RCACHE_SUFFIX ".res"
+#define RCACHE_TMP_PREFIX ".tmp."
+
+typedef struct Entry {
+    char key[RCACHE_KEY_MAX];
+    uint64_t size;
+    time_t mtime;                   // ordre LRU au rechargement
+    struct Entry *hnext;            // chaîne du seau
+    struct Entry *prev, *next;      // LRU : tête = plus récent
+} Entry;
+
+struct RCacheWriter {
+    char key[RCACHE_KEY_MAX];
+    char tmp[512];
+    int fd;
+    uint64_t size;
+    bool failed;
+    uint64_t in_hash, in_size;      // annoncés par le client
+    Xxh64State in;                  // entrée réellement consommée
+};
+
+static char *cache_dir = NULL;
+static uint64_t cache_max = 0;
+static uint64_t cache_used = 0;
+static Entry *buckets[RCACHE_BUCKETS];
+static Entry *lru_head = NULL, *lru_tail = NULL;
+static unsigned long tmp_seq = 0;
+static pthread_mutex_t cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static unsigned key_bucket(const char *key) {
+    uint32_t h = 2166136261u;       // FNV-1a
+    for (; *key; key++) h = (h ^ (uint8_t)*key) * 16777619u;
+    return h & (RCACHE_BUCKETS - 1);
+}
+
+static void entry_path(const char *key, char *buf, size_t cap) {
+    snprintf(buf, cap, "%s/%s" RCACHE_SUFFIX, cache_dir, key);
+}
+
+static Entry *find(const char *key) {
+    for (Entry *e = buckets[key_bucket(key)]; e; e = e->hnext) {
+        if (strcmp(e->key, key) == 0) return e;
+    }
+    return NULL;
+}
+
+static void lru_unlink(Entry *e) {
+    if (e->prev) e->prev->next = e->next;
+    else lru_head = e->next;
+    if (e->next) e->next->prev = e->prev;
+    else lru_tail = e->prev;
+    e->prev = e->next = NULL;
+}
+
+static void lru_push_front(Entry *e) {
+    e->prev = NULL;
+    e->next = lru_head;
+    if (lru_head) lru_head->prev = e;
+    lru_head = e;
+    if (!lru_tail) lru_tail = e;
+}
+
+static void insert(Entry *e) {
+    unsigned b = key_bucket(e->key);
+    e->hnext = buckets[b];
+    buckets[b] = e;
+    lru_push_front(e);
+    cache_used += e->size;
+}
+
+static void remove_entry(Entry *e) {
+    Entry **pp = &buckets[key_bucket(e->key)];
+    while (*pp != e) pp = &(*pp)->hnext;
+    *pp = e->hnext;
+    lru_unlink(e);
+    cache_used -= e->size;
+}
+
+// Évince depuis la queue LRU jusqu'à repasser sous la borne (verrou tenu).
+// Un fichier évincé encore ouvert pour un envoi reste lisible jusqu'à sa fermeture.
+static void evict(void) {
+    while (cache_used > cache_max && lru_tail) {
+        Entry *e = lru_tail;
+        char path[512];
+        entry_path(e->key, path, sizeof(path));
+        unlink(path);
+        remove_entry(e);
+        log_msg(LOG_DEBUG, 0, "result cache evict %s (%llu bytes)", e->key, (unsigned long long)e->size);
+        free(e);
+    }
+}
+
+static int cmp_mtime(const void *a, const void *b) {
+    const Entry *x = *(Entry *const *)a, *y = *(Entry *const *)b;
+    return (x->mtime > y->mtime) - (x->mtime < y->mtime);
+}
+
+// Reconstruit l'index : résultats publiés, du plus ancien au plus récent ;
+// les fichiers temporaires d'une exécution interrompue sont supprimés
+static void load_dir(void) {
+    DIR *dir = opendir(cache_dir);
+    if (!dir) return;
+    Entry **list = NULL;
+    size_t n = 0, cap = 0;
+    struct dirent *de;
+    while ((de = readdir(dir))) {
+        char path[512];
+        snprintf(path, sizeof(path), "%s/%s", cache_dir, de->d_name);
+        if (strncmp(de->d_name, RCACHE_TMP_PREFIX, strlen(RCACHE_TMP_PREFIX)) == 0) {
+            unlink(path);
+            continue;
+        }
+        size_t len = strlen(de->d_name), sl = strlen(RCACHE_SUFFIX);
+        if (len <= sl || len - sl >= RCACHE_KEY_MAX || strcmp(de->d_name + len - sl, RCACHE_SUFFIX) != 0) continue;
+        struct stat st;
+        if (stat(path, &st) < 0 || !S_ISREG(st.st_mode)) continue;
+        Entry *e = calloc(1, sizeof(*e));
+        if (!e) break;
+        memcpy(e->key, de->d_name, len - sl);
+        e->size = (uint64_t)st.st_size;
+        e->mtime = st.st_mtime;
+        if (n == cap) {
+            cap = cap ? cap * 2 : 256;
+            Entry **nl = realloc(list, cap * sizeof(*nl));
+            if (!nl) {
+                free(e);
+                break;
+            }
+            list = nl;
+        }
+        list[n++] = e;
+    }
+    closedir(dir);
+    qsort(list, n, sizeof(*list), cmp_mtime);
+    for (size_t i = 0; i < n; i++) insert(list[i]);
+    free(list);
+    evict();
+    if (n) log_internal("Cache de résultats : %zu entrée(s), %llu octets dans %s", n,
+                        (unsigned long long)cache_used, cache_dir);
+}
+
+int rcache_init(const char *dir, uint64_t max_bytes) {
+    if (max_bytes == 0) return 0;
+    if (mkdir(dir, 0755) < 0 && errno != EEXIST) return -1;
+    cache_dir = strdup(dir);
+    if (!cache_dir) return -1;
+    cache_max = max_bytes;
+    pthread_mutex_lock(&cache_mutex);
+    load_dir();
+    pthread_mutex_unlock(&cache_mutex);
+    return 0;
+}
+
+bool rcache_enabled(void) {
+    return cache_dir != NULL;
+}
+
+void rcache_key(char *key, size_t cap, uint64_t hash, uint64_t size, const char *mode) {
+    snprintf(key, cap, "%016llx-%llu-%s", (unsigned long long)hash, (unsigned long long)size, mode);
+}
+
+int rcache_open(const char *key, uint64_t *size) {
+    if (!cache_dir) return -1;
+    int fd = -1;
+    pthread_mutex_lock(&cache_mutex);
+    Entry *e = find(key);
+    if (e) {
+        char path[512];
+        entry_path(key, path, sizeof(path));
+        fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (fd >= 0) {
+            *size = e->size;
+            lru_unlink(e);
+            lru_push_front(e);
+            futimens(fd, NULL);     // l'ordre LRU survit au redémarrage
+        } else {
+            // Supprimé à la main : l'entrée disparaît
+            remove_entry(e);
+            free(e);
+        }
+    }
+    pthread_mutex_unlock(&cache_mutex);
+    metrics_inc(fd >= 0 ? M_RCACHE_HITS : M_RCACHE_MISSES);
+    return fd;
+}
+
+RCacheWriter *rcache_writer_new(const char *key, uint64_t hash, uint64_t in_size) {
+    if (!cache_dir) return NULL;
+    RCacheWriter *w = calloc(1, sizeof(*w));
+    if (!w) return NULL;
+    snprintf(w->key, sizeof(w->key), "%s", key);
+    w->in_hash = hash;
+    w->in_size = in_size;
+    xxh64_init(&w->in, 0);
+    unsigned long seq = __atomic_add_fetch(&tmp_seq, 1, __ATOMIC_RELAXED);
+    snprintf(w->tmp, sizeof(w->tmp), "%s/" RCACHE_TMP_PREFIX "%s.%lu", cache_dir, key, seq);
+    w->fd = open(w->tmp, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+    if (w->fd < 0) {
+        free(w);
+        return NULL;
+    }
+    return w;
+}
+
+void rcache_write(RCacheWriter *w, const void *data, size_t len) {
+    if (w->failed) return;
+    // Au-delà de la borne, le résultat ne serait jamais gardé
+    if (w->size + len > cache_max || write_n_bytes(w->fd, data, len) < 0) {
+        w->failed = true;
+        return;
+    }
+    w->size += len;
+}
+
+void rcache_input(RCacheWriter *w, const void *data, size_t len) {
+    xxh64_update(&w->in, data, len);
+}
+
+void rcache_abort(void *arg) {
+    RCacheWriter *w = arg;
+    if (!w) return;
+    close(w->fd);
+    unlink(w->tmp);
+    free(w);
+}
+
+void rcache_commit(RCacheWriter *w) {
+    if (w->failed || w->size == 0) {
+        rcache_abort(w);
+        return;
+    }
+    // Sans cette vérification, un client pourrait associer n'importe quelle
+    // sortie à l'empreinte d'un contenu qu'il n'a pas envoyé
+    if (w->in.total != w->in_size || xxh64_digest(&w->in) != w->in_hash) {
+        log_msg(LOG_WARN, 0, "result cache: input of %s does not match its digest, not stored", w->key);
+        rcache_abort(w);
+        return;
+    }
+    char path[512];
+    entry_path(w->key, path, sizeof(path));
+    Entry *e = calloc(1, sizeof(*e));
+    int rc = close(w->fd);
+    pthread_mutex_lock(&cache_mutex);
+    // Deux envois simultanés du même contenu : le premier publié reste
+    if (!e || rc < 0 || find(w->key) || rename(w->tmp, path) < 0) {
+        pthread_mutex_unlock(&cache_mutex);
+        free(e);
+        unlink(w->tmp);
+        free(w);
+        return;
+    }
+    snprintf(e->key, sizeof(e->key), "%s", w->key);
+    e->size = w->size;
+    insert(e);
+    evict();
+    pthread_mutex_unlock(&cache_mutex);
+    log_msg(LOG_DEBUG, 0, "result cache store %s (%llu bytes)", w->key, (unsigned long long)w->size);
+    free(w);
+}
+
+uint64_t rcache_bytes(void) {
+    pthread_mutex_lock(&cache_mutex);
+    uint64_t used = cache_used;
+    pthread_mutex_unlock(&cache_mutex);
+    return used;
+}
@@ -0,0 +1,48 @@
+#ifndef RESULTCACHE_H
+#define RESULTCACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Cache disque des résultats, adressé par contenu : la clé réunit l'empreinte
+// XXH64 envoyée par le client, la taille de l'entrée et le mode de traitement
+// (compression, seekable, conversion vers tel format). Un résultat produit
+// pour une tâche empreintée est écrit à côté de son envoi puis publié à la
+// fin de la tâche, à condition que l'entrée réellement reçue ait l'empreinte
+// et la taille annoncées ; une nouvelle soumission du même contenu est resservie
+// depuis le fichier par sendfile(). Taille bornée, éviction LRU ; l'index est
+// reconstruit au démarrage à partir du dossier (ordre des mtime).
+#define RCACHE_DEFAULT_DIR "results"
+#define RCACHE_DEFAULT_MB 1024
+#define RCACHE_KEY_MAX 64
+
+typedef struct RCacheWriter RCacheWriter;
+
+// max_bytes == 0 : cache désactivé (lookup et writer_new échouent).
+int rcache_init(const char *dir, uint64_t max_bytes);
+bool rcache_enabled(void);
+
+// Clé de (empreinte, taille d'entrée, mode).
+void rcache_key(char *key, size_t cap, uint64_t hash, uint64_t size, const char *mode);
+
+// Ouvre le résultat de key (fd en lecture, taille dans *size), -1 si absent.
+int rcache_open(const char *key, uint64_t *size);
+
+// Fichier temporaire recevant le résultat d'une tâche dont le client annonce
+// l'entrée (hash, in_size) ; NULL si impossible.
+RCacheWriter *rcache_writer_new(const char *key, uint64_t hash, uint64_t in_size);
+// Entrée consommée par la tâche, dans l'ordre, pour vérifier l'empreinte.
+void rcache_input(RCacheWriter *w, const void *data, size_t len);
+// Une erreur d'écriture invalide silencieusement le résultat.
+void rcache_write(RCacheWriter *w, const void *data, size_t len);
+// Publie le résultat (rename) et évince au besoin ; l'abandonne si l'entrée
+// consommée ne correspond pas à l'empreinte ou à la taille annoncées.
+void rcache_commit(RCacheWriter *w);
+// Abandonne le résultat (signature de NetTask.cache_free).
+void rcache_abort(void *w);
+
+// Octets occupés par le cache (jauge).
+uint64_t rcache_bytes(void);
+
+#endif // RESULTCACHE_H
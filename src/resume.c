@@ -0,0 +1,247 @@
+#include "resume.h"
+#include "log.h"
+#include "utils.h"
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define CKPT_MAGIC "netsched-resume 1"
+
+// Jetons des journaux ouverts : une reprise ne peut pas saisir la sortie
+// d'une tâche encore active (coupure pas encore vue par le serveur)
+typedef struct Active {
+    uint64_t token;
+    struct Active *next;
+} Active;
+
+static char *resume_dir = NULL;
+static Active *active = NULL;
+static pthread_mutex_t resume_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void log_path(uint64_t token, const char *suffix, char *buf, size_t cap) {
+    snprintf(buf, cap, "%s/%016llx%s", resume_dir, (unsigned long long)token, suffix);
+}
+
+// Enregistre token comme actif ; false s'il l'est déjà
+static bool active_add(uint64_t token) {
+    Active *a = malloc(sizeof(*a));
+    if (!a) return false;
+    pthread_mutex_lock(&resume_mutex);
+    for (Active *x = active; x; x = x->next) {
+        if (x->token == token) {
+            pthread_mutex_unlock(&resume_mutex);
+            free(a);
+            return false;
+        }
+    }
+    a->token = token;
+    a->next = active;
+    active = a;
+    pthread_mutex_unlock(&resume_mutex);
+    return true;
+}
+
+static void active_remove(uint64_t token) {
+    pthread_mutex_lock(&resume_mutex);
+    for (Active **pp = &active; *pp; pp = &(*pp)->next) {
+        if ((*pp)->token == token) {
+            Active *a = *pp;
+            *pp = a->next;
+            free(a);
+            break;
+        }
+    }
+    pthread_mutex_unlock(&resume_mutex);
+}
+
+// Supprime les journaux plus vieux que RESUME_TTL_S
+static void sweep(void) {
+    DIR *dir = opendir(resume_dir);
+    if (!dir) return;
+    time_t limit = time(NULL) - RESUME_TTL_S;
+    int kept = 0;
+    struct dirent *de;
+    while ((de = readdir(dir))) {
+        if (de->d_name[0] == '.') continue;
+        char path[512];
+        struct stat st;
+        snprintf(path, sizeof(path), "%s/%s", resume_dir, de->d_name);
+        if (stat(path, &st) < 0 || !S_ISREG(st.st_mode)) continue;
+        if (st.st_mtime < limit) unlink(path);
+        else if (strstr(de->d_name, ".ckpt")) kept++;
+    }
+    closedir(dir);
+    if (kept) log_internal("Reprise : %d tâche(s) suspendue(s) dans %s", kept, resume_dir);
+}
+
+int resume_init(const char *dir) {
+    if (mkdir(dir, 0700) < 0 && errno != EEXIST) return -1;
+    resume_dir = strdup(dir);
+    if (!resume_dir) return -1;
+    sweep();
+    return 0;
+}
+
+bool resume_enabled(void) {
+    return resume_dir != NULL;
+}
+
+static uint64_t random_token(void) {
+    uint64_t token = 0;
+    int fd = open("/dev/urandom", O_RDONLY | O_CLOEXEC);
+    if (fd >= 0) {
+        if (read_n_bytes(fd, &token, sizeof(token)) != sizeof(token)) token = 0;
+        close(fd);
+    }
+    if (token == 0) {
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        token = xxh64(&ts, sizeof(ts), (uint64_t)getpid());
+    }
+    return token;
+}
+
+static ResumeLog *log_new(uint64_t token, const char *pseudo, uint64_t total_size) {
+    ResumeLog *r = calloc(1, sizeof(*r));
+    if (!r) return NULL;
+    r->token = token;
+    r->fd = -1;
+    r->total_size = total_size;
+    r->pseudo = strdup(pseudo);
+    if (!r->pseudo) {
+        free(r);
+        return NULL;
+    }
+    return r;
+}
+
+static void log_release(ResumeLog *r) {
+    if (r->fd >= 0) close(r->fd);
+    active_remove(r->token);
+    free(r->pseudo);
+    free(r);
+}
+
+ResumeLog *resume_create(const char *pseudo, uint64_t total_size) {
+    if (!resume_dir) return NULL;
+    uint64_t token = random_token();
+    if (!active_add(token)) return NULL;
+    ResumeLog *r = log_new(token, pseudo, total_size);
+    if (!r) {
+        active_remove(token);
+        return NULL;
+    }
+    char path[512];
+    log_path(token, ".out", path, sizeof(path));
+    r->fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (r->fd < 0) {
+        log_release(r);
+        return NULL;
+    }
+    return r;
+}
+
+// Relit <jeton>.ckpt : utilisateur, taille d'entrée, point de reprise
+static int read_ckpt(uint64_t token, char *pseudo, size_t cap, uint64_t *total,
+                     uint64_t *in, uint64_t *out) {
+    char path[512], line[256];
+    log_path(token, ".ckpt", path, sizeof(path));
+    FILE *f = fopen(path, "r");
+    if (!f) return -1;
+    int rc = -1;
+    unsigned long long t, i, o;
+    if (fgets(line, sizeof(line), f) && strncmp(line, CKPT_MAGIC, strlen(CKPT_MAGIC)) == 0 &&
+        fgets(pseudo, (int)cap, f) && fgets(line, sizeof(line), f) &&
+        sscanf(line, "%llu %llu %llu", &t, &i, &o) == 3) {
+        pseudo[strcspn(pseudo, "\n")] = '\0';
+        *total = t;
+        *in = i;
+        *out = o;
+        rc = 0;
+    }
+    fclose(f);
+    return rc;
+}
+
+ResumeLog *resume_open(uint64_t token, const char *pseudo, uint64_t total_size, uint64_t have) {
+    if (!resume_dir) return NULL;
+    char owner[256];
+    uint64_t total, in, out;
+    if (read_ckpt(token, owner, sizeof(owner), &total, &in, &out) < 0) return NULL;
+    if (strcmp(owner, pseudo) != 0 || total != total_size || in > total) return NULL;
+    if (!active_add(token)) return NULL;
+    ResumeLog *r = log_new(token, pseudo, total_size);
+    if (!r) {
+        active_remove(token);
+        return NULL;
+    }
+    char path[512];
+    struct stat st;
+    log_path(token, ".out", path, sizeof(path));
+    r->fd = open(path, O_RDWR | O_CLOEXEC);
+    // Ce qui suit le point de reprise (trame inachevée) est jeté
+    if (r->fd < 0 || fstat(r->fd, &st) < 0 || (uint64_t)st.st_size < out ||
+        ftruncate(r->fd, (off_t)out) < 0 || lseek(r->fd, (off_t)out, SEEK_SET) < 0) {
+        log_release(r);
+        return NULL;
+    }
+    r->out_len = r->out_ckpt = out;
+    r->in_ckpt = in;
+    r->replay_from = have < out ? have : out;
+    r->replay_to = out;
+    return r;
+}
+
+void resume_write(ResumeLog *r, const void *data, size_t len) {
+    if (r->failed) return;
+    if (write_n_bytes(r->fd, data, len) < 0) {
+        log_msg(LOG_WARN, 0, "resume log %016llx: write failed (%s)",
+                (unsigned long long)r->token, strerror(errno));
+        r->failed = true;
+        return;
+    }
+    r->out_len += len;
+}
+
+void resume_checkpoint(ResumeLog *r, uint64_t in_off) {
+    if (r->failed) return;
+    char path[512], tmp[520];
+    log_path(r->token, ".ckpt", path, sizeof(path));
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    // La sortie d'abord sur disque : un point de reprise ne désigne jamais
+    // des octets perdus
+    FILE *f = fdatasync(r->fd) == 0 ? fopen(tmp, "w") : NULL;
+    if (!f) {
+        r->failed = true;
+        return;
+    }
+    fprintf(f, CKPT_MAGIC "\n%s\n%llu %llu %llu\n", r->pseudo, (unsigned long long)r->total_size,
+            (unsigned long long)in_off, (unsigned long long)r->out_len);
+    if (fflush(f) != 0 || fsync(fileno(f)) < 0 || fclose(f) != 0 || rename(tmp, path) < 0) {
+        unlink(tmp);
+        r->failed = true;
+        return;
+    }
+    r->in_ckpt = in_off;
+    r->out_ckpt = r->out_len;
+}
+
+void resume_free(void *arg) {
+    ResumeLog *r = arg;
+    if (!r) return;
+    if (!r->suspended) {
+        char path[512];
+        log_path(r->token, ".out", path, sizeof(path));
+        unlink(path);
+        log_path(r->token, ".ckpt", path, sizeof(path));
+        unlink(path);
+    }
+    log_release(r);
+}
@@ -0,0 +1,58 @@
+#ifndef RESUME_H
+#define RESUME_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Reprise des grosses tâches de compression après une coupure. Une tâche
+// reprenable recopie sa sortie dans <dossier>/<jeton>.out et, toutes les
+// RESUME_CHECKPOINT octets d'entrée, clôt sa trame Zstd : la sortie jusque-là
+// est une suite de trames complètes qui couvre exactement les in_ckpt
+// premiers octets. Ce point de reprise (<jeton>.ckpt) est écrit après
+// fdatasync de la sortie ; il survit à un redémarrage du serveur. Connexion
+// perdue : la trame en cours est close sur tout ce qui a été reçu, ce qui
+// donne un dernier point de reprise. Le client qui revient avec le jeton
+// n'envoie que la suite, le serveur lui renvoie d'abord la sortie manquante.
+#define RESUME_DEFAULT_DIR "resume"
+#define RESUME_MIN_SIZE (16L * 1024 * 1024)      // tâches reprenables
+#define RESUME_CHECKPOINT (16L * 1024 * 1024)    // entrée entre deux points
+#define RESUME_TTL_S (24 * 3600)                 // points de reprise abandonnés
+
+typedef struct {
+    uint64_t token;
+    int fd;                     // sortie produite (copie côté serveur)
+    uint64_t out_len;           // octets écrits dans fd
+    uint64_t in_ckpt;           // entrée couverte par le dernier point de reprise
+    uint64_t out_ckpt;          // sortie correspondante (trames complètes)
+    uint64_t replay_from;       // sortie à renvoyer depuis fd avant de continuer :
+    uint64_t replay_to;         // [replay_from, replay_to)
+    uint64_t total_size;
+    char *pseudo;
+    bool failed;                // écriture impossible : plus de nouveau point
+    bool suspended;             // connexion perdue : fichiers gardés
+} ResumeLog;
+
+// Crée dir au besoin et supprime les points de reprise expirés.
+int resume_init(const char *dir);
+bool resume_enabled(void);
+
+// Nouveau journal de reprise (jeton aléatoire) ; NULL si impossible.
+ResumeLog *resume_create(const char *pseudo, uint64_t total_size);
+
+// Reprend le journal token pour pseudo, le client détenant déjà have octets
+// de sortie. NULL si inconnu, expiré, d'un autre utilisateur, d'une autre
+// taille ou encore utilisé par une tâche active.
+ResumeLog *resume_open(uint64_t token, const char *pseudo, uint64_t total_size, uint64_t have);
+
+// Copie de sortie ; une erreur désactive les points suivants.
+void resume_write(ResumeLog *r, const void *data, size_t len);
+
+// Trame close : la sortie écrite couvre les in_off premiers octets d'entrée.
+void resume_checkpoint(ResumeLog *r, uint64_t in_off);
+
+// Libère le journal (signature de NetTask.resume_free). Les fichiers ne sont
+// gardés que si la tâche a été suspendue (r->suspended).
+void resume_free(void *r);
+
+#endif // RESUME_H
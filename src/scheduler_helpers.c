@@ -1,18 +1,33 @@
 #include "scheduler_helpers.h"
-#include "utils.h"
 #include "log.h"
+#include "transcoder.h"
+#include "protocol.h"
+#include "netio.h"
+#include "mempool.h"
+#include "metrics.h"
+#include "levelctl.h"
+#include "dictstore.h"
+#include "resultcache.h"
+#include "resume.h"
+#include <pthread.h>
 #include <zstd.h>
 #include <unistd.h>
-#include <sys/types.h>
-#include <sys/wait.h>
-#include <fcntl.h>
 #include <string.h>
 #include <stdlib.h>
-#include <sys/stat.h>
-#include <errno.h>
 #include <ctype.h>
 
 #define LOGFILE "/tmp/scheduler_network.log"
+// Données exigées avant de lancer un quantum : au plus une demi-fenêtre,
+// que le client peut toujours envoyer sans attendre de FRAME_WINDOW
+#define TASK_READY_MAX (PROTO_INITIAL_WINDOW / 2)
+// Un FRAME_PROGRESS au plus tous les PROGRESS_STEP octets traités
+#define PROGRESS_STEP (256 * 1024)
+// La fenêtre d'envoi est rouverte par pas de WINDOW_STEP octets consommés
+#define WINDOW_STEP (PROTO_INITIAL_WINDOW / 4)
+// Format Zstd seekable : trame sautable finale portant la table de saut
+#define SEEKABLE_SKIPPABLE_MAGIC 0x184D2A5E
+#define SEEKABLE_FOOTER_MAGIC 0x8F92EAB1
+#define SEEKABLE_FOOTER_SIZE 9
 
 bool is_media_file(const char *path) {
     const char *dot = strrchr(path, '.');
@@ -30,113 +45,749 @@ bool is_media_file(const char *path) {
     return false;
 }
 
-void handle_streaming_compress_partial(NetTask *t, size_t quantum_size) {
-    int fd = t->client_fd;
-    bool media = is_media_file(t->meta);
-
-    void *inbuf = malloc(quantum_size);
-    if (!inbuf) return;
-    ssize_t r = read_n_bytes(fd, inbuf, quantum_size);
-    if (r <= 0) {
-        free(inbuf);
-        t->processed_bytes = t->total_size;
-        return;
+// Le dernier quantum ne lit que ce qui reste : sinon on attendrait des
+// octets que le client n'enverra jamais.
+static size_t quantum_len(const NetTask *t, size_t quantum_size) {
+    long rem = t->total_size - t->processed_bytes;
+    if (rem < 0) rem = 0;
+    return (size_t)rem < quantum_size ? (size_t)rem : quantum_size;
+}
+
+// Résultat incomplet (entrée tronquée, ffmpeg disparu) : rien à garder
+static void task_cache_drop(NetTask *t) {
+    rcache_abort(t->cache);
+    t->cache = NULL;
+}
+
+// Envoie la sortie de la tâche au client en trames DATA, copiée au passage
+// dans le cache de résultats si la tâche est empreintée et dans son journal
+// si elle est reprenable.
+static void task_emit(NetTask *t, const void *data, size_t len) {
+    if (t->cache) rcache_write(t->cache, data, len);
+    if (t->resume) resume_write(t->resume, data, len);
+    const char *p = data;
+    while (len > 0) {
+        uint32_t n = len > PROTO_DATA_CHUNK ? PROTO_DATA_CHUNK : (uint32_t)len;
+        if (netio_send_frame(t->conn, FRAME_DATA, t->stream_id, p, n) < 0) return;
+        t->bytes_out += n;
+        p += n;
+        len -= n;
+    }
+}
+
+static void task_sink_write(void *ctx, const void *data, size_t len) {
+    metrics_add(M_MEDIA_BYTES_OUT, len);
+    task_emit(ctx, data, len);
+}
+
+// Sortie de ffmpeg passée du tube au socket sans copie
+static int task_sink_splice(void *ctx, int fd, size_t len) {
+    NetTask *t = ctx;
+    metrics_add(M_MEDIA_BYTES_OUT, len);
+    while (len > 0) {
+        uint32_t n = len > PROTO_DATA_CHUNK ? PROTO_DATA_CHUNK : (uint32_t)len;
+        if (netio_send_frame_from_fd(t->conn, FRAME_DATA, t->stream_id, fd, n) < 0) return -1;
+        t->bytes_out += n;
+        len -= n;
+    }
+    return 0;
+}
+
+static void task_progress(NetTask *t, bool force) {
+    if (!force && t->processed_bytes - t->progress_sent < PROGRESS_STEP) return;
+    uint8_t p[16];
+    put_u64(p, (uint64_t)t->processed_bytes);
+    put_u64(p + 8, (uint64_t)t->total_size);
+    netio_send_frame(t->conn, FRAME_PROGRESS, t->stream_id, p, sizeof(p));
+    t->progress_sent = t->processed_bytes;
+}
+
+// Rend au client la place libérée dans le tampon d'entrée
+static void task_window(NetTask *t, size_t consumed) {
+    t->window_unacked += consumed;
+    if (t->window_unacked < WINDOW_STEP) return;
+    uint8_t p[4];
+    put_u32(p, (uint32_t)t->window_unacked);
+    netio_send_frame(t->conn, FRAME_WINDOW, t->stream_id, p, sizeof(p));
+    t->window_unacked = 0;
+}
+
+// Envoie n octets du fichier fd (à partir de off) en trames DATA par
+// sendfile(). Retourne -1 si la connexion est coupée.
+static int task_send_file(NetTask *t, int fd, uint64_t off, uint64_t n) {
+    while (n > 0) {
+        uint32_t chunk = n > PROTO_DATA_CHUNK ? PROTO_DATA_CHUNK : (uint32_t)n;
+        if (netio_send_frame_from_file(t->conn, FRAME_DATA, t->stream_id, fd, (off_t)off, chunk) < 0) return -1;
+        t->bytes_out += chunk;
+        off += chunk;
+        n -= chunk;
     }
+    return 0;
+}
+
+// Connexion perdue : la sortie écrite jusqu'ici est faite de trames complètes
+// et couvre tout ce qui a été traité, c'est le dernier point de reprise. La
+// tâche s'arrête sans FRAME_END, son journal est gardé.
+static void task_suspend(NetTask *t) {
+    ResumeLog *r = t->resume;
+    task_cache_drop(t);
+    resume_checkpoint(r, (uint64_t)t->processed_bytes);
+    r->suspended = true;
+    t->processed_bytes = t->total_size;
+    metrics_inc(M_TASKS_SUSPENDED);
+    log_msg(LOG_INFO, t->task_id, "suspended at %llu/%ld (resume token %016llx)",
+            (unsigned long long)r->in_ckpt, t->total_size, (unsigned long long)r->token);
+}
+
+static void task_finish(NetTask *t) {
+    // Une sortie liée à un dictionnaire n'est pas resservie : le client
+    // devrait encore posséder ce dictionnaire
+    if (t->cache && t->dict_id == 0) {
+        rcache_commit(t->cache);
+        t->cache = NULL;
+    }
+    task_cache_drop(t);
+    task_progress(t, true);
+    uint8_t p[12];
+    put_u64(p, (uint64_t)t->bytes_out);
+    put_u32(p + 8, t->dict_id);
+    // Fin perdue avec la connexion : le client pourra encore récupérer la
+    // sortie complète par une reprise
+    if (netio_send_frame(t->conn, FRAME_END, t->stream_id, p, t->dict_id ? 12 : 8) < 0 && t->resume) {
+        task_suspend(t);
+    }
+}
+
+void task_abort(NetTask *t, const char *reason) {
+    if (!t->conn) return;
+    netio_send_frame(t->conn, FRAME_ERROR, t->stream_id, reason, (uint32_t)strlen(reason));
+}
+
+// Sortie déjà envoyée inutilisable : la tâche se termine sur une erreur et
+// non sur FRAME_END, sans rien laisser dans le cache.
+static void task_failed(NetTask *t, const char *reason) {
+    task_cache_drop(t);
+    task_abort(t, reason);
+    metrics_inc(M_TASKS_ABORTED);
+    t->processed_bytes = t->total_size;
+}
+
+// Entrée close avant la taille annoncée : trame Zstd non close, taille
+// promise non atteinte
+static void task_truncated(NetTask *t) {
+    log_msg(LOG_WARN, t->task_id, "input ended early (%ld/%ld)", t->processed_bytes, t->total_size);
+    task_failed(t, "Entrée interrompue avant la taille annoncée");
+}
+
+// Flux Zstd d'une tâche : un seul contexte et une seule trame pour toute la
+// tâche, le matcher garde la fenêtre complète d'un quantum à l'autre.
+typedef struct {
+    ZSTD_CCtx *cctx;
+    ZstdDict *dict;             // petite tâche : dictionnaire de son type
+    void *out;
+    size_t out_cap;
+} ZstdStream;
+
+static Slab zstd_stream_slab = SLAB_INITIALIZER("zstd-stream", sizeof(ZstdStream), 64);
 
-    if (media) {
-        // Processus ffmpeg simple par quantum
-        int pin[2], pout[2];
-        if (pipe(pin)<0||pipe(pout)<0) { free(inbuf); return; }
-        pid_t pid = fork();
-        if (pid < 0) { free(inbuf); close(pin[0]);close(pin[1]);close(pout[0]);close(pout[1]); return; }
-        if (pid == 0) {
-            dup2(pin[0], 0); dup2(pout[1], 1);
-            close(pin[1]); close(pout[0]);
-            execlp("ffmpeg","ffmpeg","-hide_banner","-loglevel","error",
-                   "-i","pipe:0","-f","mp3","-b:a","192k","pipe:1",(char*)NULL);
-            _exit(1);
+// Contextes Zstd rendus par les tâches terminées : les tables du matcher
+// (plusieurs Mio) sont réutilisées au lieu d'être réallouées à chaque tâche
+#define CCTX_CACHE_MAX 16
+static ZSTD_CCtx *cctx_cache[CCTX_CACHE_MAX];
+static int cctx_cached = 0;
+static pthread_mutex_t cctx_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static ZSTD_CCtx *cctx_acquire(void) {
+    ZSTD_CCtx *cctx = NULL;
+    pthread_mutex_lock(&cctx_mutex);
+    if (cctx_cached > 0) cctx = cctx_cache[--cctx_cached];
+    pthread_mutex_unlock(&cctx_mutex);
+    return cctx ? cctx : ZSTD_createCCtx();
+}
+
+static void cctx_release(ZSTD_CCtx *cctx) {
+    if (!cctx) return;
+    ZSTD_CCtx_reset(cctx, ZSTD_reset_session_and_parameters);
+    pthread_mutex_lock(&cctx_mutex);
+    if (cctx_cached < CCTX_CACHE_MAX) {
+        cctx_cache[cctx_cached++] = cctx;
+        cctx = NULL;
+    }
+    pthread_mutex_unlock(&cctx_mutex);
+    ZSTD_freeCCtx(cctx);
+}
+
+static void zstd_stream_free(void *codec) {
+    ZstdStream *zs = codec;
+    cctx_release(zs->cctx);
+    dictstore_release(zs->dict);
+    bufpool_put(zs->out, zs->out_cap);
+    slab_free(&zstd_stream_slab, zs);
+}
+
+static ZstdStream *zstd_stream_get(NetTask *t) {
+    if (t->codec) return t->codec;
+    ZstdStream *zs = slab_alloc(&zstd_stream_slab);
+    if (!zs) return NULL;
+    zs->cctx = cctx_acquire();
+    zs->dict = NULL;
+    zs->out_cap = ZSTD_CStreamOutSize();
+    zs->out = bufpool_get(zs->out_cap);
+    if (!zs->cctx || !zs->out) {
+        zstd_stream_free(zs);
+        return NULL;
+    }
+    // Petite tâche : le dictionnaire de son type, déjà digéré ; la trame
+    // prend alors le niveau du CDict
+    if (t->total_size <= DICT_SMALL_TASK && (zs->dict = dictstore_acquire(t->meta))) {
+        ZSTD_CCtx_refCDict(zs->cctx, zs->dict->cdict);
+        t->dict_id = zs->dict->id;
+        t->level = DICT_LEVEL;
+    } else {
+        // Niveau fixé pour toute la trame : hors mode multithread, Zstd ne
+        // le change pas en cours de trame
+        t->level = levelctl_level();
+        ZSTD_CCtx_setParameter(zs->cctx, ZSTD_c_compressionLevel, t->level);
+    }
+    // Une tâche reprenable clôt ses trames aux points de reprise, sans
+    // savoir d'avance où : taille de trame inconnue
+    if (!t->resume) ZSTD_CCtx_setPledgedSrcSize(zs->cctx, (unsigned long long)t->total_size);
+    t->codec = zs;
+    t->codec_free = zstd_stream_free;
+    return zs;
+}
+
+// Pousse len octets dans la trame de la tâche ; last clôt la trame.
+// Retourne -1 si la trame est perdue (mémoire, erreur Zstd).
+static int zstd_stream_feed(NetTask *t, const void *data, size_t len, bool last) {
+    ZstdStream *zs = zstd_stream_get(t);
+    if (!zs) {
+        log_msg(LOG_ERROR, t->task_id, "zstd stream unavailable");
+        return -1;
+    }
+    // Le début des petites tâches nourrit l'entraînement des dictionnaires
+    if (t->processed_bytes == 0 && t->total_size <= DICT_SMALL_TASK) dictstore_sample(t->meta, data, len);
+    metrics_add(M_ZSTD_BYTES_IN, len);
+    uint64_t start = metrics_now_us();
+    ZSTD_inBuffer in = { data, len, 0 };
+    ZSTD_EndDirective mode = last ? ZSTD_e_end : ZSTD_e_continue;
+    for (;;) {
+        ZSTD_outBuffer out = { zs->out, zs->out_cap, 0 };
+        size_t rem = ZSTD_compressStream2(zs->cctx, &out, &in, mode);
+        if (ZSTD_isError(rem)) {
+            log_msg(LOG_ERROR, t->task_id, "zstd error %s", ZSTD_getErrorName(rem));
+            return -1;
         }
-        close(pin[0]); close(pout[1]);
-        write_n_bytes(pin[1], inbuf, r);
-        close(pin[1]);
-        char buf[32768];
-        ssize_t w;
-        while ((w=read(pout[0], buf, sizeof(buf)))>0) {
-            write_n_bytes(fd, buf, w);
+        if (out.pos) {
+            metrics_add(M_ZSTD_BYTES_OUT, out.pos);
+            task_emit(t, zs->out, out.pos);
         }
-        close(pout[0]);
-        waitpid(pid, NULL, 0);
-    }
-    else {
-        ZSTD_CCtx *cctx = ZSTD_createCCtx();
-        ZSTD_CCtx_setParameter(cctx, ZSTD_c_compressionLevel, 9);
-        ZSTD_CCtx_setParameter(cctx, ZSTD_c_nbWorkers, 1);
-        size_t bound = ZSTD_compressBound(r);
-        void *out = malloc(bound);
-        size_t csize = ZSTD_compressCCtx(cctx, out, bound, inbuf, r, 9);
-        if (!ZSTD_isError(csize)) {
-            write_n_bytes(fd, out, csize);
+        // continue : tout l'input consommé ; end : trame entièrement vidée
+        if (last ? rem == 0 : in.pos == in.size) break;
+    }
+    levelctl_observe_codec(t->level, len, metrics_now_us() - start);
+    return 0;
+}
+
+// Mode parallèle. Le worker qui détient la tâche (sortie de file) remplit le
+// bloc courant ; un bloc plein est numéroté, la tâche rendue à la file, puis
+// le bloc compressé hors verrou. Les blocs terminés attendent dans l'anneau
+// que leurs prédécesseurs soient émis. Au plus share blocs entre distribution
+// et émission : au-delà, la tâche est « garée » hors file et le worker qui
+// émet un bloc la remet en file.
+typedef struct {
+    void *data;                 // trame compressée, NULL tant que pas prête
+    size_t cap;                 // taille demandée à bufpool_get
+    size_t len;
+    size_t src_len;
+} ParallelSlot;
+
+typedef struct {
+    pthread_mutex_t lock;
+    char *fill;                 // bloc en remplissage (détenteur de la tâche seul)
+    size_t fill_len;
+    uint32_t next_block;        // prochain numéro distribué
+    uint32_t next_emit;         // prochain numéro à émettre
+    int compressing;            // blocs en cours de compression
+    bool all_claimed;           // toute l'entrée est distribuée
+    bool parked;                // hors file, en attente d'une émission (atomique)
+    bool abandoned;             // retirée (kick) ou bloc perdu : plus rien n'est émis
+    bool finished;
+    ParallelSlot ring[PARALLEL_MAX_SHARE];
+    uint8_t *seek;              // entrées de la table de saut (8 o par trame)
+    size_t seek_len, seek_cap;
+} ParallelState;
+
+typedef struct {
+    uint32_t index;
+    char *src;
+    size_t len;
+} ParallelBlock;
+
+static void parallel_free(void *codec) {
+    ParallelState *ps = codec;
+    for (int i = 0; i < PARALLEL_MAX_SHARE; i++) bufpool_put(ps->ring[i].data, ps->ring[i].cap);
+    bufpool_put(ps->fill, PARALLEL_BLOCK_SIZE);
+    free(ps->seek);
+    pthread_mutex_destroy(&ps->lock);
+    free(ps);
+}
+
+static ParallelState *parallel_get(NetTask *t) {
+    if (t->codec) return t->codec;
+    ParallelState *ps = calloc(1, sizeof(*ps));
+    if (!ps) return NULL;
+    pthread_mutex_init(&ps->lock, NULL);
+    t->codec = ps;
+    t->codec_free = parallel_free;
+    return ps;
+}
+
+static void put_le32(uint8_t *p, uint32_t v) {
+    p[0] = v; p[1] = v >> 8; p[2] = v >> 16; p[3] = v >> 24;
+}
+
+// Table de saut : trame sautable (magique, taille) + entrées + pied
+static void parallel_emit_seek_table(NetTask *t, ParallelState *ps) {
+    uint32_t frames = ps->next_emit;
+    size_t body = ps->seek_len + SEEKABLE_FOOTER_SIZE;
+    uint8_t *p = malloc(8 + body);
+    if (!p) return;
+    put_le32(p, SEEKABLE_SKIPPABLE_MAGIC);
+    put_le32(p + 4, (uint32_t)body);
+    if (ps->seek_len) memcpy(p + 8, ps->seek, ps->seek_len);
+    uint8_t *f = p + 8 + ps->seek_len;
+    put_le32(f, frames);
+    f[4] = 0;                   // descripteur : pas de sommes de contrôle
+    put_le32(f + 5, SEEKABLE_FOOTER_MAGIC);
+    metrics_add(M_ZSTD_BYTES_OUT, 8 + body);
+    task_emit(t, p, 8 + body);
+    free(p);
+}
+
+// Émet les blocs prêts dans l'ordre (verrou tenu). Retourne true si la tâche
+// vient de se terminer.
+static bool parallel_drain(NetTask *t, ParallelState *ps) {
+    for (;;) {
+        ParallelSlot *s = &ps->ring[ps->next_emit % PARALLEL_MAX_SHARE];
+        if (!s->data) break;
+        if (!ps->abandoned) {
+            if (ps->seek_len + 8 > ps->seek_cap) {
+                size_t cap = ps->seek_cap ? ps->seek_cap * 2 : 256;
+                uint8_t *n = realloc(ps->seek, cap);
+                if (n) {
+                    ps->seek = n;
+                    ps->seek_cap = cap;
+                }
+            }
+            if (ps->seek_len + 8 <= ps->seek_cap) {
+                put_le32(ps->seek + ps->seek_len, (uint32_t)s->len);
+                put_le32(ps->seek + ps->seek_len + 4, (uint32_t)s->src_len);
+                ps->seek_len += 8;
+            }
+            metrics_add(M_ZSTD_BYTES_OUT, s->len);
+            task_emit(t, s->data, s->len);
         }
-        ZSTD_freeCCtx(cctx);
-        free(out);
+        bufpool_put(s->data, s->cap);
+        s->data = NULL;
+        ps->next_emit++;
     }
+    // Tant que toute l'entrée n'est pas distribuée, la tâche a un détenteur
+    // (ou une file) : c'est lui qui la termine
+    if (ps->finished || ps->compressing > 0 || !ps->all_claimed) return false;
+    if (ps->abandoned) {
+        ps->finished = true;
+        return true;
+    }
+    if (!ps->all_claimed || ps->next_emit != ps->next_block) return false;
+    ps->finished = true;
+    parallel_emit_seek_table(t, ps);
+    task_finish(t);
+    return true;
+}
 
-    free(inbuf);
+bool parallel_compress_abandon(NetTask *t) {
+    ParallelState *ps = t->codec;
+    if (!ps) return true;
+    pthread_mutex_lock(&ps->lock);
+    ps->abandoned = true;
+    ps->all_claimed = true;
+    bool now = ps->compressing == 0;
+    if (now) ps->finished = true;
+    pthread_mutex_unlock(&ps->lock);
+    return now;
+}
+
+// Remplit le bloc courant avec ce qui est déjà reçu, sans attendre : le
+// worker ne sort la tâche qu'une fois ses données là (task_input_want)
+static size_t parallel_fill(NetTask *t, ParallelState *ps) {
+    size_t want = quantum_len(t, PARALLEL_BLOCK_SIZE - ps->fill_len);
+    if (want == 0) return 0;
+    if (!ps->fill && !(ps->fill = bufpool_get(PARALLEL_BLOCK_SIZE))) return 0;
+    size_t r = taskbuf_read(t->input, ps->fill + ps->fill_len, want, 0);
+    ps->fill_len += r;
     t->processed_bytes += r;
-    log_internal("Task %d: processed %zd/%ld", t->task_id, r, t->total_size);
+    metrics_add(M_ZSTD_BYTES_IN, r);
+    return r;
 }
 
-void handle_streaming_convert_partial(NetTask *t, size_t quantum_size) {
-    static pid_t pid = -1;
-    static int wfd = -1, rfd = -1;
-    static bool init = false;
-    int fd = t->client_fd;
-
-    if (!init) {
-        int pin[2], pout[2];
-        if (pipe(pin)<0||pipe(pout)<0) return;
-        pid = fork();
-        if (pid<0) return;
-        if (pid==0) {
-            dup2(pin[0], 0); dup2(pout[1], 1);
-            close(pin[1]); close(pout[0]);
-            execlp("ffmpeg","ffmpeg","-hide_banner","-loglevel","error",
-                   "-i","pipe:0","-f","mp3","-b:a","192k","pipe:1",(char*)NULL);
-            _exit(1);
+bool parallel_compress_unpark(NetTask *t) {
+    ParallelState *ps = t->codec;
+    return ps && __atomic_exchange_n(&ps->parked, false, __ATOMIC_ACQ_REL);
+}
+
+bool handle_parallel_compress_partial(NetTask *t, int share,
+                                      void (*requeue)(NetTask *t, void *ctx),
+                                      void (*park)(NetTask *t, bool parked, void *ctx),
+                                      void *ctx) {
+    if (share < 1) share = 1;
+    if (share > PARALLEL_MAX_SHARE) share = PARALLEL_MAX_SHARE;
+    ParallelState *ps = parallel_get(t);
+    if (!ps) {
+        task_abort(t, "Mémoire insuffisante");
+        return true;
+    }
+
+    // 1) Détenteur de la tâche : remplissage, fenêtre et progression
+    size_t r = parallel_fill(t, ps);
+    bool input_end = t->processed_bytes >= t->total_size || taskbuf_drained(t->input);
+    task_window(t, r);
+    task_progress(t, false);
+    log_msg(LOG_DEBUG, t->task_id, "block fill %zu/%d", ps->fill_len, PARALLEL_BLOCK_SIZE);
+
+    // 2) Distribution d'un bloc et sort de la tâche. Le cache n'est touché que
+    // verrou tenu : un autre worker peut être en train d'y émettre un bloc.
+    ParallelBlock blk = { 0, NULL, 0 };
+    bool requeue_now = false, done = false;
+    pthread_mutex_lock(&ps->lock);
+    if (t->cache && r) rcache_input(t->cache, ps->fill + ps->fill_len - r, r);
+    if (input_end && t->processed_bytes < t->total_size && !ps->abandoned) {
+        // Les blocs encore en compression ne seront pas émis
+        task_truncated(t);
+        ps->abandoned = true;
+    }
+    // Abandonnée par un bloc perdu : le détenteur ne distribue plus rien et
+    // la termine (ou le dernier bloc en cours)
+    if (ps->abandoned) ps->all_claimed = true;
+    if (!ps->abandoned && (ps->fill_len == PARALLEL_BLOCK_SIZE || (input_end && ps->fill_len > 0))) {
+        blk.index = ps->next_block++;
+        blk.src = ps->fill;
+        blk.len = ps->fill_len;
+        ps->fill = NULL;
+        ps->fill_len = 0;
+        ps->compressing++;
+    }
+    if (input_end) ps->all_claimed = true;
+    if (!ps->all_claimed) {
+        if ((int)(ps->next_block - ps->next_emit) >= share) {
+            // Inscrite au registre avant qu'un bloc émis puisse la réveiller
+            __atomic_store_n(&ps->parked, true, __ATOMIC_RELEASE);
+            park(t, true, ctx);
+        } else {
+            requeue_now = true;
+        }
+    } else if (!blk.src) {
+        done = parallel_drain(t, ps);
+    }
+    pthread_mutex_unlock(&ps->lock);
+    if (requeue_now) requeue(t, ctx);
+    if (!blk.src) return done;
+
+    // 3) Compression du bloc, hors verrou : une trame autonome
+    uint64_t blk_start = metrics_now_us(), blk_cpu = metrics_thread_cpu_ns();
+    size_t cap = ZSTD_compressBound(blk.len);
+    void *dst = bufpool_get(cap);
+    ZSTD_CCtx *cctx = cctx_acquire();
+    size_t n = 0;
+    if (dst && cctx) {
+        // Chaque bloc est une trame : le niveau suit la charge bloc par bloc
+        int level = levelctl_level();
+        __atomic_store_n(&t->level, level, __ATOMIC_RELAXED);
+        uint64_t start = metrics_now_us();
+        ZSTD_CCtx_setParameter(cctx, ZSTD_c_compressionLevel, level);
+        n = ZSTD_compress2(cctx, dst, cap, blk.src, blk.len);
+        levelctl_observe_codec(level, blk.len, metrics_now_us() - start);
+        if (ZSTD_isError(n)) {
+            log_msg(LOG_ERROR, t->task_id, "zstd error %s", ZSTD_getErrorName(n));
+            n = 0;
+        }
+    }
+    cctx_release(cctx);
+    bufpool_put(blk.src, PARALLEL_BLOCK_SIZE);
+    if (n == 0) {
+        // Bloc perdu : la sortie serait incohérente, on abandonne la tâche
+        bufpool_put(dst, cap);
+        dst = NULL;
+    }
+
+    // 4) Rangement dans l'anneau, émission dans l'ordre, réveil de la tâche.
+    // Le temps du bloc est compté tant que la tâche ne peut pas être libérée.
+    // Seule la fin d'une tâche dont toute l'entrée est distribuée revient à
+    // ce worker : avant, elle a un détenteur, une file ou est garée.
+    pthread_mutex_lock(&ps->lock);
+    __atomic_add_fetch(&t->cpu_ns, metrics_thread_cpu_ns() - blk_cpu, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&t->service_ns, (metrics_now_us() - blk_start) * 1000, __ATOMIC_RELAXED);
+    ps->compressing--;
+    if (!dst && !ps->abandoned) {
+        task_cache_drop(t);
+        task_abort(t, "Erreur de compression");
+        metrics_inc(M_TASKS_ABORTED);
+        ps->abandoned = true;
+    }
+    if (dst) {
+        ParallelSlot *s = &ps->ring[blk.index % PARALLEL_MAX_SHARE];
+        s->data = dst;
+        s->cap = cap;
+        s->len = n;
+        s->src_len = blk.len;
+    }
+    done = parallel_drain(t, ps);
+    // Garée et abandonnée : remise en file pour que son prochain détenteur
+    // la termine. Un kick peut l'avoir déjà reprise (parallel_compress_unpark).
+    bool unpark = !ps->all_claimed &&
+                  (ps->abandoned || (int)(ps->next_block - ps->next_emit) < share) &&
+                  __atomic_exchange_n(&ps->parked, false, __ATOMIC_ACQ_REL);
+    pthread_mutex_unlock(&ps->lock);
+    if (unpark) park(t, false, ctx);
+    return done;
+}
+
+// Un ffmpeg par tâche, attaché à t->codec : les quanta alimentent le même
+// processus, la sortie est un flux mp3 continu. Retourne NULL si ffmpeg
+// ne peut pas être lancé.
+static Transcoder *task_transcoder(NetTask *t) {
+    if (!t->codec) {
+        t->codec = transcoder_acquire();
+        if (!t->codec) {
+            log_msg(LOG_ERROR, t->task_id, "ffmpeg unavailable");
+            return NULL;
         }
-        close(pin[0]); close(pout[1]);
-        wfd=pin[1]; rfd=pout[0];
-        init=true;
-        fcntl(rfd, F_SETFL, fcntl(rfd,F_GETFL,0)|O_NONBLOCK);
+        t->codec_free = transcoder_release;
     }
+    return t->codec;
+}
+
+static void transcode_quantum(NetTask *t, const void *data, size_t len, bool last) {
+    // Sortie copiée dans le cache : elle doit passer par la mémoire
+    TranscoderSink sink = { task_sink_write, t->cache ? NULL : task_sink_splice, t };
+    Transcoder *tc = task_transcoder(t);
+    if (!tc) return;
+    metrics_add(M_MEDIA_BYTES_IN, len);
+    if (len && transcoder_feed(tc, &sink, data, len) < 0) {
+        log_msg(LOG_WARN, t->task_id, "ffmpeg exited early");
+        task_cache_drop(t);
+    }
+    if (last) transcoder_finish(tc, &sink);
+}
+
+// Consomme n octets du tube par copie : empreinte pour le cache, puis ffmpeg
+// si tc (sinon simplement jetés). -1 si ffmpeg les refuse.
+static int pipe_copy(NetTask *t, Transcoder *tc, TranscoderSink *sink, int fd, size_t n) {
+    char buf[16384];
+    int rc = 0;
+    while (n > 0) {
+        ssize_t r = read(fd, buf, n < sizeof(buf) ? n : sizeof(buf));
+        if (r <= 0) break;
+        if (t->cache) rcache_input(t->cache, buf, (size_t)r);
+        if (tc && rc == 0 && transcoder_feed(tc, sink, buf, (size_t)r) < 0) rc = -1;
+        n -= (size_t)r;
+    }
+    return rc;
+}
+
+// Quantum d'un tampon en mode tube : les octets déjà dans le tube passent
+// directement à ffmpeg par splice(), le débordement éventuel par copie.
+// Une tâche dont le résultat ira au cache lit aussi le tube par copie : son
+// entrée doit être empreintée.
+static void transcode_quantum_pipe(NetTask *t, size_t len, bool last) {
+    TranscoderSink sink = { task_sink_write, t->cache ? NULL : task_sink_splice, t };
+    TaskBuf *in = t->input;
+    Transcoder *tc = (len || t->codec) ? task_transcoder(t) : NULL;
+    size_t from_pipe = taskbuf_pipe_pending(in);
+    if (from_pipe > len) from_pipe = len;
+    size_t rest = len - from_pipe;
+    void *spill = rest ? bufpool_get(rest) : NULL;
+    if (rest && !spill) return;
 
-    void *inbuf = malloc(quantum_size);
-    if (!inbuf) return;
-    ssize_t r = read_n_bytes(fd, inbuf, quantum_size);
-    if (r <= 0) {
-        free(inbuf);
+    bool ok = tc != NULL;
+    bool copy = t->cache != NULL;
+    if (ok) metrics_add(M_MEDIA_BYTES_IN, len);
+    if (ok && from_pipe && !copy && transcoder_feed_fd(tc, &sink, in->pipe_r, from_pipe) < 0) ok = false;
+    // Sans ffmpeg, les octets du tube doivent quand même être consommés
+    if (from_pipe && (copy || !ok) && pipe_copy(t, ok ? tc : NULL, &sink, in->pipe_r, from_pipe) < 0) {
+        ok = false;
+    }
+    // Toujours appelé : c'est aussi là que le débordement est résorbé
+    size_t got = taskbuf_read(in, spill, rest, 0);
+    if (t->cache && got) rcache_input(t->cache, spill, got);
+    if (ok && got && transcoder_feed(tc, &sink, spill, got) < 0) ok = false;
+    bufpool_put(spill, rest);
+    if (tc && !ok) {
+        log_msg(LOG_WARN, t->task_id, "ffmpeg exited early");
+        task_cache_drop(t);
+    }
+    if (tc && last) transcoder_finish(tc, &sink);
+}
+
+// Point de reprise : la trame en cours est close et son contexte rendu, la
+// suivante repartira au niveau courant du régulateur. -1 si la trame n'a pas
+// pu être close : pas de point de reprise.
+static int task_checkpoint(NetTask *t) {
+    if (zstd_stream_feed(t, NULL, 0, true) < 0) return -1;
+    t->codec_free(t->codec);
+    t->codec = NULL;
+    resume_checkpoint(t->resume, (uint64_t)t->processed_bytes);
+    log_msg(LOG_DEBUG, t->task_id, "checkpoint at %ld", t->processed_bytes);
+    return 0;
+}
+
+// Reprise : la sortie que le client n'a pas reçue repart d'abord, depuis le
+// journal, au rythme d'une tâche en cache
+static void task_replay(NetTask *t, size_t quantum_size) {
+    ResumeLog *r = t->resume;
+    uint64_t n = r->replay_to - r->replay_from;
+    if (n > (uint64_t)quantum_size * RCACHE_QUANTUM_FACTOR) n = (uint64_t)quantum_size * RCACHE_QUANTUM_FACTOR;
+    if (task_send_file(t, r->fd, r->replay_from, n) < 0) {
+        r->suspended = true;
         t->processed_bytes = t->total_size;
-        close(wfd);
         return;
     }
-    write_n_bytes(wfd, inbuf, r);
-    free(inbuf);
+    r->replay_from += n;
+    // Coupure après la dernière trame : il ne restait que la sortie
+    if (r->replay_from == r->replay_to && t->processed_bytes >= t->total_size) task_finish(t);
+}
 
-    char buf[16384];
-    ssize_t w;
-    while ((w = read(rfd, buf, sizeof(buf))) > 0) {
-        write_n_bytes(fd, buf, w);
+// Un quantum : lit au plus quantum_size octets reçus et les passe au codec.
+// Jamais d'attente : sans donnée disponible, le quantum est rendu sans rien
+// faire (le worker garde normalement la tâche hors file jusque-là).
+static void stream_quantum(NetTask *t, size_t quantum_size, bool media, const char *what) {
+    size_t want = quantum_len(t, quantum_size);
+    bool piped = media && taskbuf_is_pipe(t->input);
+    void *inbuf = NULL;
+    size_t r;
+    if (piped) {
+        r = want ? taskbuf_pipe_ready(t->input, want, 0) : 0;
+    } else {
+        inbuf = bufpool_get(want ? want : 1);
+        if (!inbuf) return;
+        r = want ? taskbuf_read(t->input, inbuf, want, 0) : 0;
+    }
+    if (want && r == 0 && !taskbuf_drained(t->input)) {
+        bufpool_put(inbuf, want ? want : 1);
+        return;
+    }
+    if (t->cache && !piped && r) rcache_input(t->cache, inbuf, r);
+    // Dernier quantum (ou plus rien à lire : reprise, coupure)
+    bool last = r == 0 || t->processed_bytes + (long)r >= t->total_size;
+    bool suspend = r == 0 && want && t->resume && t->input->lost;
+    if (r == 0 && want && !suspend) {
+        bufpool_put(inbuf, want ? want : 1);
+        task_truncated(t);
+        return;
     }
 
-    t->processed_bytes += r;
-    log_internal("Task %d: converted %zd/%ld", t->task_id, r, t->total_size);
+    if (piped) {
+        transcode_quantum_pipe(t, r, last);
+    } else if (media) {
+        if (r || t->codec) transcode_quantum(t, inbuf, r, last);
+    } else if (r || t->codec || !t->resume) {
+        // Juste après un point de reprise, pas de trame vide à clore
+        if (zstd_stream_feed(t, inbuf, r, last) < 0) {
+            bufpool_put(inbuf, want ? want : 1);
+            task_failed(t, "Erreur de compression");
+            return;
+        }
+    }
+    bufpool_put(inbuf, want ? want : 1);
+    // ffmpeg tué faute de progrès : sa sortie est incomplète
+    if (media && t->codec && ((Transcoder *)t->codec)->stalled) {
+        task_failed(t, "Conversion bloquée (ffmpeg ne répond plus)");
+        return;
+    }
 
-    if (t->processed_bytes >= t->total_size) {
-        close(wfd);
-        while ((w = read(rfd, buf, sizeof(buf))) > 0) {
-            write_n_bytes(fd, buf, w);
+    t->processed_bytes += r;
+    log_msg(LOG_DEBUG, t->task_id, "%s %zu/%ld", what, r, t->total_size);
+    if (suspend) {
+        task_suspend(t);
+    } else if (last) {
+        t->processed_bytes = t->total_size;
+        task_finish(t);
+    } else {
+        ResumeLog *rl = t->resume;
+        if (rl && (uint64_t)t->processed_bytes - rl->in_ckpt >= (uint64_t)RESUME_CHECKPOINT &&
+            task_checkpoint(t) < 0) {
+            task_failed(t, "Erreur de compression");
+            return;
         }
-        waitpid(pid, NULL, 0);
-        log_internal("Task %d: conversion done", t->task_id);
+        task_window(t, r);
+        task_progress(t, false);
+    }
+}
+
+size_t task_input_want(NetTask *t, size_t quantum_size) {
+    if (!t->input || t->cached) return 0;
+    ResumeLog *r = t->resume;
+    if (r && r->replay_from < r->replay_to) return 0;
+    size_t want;
+    if (t->parallel) {
+        ParallelState *ps = t->codec;
+        want = quantum_len(t, PARALLEL_BLOCK_SIZE - (ps ? ps->fill_len : 0));
+    } else {
+        want = quantum_len(t, quantum_size);
+    }
+    return want < TASK_READY_MAX ? want : TASK_READY_MAX;
+}
+
+void handle_streaming_compress_partial(NetTask *t, size_t quantum_size) {
+    ResumeLog *r = t->resume;
+    if (r && r->replay_from < r->replay_to) {
+        task_replay(t, quantum_size);
+        return;
+    }
+    stream_quantum(t, quantum_size, is_media_file(t->meta), "processed");
+}
+
+void handle_streaming_convert_partial(NetTask *t, size_t quantum_size) {
+    stream_quantum(t, quantum_size, true, "converted");
+}
+
+typedef struct {
+    int fd;
+} CachedResult;
+
+static void cached_result_free(void *codec) {
+    CachedResult *cr = codec;
+    close(cr->fd);
+    free(cr);
+}
+
+int task_attach_cached(NetTask *t, int fd, uint64_t size) {
+    CachedResult *cr = malloc(sizeof(*cr));
+    if (!cr) {
+        close(fd);
+        return -1;
+    }
+    cr->fd = fd;
+    t->cached = true;
+    t->parallel = false;            // résultat déjà découpé en blocs
+    t->total_size = (long)size;     // progression exprimée sur le résultat
+    t->codec = cr;
+    t->codec_free = cached_result_free;
+    return 0;
+}
+
+// Un quantum d'une tâche en cache : le fichier part tel quel, du cache de
+// pages au socket, sans repasser par les codecs.
+void handle_cached_partial(NetTask *t, size_t quantum_size) {
+    CachedResult *cr = t->codec;
+    size_t n = quantum_len(t, quantum_size);
+    if (!cr || task_send_file(t, cr->fd, (uint64_t)t->processed_bytes, n) < 0) {
+        // Connexion coupée : la tâche s'arrête là
+        t->processed_bytes = t->total_size;
+        return;
     }
+    metrics_add(M_RCACHE_BYTES_OUT, n);
+    t->processed_bytes += n;
+    if (t->processed_bytes >= t->total_size) task_finish(t);
+    else task_progress(t, false);
 }
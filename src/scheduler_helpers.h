@@ -5,7 +5,53 @@
 #include "netqueue.h"
 
 void handle_streaming_compress_partial(NetTask *t, size_t quantum_size);
+
+// Octets d'entrée que le prochain quantum de t (quantum_size octets, ou un
+// bloc en mode parallèle) doit trouver déjà reçus, plafonnés à une
+// demi-fenêtre de contrôle de flux. 0 : rien à attendre (résultat en cache,
+// sortie d'une reprise à renvoyer, entrée entièrement lue). Les quanta ne
+// bloquent jamais sur le réseau : une tâche sans ses données attend hors
+// file (taskbuf_park).
+size_t task_input_want(NetTask *t, size_t quantum_size);
+
+// Mode parallèle : l'entrée est découpée en blocs de PARALLEL_BLOCK_SIZE
+// compressés indépendamment, par autant de workers que la part de la tâche
+// le permet (share blocs en cours au plus), puis émis dans l'ordre au format
+// Zstd seekable (une trame par bloc, table de saut finale).
+#define PARALLEL_BLOCK_SIZE (4 * 1024 * 1024)
+#define PARALLEL_MIN_SIZE (2 * PARALLEL_BLOCK_SIZE)
+#define PARALLEL_MAX_SHARE 64
+
+// Un quantum d'une tâche parallèle, appelé par le worker qui l'a sortie de
+// file. La tâche est rendue à la file (requeue) dès qu'un bloc est pris,
+// avant sa compression, pour qu'un autre worker prenne le suivant. Avec
+// share blocs déjà en cours, elle est garée à la place (park(t, true), son
+// verrou tenu) et réveillée par le worker qui émet un bloc (park(t, false)).
+// Retourne true si la tâche est terminée : l'appelant la libère.
+bool handle_parallel_compress_partial(NetTask *t, int share,
+                                      void (*requeue)(NetTask *t, void *ctx),
+                                      void (*park)(NetTask *t, bool parked, void *ctx),
+                                      void *ctx);
+
+// Annule le réveil d'une tâche parallèle garée (kick) : true si elle
+// appartient désormais à l'appelant, false si un bloc émis la réveille déjà.
+bool parallel_compress_unpark(NetTask *t);
+
+// Tâche parallèle retirée de sa file (kick) : retourne true si elle peut
+// être libérée tout de suite, sinon le dernier bloc en cours s'en charge.
+bool parallel_compress_abandon(NetTask *t);
 void handle_streaming_convert_partial(NetTask *t, size_t quantum_size);
 bool is_media_file(const char *path);
 
+// Tâche servie depuis le cache de résultats : size octets du fichier fd,
+// envoyés par sendfile() ; tant que son coût n'est pas mesuré, un quantum
+// vaut RCACHE_QUANTUM_FACTOR quanta ordinaires.
+// Retourne -1 (fd fermé) faute de mémoire.
+#define RCACHE_QUANTUM_FACTOR 16
+int task_attach_cached(NetTask *t, int fd, uint64_t size);
+void handle_cached_partial(NetTask *t, size_t quantum_size);
+
+// Signale au client l'abandon de la tâche (FRAME_ERROR).
+void task_abort(NetTask *t, const char *reason);
+
 #endif // SCHEDULER_HELPERS_H
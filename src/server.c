@@ -3,7 +3,18 @@
 #include "utils.h"
 #include "log.h"
 #include "admin_console.h"
+#include "worker_pool.h"
+#include "transcoder.h"
+#include "netio.h"
+#include "protocol.h"
 #include "scheduler_helpers.h"
+#include "levelctl.h"
+#include "dictstore.h"
+#include "resultcache.h"
+#include "resume.h"
+#include "session.h"
+#include "mempool.h"
+#include "metrics.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -17,228 +28,543 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <signal.h>
+#include <ctype.h>
+#include <limits.h>
 
-#define SERVER_PORT 5000
-#define BACKLOG 5
-#define MAX_CLIENTS 5
+#define DEFAULT_SERVER_PORT 5000
+#define BACKLOG 128
+#define MAX_CLIENTS 4096
+#define DEFAULT_IO_THREADS 2
+#define DEFAULT_WARM_TRANSCODERS 2
+#define DEFAULT_METRICS_PORT 9464
+#define DEFAULT_MAX_TASK_MB (64L << 10)  // 64 Gio
 
 static bool server_running = true;
 static NetQueue queue;
+static WorkerPool pool;
 static int next_task_id = 1;
+static long max_task_mb = DEFAULT_MAX_TASK_MB;
 static pthread_mutex_t taskid_mutex = PTHREAD_MUTEX_INITIALIZER;
-static int current_clients = 0;
-static pthread_mutex_t clients_mutex = PTHREAD_MUTEX_INITIALIZER;
 
-// Gérer la console admin
-void *scheduler_thread(void *arg) {
-    NetQueue *q = arg;
-    while (server_running) {
-        // Attendre tâche
-        pthread_mutex_lock(&q->mutex);
-        while (q->size == 0 && server_running) {
-            pthread_cond_wait(&q->cond, &q->mutex);
-        }
-        if (!server_running) {
-            pthread_mutex_unlock(&q->mutex);
-            break;
-        }
-        // Sélection simple : FIFO
-        NetTask *t = netqueue_dequeue(q);
-        pthread_mutex_unlock(&q->mutex);
-        if (!t) continue;
+// États du protocole d'une connexion
+enum { CONN_AUTH, CONN_READY };
 
-        // Quantum selon priorité
-        size_t quantum = (3 - t->user_priority) * 16384; // ex. prio0→49152, prio1→32768, prio2→16384
+// Refus immédiat au-delà de MAX_CLIENTS, sans attente
+static int on_conn_accept(Conn *c) {
+    if (netio_active_conns() > MAX_CLIENTS) {
+        const char *msg = "Serveur plein";
+        netio_send_frame(c, FRAME_ERROR, 0, msg, (uint32_t)strlen(msg));
+        return -1;
+    }
+    metrics_inc(M_CONNS_ACCEPTED);
+    return 0;
+}
 
-        if (t->type == TASK_COMPRESS) {
-            handle_streaming_compress_partial(t, quantum);
-        } else {
-            handle_streaming_convert_partial(t, quantum);
-        }
+static void send_error(Conn *c, uint32_t stream, const char *msg) {
+    netio_send_frame(c, FRAME_ERROR, stream, msg, (uint32_t)strlen(msg));
+}
 
-        if (t->processed_bytes < t->total_size) {
-            netqueue_enqueue(q, t);
-        } else {
-            close(t->client_fd);
-            log_internal("Task %d done", t->task_id);
-            nettask_free(t);
-        }
-    }
-    return NULL;
-}
-
-static bool pseudo_in_use(const char *pseudo);
-
-void *client_handler(void *arg) {
-    int client_fd = *(int*)arg;
-    free(arg);
-
-    // Auth
-    char buf[256];
-    ssize_t r = read(client_fd, buf, sizeof(buf)-1);
-    if (r <= 0) { close(client_fd);   
-        pthread_mutex_lock(&clients_mutex);
-        current_clients--;
-        pthread_mutex_unlock(&clients_mutex);
-        return NULL;
-    }
-    buf[r] = '\0';
-    // Format : AUTH|pseudo\n
-    if (strncmp(buf, "AUTH|", 5) != 0) {
-        close(client_fd);
-        pthread_mutex_lock(&clients_mutex);
-        current_clients--;
-        pthread_mutex_unlock(&clients_mutex);
-        return NULL;
-    }
-    char *pseudo = strdup(buf+5);
-    pseudo[strcspn(pseudo, "\n")] = '\0';
-
-    // Déjà utilisé ?
-    pthread_mutex_lock(&clients_mutex);
-    if (pseudo_in_use(pseudo)) {
-        const char *msg = "AUTH_FAIL|Pseudo déjà connecté\n";
-        write(client_fd, msg, strlen(msg));
-        close(client_fd);
-        current_clients--;
-        pthread_mutex_unlock(&clients_mutex);
-        free(pseudo);
-        return NULL;
-    }
-    // Marquer comme utilisé
-    // (dans production, on stockerait dans une liste ; ici, on simplifie)
-    pthread_mutex_unlock(&clients_mutex);
+// FRAME_AUTH : charge = pseudo
+static int handle_auth(Conn *c, const uint8_t *payload, uint32_t len) {
+    if (len == 0 || len > 255) return -1;
+    char *pseudo = bufpool_strndup((const char *)payload, len);
+    if (!pseudo) return -1;
 
     // Priorité
     int prio;
     if (!find_user_priority(pseudo, &prio)) {
         prio = 2; // invité
     }
-    char ok[64];
-    snprintf(ok, sizeof(ok), "AUTH_OK|%d\n", prio);
-    write(client_fd, ok, strlen(ok));
-
-    // Lire tâche
-    r = read(client_fd, buf, sizeof(buf)-1);
-    if (r <= 0) {
-        close(client_fd);
-        pthread_mutex_lock(&clients_mutex);
-        current_clients--;
-        pthread_mutex_unlock(&clients_mutex);
-        free(pseudo);
-        return NULL;
-    }
-    buf[r] = '\0';
-    // Format : TASK|TYPE|size|meta|out\n
-    char *parts[6] = {0};
-    int idx = 0;
-    char *tok = strtok(buf, "|");
-    while (tok && idx < 5) {
-        parts[idx++] = tok;
-        tok = strtok(NULL, "|");
-    }
-    if (idx < 4) {
-        close(client_fd);
-        pthread_mutex_lock(&clients_mutex);
-        current_clients--;
-        pthread_mutex_unlock(&clients_mutex);
-        free(pseudo);
-        return NULL;
-    }
-    TaskType type = (strcmp(parts[1], "COMPRESS")==0 ? TASK_COMPRESS : TASK_CONVERT);
-    long total = atol(parts[2]);
-    char *meta = strdup(parts[3]);
-    char *out  = (type==TASK_CONVERT? strdup(parts[4]) : NULL);
+    // Un même pseudo peut ouvrir plusieurs connexions (client batch), dans
+    // la limite de son niveau
+    Session *session = session_open(pseudo, prio);
+    if (!session) {
+        metrics_inc(M_QUOTA_REJECTED);
+        const char *msg = "Trop de connexions pour ce pseudo";
+        netio_send_frame(c, FRAME_AUTH_FAIL, 0, msg, (uint32_t)strlen(msg));
+        bufpool_strfree(pseudo);
+        return -1;
+    }
+    c->pseudo = pseudo;
+    c->priority = prio;
+    c->session = session;
+    c->state = CONN_READY;
+
+    uint8_t ok[4];
+    put_u32(ok, (uint32_t)prio);
+    netio_send_frame(c, FRAME_AUTH_OK, 0, ok, sizeof(ok));
+    return 0;
+}
+
+static int stream_slot(Conn *c, uint32_t stream) {
+    for (int i = 0; i < CONN_MAX_STREAMS; i++) {
+        if (c->streams[i] && c->streams[i]->stream_id == stream) return i;
+    }
+    return -1;
+}
+
+// Mode de traitement, dernier élément de la clé du cache de résultats :
+// deux tâches de même contenu et de même mode produisent la même sortie
+static void cache_mode(const NetTask *t, bool media, char *mode, size_t cap) {
+    if (t->type == TASK_CONVERT) {
+        const char *out = t->output_name ? t->output_name : "";
+        const char *dot = strrchr(out, '.');
+        size_t n = (size_t)snprintf(mode, cap, "conv-");
+        for (const char *p = dot ? dot + 1 : ""; *p && n < cap - 1; p++) {
+            if (isalnum((unsigned char)*p)) mode[n++] = (char)tolower((unsigned char)*p);
+        }
+        mode[n] = '\0';
+    } else {
+        snprintf(mode, cap, "%s", media ? "media" : t->parallel ? "zs" : "z");
+    }
+}
+
+// FRAME_TASK : crée la tâche, son tampon d'entrée, et la met en file.
+// Une erreur sur une tâche ne coupe pas la connexion.
+static int handle_task(Conn *c, uint32_t stream, const uint8_t *payload, uint32_t len) {
+    ProtoTask pt;
+    if (stream == 0 || proto_decode_task(payload, len, &pt) < 0) {
+        send_error(c, stream, "En-tête de tâche invalide");
+        return 0;
+    }
+    if (stream_slot(c, stream) >= 0) {
+        send_error(c, stream, "Identifiant de tâche déjà utilisé");
+        return 0;
+    }
+    int slot = -1;
+    for (int i = 0; i < CONN_MAX_STREAMS && slot < 0; i++) {
+        if (!c->streams[i]) slot = i;
+    }
+    if (slot < 0) {
+        send_error(c, stream, "Trop de tâches en cours sur la connexion");
+        return 0;
+    }
+
+    TaskType type = (pt.type == PROTO_TASK_COMPRESS ? TASK_COMPRESS : TASK_CONVERT);
+    // Un dossier arrive déjà empaqueté (tar) : un seul flux Zstd pour toute
+    // l'archive, qui profite de la redondance entre fichiers
+    bool archive = (pt.flags & PROTO_TASK_ARCHIVE) != 0;
+    if (archive && type != TASK_COMPRESS) {
+        send_error(c, stream, "Archive : compression uniquement");
+        return 0;
+    }
+    // Taille annoncée par le client : bornée avant d'être comptée en long,
+    // une valeur hors bornes deviendrait négative et viderait le quota
+    if (pt.total_size > (uint64_t)LONG_MAX ||
+        (max_task_mb > 0 && pt.total_size > (uint64_t)max_task_mb << 20)) {
+        send_error(c, stream, "Tâche trop grosse");
+        return 0;
+    }
+    // Quota de l'utilisateur : refus avant toute allocation, la tâche ne
+    // coûte ni place en file ni quantum (ses DATA en route sont jetées)
+    long admitted = (long)pt.total_size;
+    if (!session_admit(c->session, c->priority, admitted)) {
+        metrics_inc(M_QUOTA_REJECTED);
+        send_error(c, stream, "Quota de l'utilisateur atteint");
+        return 0;
+    }
+    // Les données transcodées ne sont jamais inspectées : elles transitent
+    // par un tube, du socket à ffmpeg, sans copie en espace utilisateur
+    bool media = type == TASK_CONVERT || (!archive && is_media_file(pt.meta));
+    NetTask *t = nettask_new();
+    TaskBuf *in = media ? taskbuf_new_pipe(stream, PROTO_INITIAL_WINDOW) : taskbuf_new(stream);
+    if (t) {
+        t->session = c->session;
+        t->session_bytes = admitted;
+        t->session_release = session_release;
+    } else {
+        session_release(c->session, admitted);
+    }
+    if (!t || !in) {
+        nettask_free(t);
+        taskbuf_put(in);
+        send_error(c, stream, "Mémoire insuffisante");
+        return 0;
+    }
+    t->meta = bufpool_strdup(pt.meta);
+    t->output_name = (type==TASK_CONVERT && pt.out[0]) ? bufpool_strdup(pt.out) : NULL;
 
     // ID
     pthread_mutex_lock(&taskid_mutex);
     int tid = next_task_id++;
     pthread_mutex_unlock(&taskid_mutex);
 
-    NetTask *t = malloc(sizeof(NetTask));
     t->task_id = tid;
-    t->client_fd = client_fd;
-    t->user_priority = prio;
+    t->stream_id = stream;
+    t->user_priority = c->priority;
     t->type = type;
-    t->total_size = total;
+    t->total_size = (long)pt.total_size;
+    // Gros fichier : blocs indépendants compressés par plusieurs workers,
+    // sortie Zstd seekable. Sans intérêt sous deux blocs.
+    t->parallel = (pt.flags & PROTO_TASK_PARALLEL) && !media &&
+                  t->total_size >= PARALLEL_MIN_SIZE;
     t->processed_bytes = 0;
-    t->meta = meta;
-    t->output_name = out;
-    t->next = NULL;
+    t->created_us = t->ready_us = metrics_now_us();
+    conn_get(c);
+    t->conn = c;
+    t->conn_put = conn_put;
+
+    // Contenu déjà traité : le résultat est resservi depuis le cache et le
+    // flux n'est pas enregistré (les DATA déjà en route sont ignorées)
+    bool cached = false;
+    if ((pt.flags & PROTO_TASK_HASHED) && rcache_enabled()) {
+        char mode[32], key[RCACHE_KEY_MAX];
+        cache_mode(t, media, mode, sizeof(mode));
+        rcache_key(key, sizeof(key), pt.hash, pt.total_size, mode);
+        uint64_t size;
+        int fd = rcache_open(key, &size);
+        if (fd >= 0 && task_attach_cached(t, fd, size) == 0) {
+            cached = true;
+        } else {
+            t->cache = rcache_writer_new(key, pt.hash, pt.total_size);
+            t->cache_free = rcache_abort;
+        }
+    }
+    // Grosse compression simple d'un client qui sait reprendre : journal de
+    // reprise, nouveau ou retrouvé grâce au jeton (sinon départ de zéro)
+    ResumeLog *rl = NULL;
+    bool resumed = false;
+    if (!cached && (pt.flags & PROTO_TASK_RESUMABLE) && resume_enabled() && type == TASK_COMPRESS &&
+        !archive && !media && !t->parallel && t->total_size >= RESUME_MIN_SIZE) {
+        if (pt.flags & PROTO_TASK_RESUME) {
+            rl = resume_open(pt.resume_token, c->pseudo, pt.total_size, pt.resume_have);
+            resumed = rl != NULL;
+        }
+        if (!rl) rl = resume_create(c->pseudo, pt.total_size);
+        t->resume = rl;
+        t->resume_free = resume_free;
+    }
+    if (resumed) {
+        // Sortie partielle : rien à publier dans le cache
+        rcache_abort(t->cache);
+        t->cache = NULL;
+        t->processed_bytes = t->progress_sent = (long)rl->in_ckpt;
+        t->bytes_out = (long)rl->replay_from;
+        metrics_inc(M_TASKS_RESUMED);
+    }
+    if (cached) {
+        taskbuf_put(in);
+    } else {
+        taskbuf_get(in);
+        t->input = in;
+        c->streams[slot] = in;  // référence de la connexion
+    }
 
-    netqueue_enqueue(&queue, t);
+    uint8_t acc[29];
+    uint32_t acc_len = 5;
+    put_u32(acc, (uint32_t)tid);
+    acc[4] = cached ? PROTO_ACCEPT_CACHED : 0;
+    if (rl) {
+        acc[4] |= PROTO_ACCEPT_RESUMABLE;
+        put_u64(acc + acc_len, rl->token);
+        acc_len += 8;
+    }
+    if (resumed) {
+        acc[4] |= PROTO_ACCEPT_RESUMED;
+        put_u64(acc + acc_len, rl->in_ckpt);
+        put_u64(acc + acc_len + 8, rl->replay_from);
+        acc_len += 16;
+    }
+    netio_send_frame(c, FRAME_ACCEPT, stream, acc, acc_len);
 
-    // Attendre fin (socket close)
-    char dummy;
-    while (read(client_fd, &dummy, 1) > 0) { /* rien */ }
+    if (!netqueue_enqueue(&queue, t)) {
+        send_error(c, stream, "File pleine");
+        nettask_free(t);
+        return 0;
+    }
+    metrics_inc(M_TASKS_ACCEPTED);
+    log_msg(LOG_INFO, tid, "queued (%s, prio %d, stream %u%s%s%s%s)", c->pseudo, c->priority, stream,
+            archive ? ", archive" : "", t->parallel ? ", parallel" : "", cached ? ", cached" : "",
+            resumed ? ", resumed" : rl ? ", resumable" : "");
+    return 0;
+}
 
-    close(client_fd);
-    pthread_mutex_lock(&clients_mutex);
-    current_clients--;
-    pthread_mutex_unlock(&clients_mutex);
-    free(pseudo);
-    return NULL;
+// Fin d'envoi d'une tâche : la connexion lâche son tampon
+static void end_stream(Conn *c, int slot) {
+    if (c->data_dst == c->streams[slot]) c->data_dst = NULL;
+    taskbuf_set_eof(c->streams[slot]);
+    taskbuf_put(c->streams[slot]);
+    c->streams[slot] = NULL;
 }
 
-// Simplification : 
-static bool pseudo_in_use(const char *pseudo) {
-    // À implémenter avec une liste réelle...
-    // Pour l’instant on retourne false pour accepter tout pseudo unique.
-    return false;
+// FRAME_DICT_GET : renvoie le dictionnaire demandé sur le même identifiant
+static int handle_dict_get(Conn *c, uint32_t stream, const uint8_t *payload, uint32_t len) {
+    if (len != 4) return -1;
+    uint32_t id = get_u32(payload);
+    size_t size = 0;
+    void *dict = dictstore_fetch(id, &size);
+    uint8_t *p = bufpool_get(4 + size);
+    if (!p) {
+        free(dict);
+        return -1;
+    }
+    put_u32(p, id);
+    if (dict) memcpy(p + 4, dict, size);
+    netio_send_frame(c, FRAME_DICT, stream, p, (uint32_t)(4 + size));
+    bufpool_put(p, 4 + size);
+    free(dict);
+    return 0;
 }
 
-int main(void) {
+// Découpe c->rbuf en trames. Les charges DATA sont versées au fil de l'eau
+// dans le tampon de leur tâche ; les autres trames doivent tenir dans rbuf.
+static int on_conn_input(Conn *c) {
+    while (c->rlen > 0) {
+        if (c->data_left > 0) {
+            size_t n = c->rlen < c->data_left ? c->rlen : c->data_left;
+            // Au-delà de la fenêtre accordée, le client ne respecte pas
+            // le contrôle de flux
+            if (c->data_dst &&
+                taskbuf_append(c->data_dst, c->rbuf, n) > PROTO_INITIAL_WINDOW) return -1;
+            netio_consume(c, n);
+            c->data_left -= (uint32_t)n;
+            continue;
+        }
+        if (c->rlen < PROTO_HEADER_SIZE) return 0;
+
+        ProtoHeader h;
+        if (proto_parse_header((const uint8_t *)c->rbuf, &h) < 0) return -1;
+
+        if (h.type == FRAME_DATA) {
+            if (c->state != CONN_READY) return -1;
+            int slot = stream_slot(c, h.task_id);
+            c->data_dst = slot >= 0 ? c->streams[slot] : NULL;
+            c->data_left = h.length;
+            netio_consume(c, PROTO_HEADER_SIZE);
+            continue;
+        }
+
+        if (PROTO_HEADER_SIZE + h.length > sizeof(c->rbuf)) return -1;
+        if (c->rlen < PROTO_HEADER_SIZE + h.length) return 0;
+        const uint8_t *payload = (const uint8_t *)c->rbuf + PROTO_HEADER_SIZE;
+        int rc = 0;
+
+        if (h.type == FRAME_BYE) {
+            return -1;
+        } else if (c->state == CONN_AUTH) {
+            rc = (h.type == FRAME_AUTH) ? handle_auth(c, payload, h.length) : -1;
+        } else if (h.type == FRAME_TASK) {
+            rc = handle_task(c, h.task_id, payload, h.length);
+        } else if (h.type == FRAME_END) {
+            int slot = stream_slot(c, h.task_id);
+            if (slot >= 0) end_stream(c, slot);
+        } else if (h.type == FRAME_DICT_GET) {
+            rc = handle_dict_get(c, h.task_id, payload, h.length);
+        } else {
+            rc = -1;
+        }
+        if (rc < 0) return -1;
+        netio_consume(c, PROTO_HEADER_SIZE + h.length);
+    }
+    return 0;
+}
+
+// Connexion perdue : les tâches encore alimentées voient une fin de flux,
+// marquée comme coupure (les tâches reprenables se suspendent)
+static void on_conn_close(Conn *c) {
+    for (int i = 0; i < CONN_MAX_STREAMS; i++) {
+        if (!c->streams[i]) continue;
+        taskbuf_set_lost(c->streams[i]);
+        end_stream(c, i);
+    }
+    // Les tâches en cours gardent leur part du quota jusqu'à leur fin
+    session_close(c->session);
+    c->session = NULL;
+}
+
+static double gauge_queue_depth(void *ctx) {
+    return worker_pool_pending(ctx);
+}
+
+static double gauge_waiting_input(void *ctx) {
+    return worker_pool_waiting_input(ctx);
+}
+
+static double gauge_waiting_output(void *ctx) {
+    return worker_pool_waiting_output(ctx);
+}
+
+static double gauge_zstd_level(void *ctx) {
+    (void)ctx;
+    return levelctl_level();
+}
+
+static double gauge_users(void *ctx) {
+    (void)ctx;
+    return userauth_count();
+}
+
+static double gauge_rcache_bytes(void *ctx) {
+    (void)ctx;
+    return (double)rcache_bytes();
+}
+
+static double gauge_sessions(void *ctx) {
+    (void)ctx;
+    return session_count();
+}
+
+static double gauge_connections(void *ctx) {
+    (void)ctx;
+    return netio_active_conns();
+}
+
+static double gauge_log_dropped(void *ctx) {
+    (void)ctx;
+    return (double)log_overflows();
+}
+
+static const NetioHandlers protocol_handlers = {
+    .on_input = on_conn_input,
+    .on_accept = on_conn_accept,
+    .on_close = on_conn_close,
+};
+
+int main(int argc, char *argv[]) {
+    // Options : -p <port> (défaut : 5000)
+    //           -w <nb_workers> (défaut : un worker par cœur)
+    //           -t <nb_ffmpeg_pre_lancés> (défaut : 2)
+    //           -i <nb_threads_E/S> (défaut : 2)
+    //           -v : journal détaillé (un message par quantum)
+    //           -m <port_métriques> (défaut : 9464, 0 = désactivé)
+    //           -d <dossier> : magasin des dictionnaires Zstd (défaut : dicts)
+    //           -r <dossier> : cache des résultats (défaut : results)
+    //           -C <Mio> : taille du cache des résultats (défaut : 1024, 0 = désactivé)
+    //           -k <dossier> : journaux de reprise des tâches (défaut : resume)
+    //           -S srpt|drr : service au sein d'un niveau de priorité (défaut : srpt,
+    //              moins d'octets restants d'abord ; drr : partage équitable entre
+    //              utilisateurs puis entre leurs tâches)
+    //           -q <prio>:<connexions>:<tâches>:<Mio> : quotas par utilisateur d'un
+    //              niveau de priorité (0 = illimité ; répétable)
+    //           -T <Mio> : taille maximale d'une tâche (défaut : 65536, 0 = sans borne)
+    //           -z <min>[:<max>] : bornes du niveau Zstd adaptatif (défaut : 1:12,
+    //              un seul nombre fixe le niveau)
+    int port = DEFAULT_SERVER_PORT;
+    int nworkers = worker_pool_default_size();
+    int warm_transcoders = DEFAULT_WARM_TRANSCODERS;
+    int io_threads = DEFAULT_IO_THREADS;
+    int metrics_port = DEFAULT_METRICS_PORT;
+    int level_min = LEVELCTL_MIN, level_max = LEVELCTL_CEILING;
+    const char *dict_dir = DICT_DEFAULT_DIR;
+    const char *cache_dir = RCACHE_DEFAULT_DIR;
+    long cache_mb = RCACHE_DEFAULT_MB;
+    const char *resume_dir = RESUME_DEFAULT_DIR;
+    NetQueuePolicy policy = NETQUEUE_SRPT;
+    int opt;
+    while ((opt = getopt(argc, argv, "p:w:t:i:vm:z:d:r:C:k:q:S:T:")) != -1) {
+        if (opt == 'p' && atoi(optarg) > 0 && atoi(optarg) <= 65535) {
+            port = atoi(optarg);
+        } else if (opt == 'w' && atoi(optarg) > 0) {
+            nworkers = atoi(optarg);
+        } else if (opt == 't' && atoi(optarg) >= 0) {
+            warm_transcoders = atoi(optarg);
+        } else if (opt == 'i' && atoi(optarg) > 0) {
+            io_threads = atoi(optarg);
+        } else if (opt == 'm' && atoi(optarg) >= 0) {
+            metrics_port = atoi(optarg);
+        } else if (opt == 'z' && atoi(optarg) > 0) {
+            const char *colon = strchr(optarg, ':');
+            level_min = atoi(optarg);
+            level_max = colon ? atoi(colon + 1) : level_min;
+        } else if (opt == 'd') {
+            dict_dir = optarg;
+        } else if (opt == 'r') {
+            cache_dir = optarg;
+        } else if (opt == 'C' && atol(optarg) >= 0) {
+            cache_mb = atol(optarg);
+        } else if (opt == 'k') {
+            resume_dir = optarg;
+        } else if (opt == 'S' && (strcmp(optarg, "srpt") == 0 || strcmp(optarg, "drr") == 0)) {
+            policy = optarg[0] == 'd' ? NETQUEUE_DRR : NETQUEUE_SRPT;
+        } else if (opt == 'q' && session_parse_limits(optarg) == 0) {
+            // limites appliquées par session_parse_limits
+        } else if (opt == 'T' && atol(optarg) >= 0) {
+            max_task_mb = atol(optarg);
+        } else if (opt == 'v') {
+            log_set_level(LOG_DEBUG);
+        } else {
+            fprintf(stderr, "Usage : %s [-p port] [-w nb_workers] [-t nb_ffmpeg] [-i nb_threads_es] [-v] [-m port_metriques] [-z niveau_min:max] [-d dossier_dicts] [-r dossier_resultats] [-C taille_cache_mio] [-k dossier_reprise] [-q prio:conn:taches:mio] [-S srpt|drr] [-T taille_max_tache_mio]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    // Un client ou un ffmpeg qui disparaît ne doit pas tuer le serveur
+    signal(SIGPIPE, SIG_IGN);
+
     if (load_users("users.txt") < 0) {
         fprintf(stderr, "Erreur users.txt\n");
         return 1;
     }
+    // kill -HUP ou « reload » dans la console : annuaire relu en arrière-plan
+    if (userauth_start_reloader() < 0) {
+        fprintf(stderr, "Avertissement : rechargement de l'annuaire indisponible\n");
+    }
     netqueue_init(&queue);
+    if (netqueue_set_policy(&queue, policy) < 0) {
+        fprintf(stderr, "Erreur : politique d'ordonnancement\n");
+        return 1;
+    }
+    levelctl_set_bounds(level_min, level_max);
+    if (dictstore_init(dict_dir) < 0) {
+        fprintf(stderr, "Avertissement : magasin de dictionnaires %s indisponible\n", dict_dir);
+    }
+    if (rcache_init(cache_dir, (uint64_t)cache_mb << 20) < 0) {
+        fprintf(stderr, "Avertissement : cache de résultats %s indisponible\n", cache_dir);
+    }
+    if (resume_init(resume_dir) < 0) {
+        fprintf(stderr, "Avertissement : reprise des tâches indisponible (%s)\n", resume_dir);
+    }
 
-    pthread_t sched;
-    pthread_create(&sched, NULL, scheduler_thread, &queue);
-    pthread_detach(sched);
+    if (transcoder_pool_init(warm_transcoders) < 0) {
+        fprintf(stderr, "Avertissement : pas de réserve ffmpeg\n");
+    }
+    if (worker_pool_start(&pool, &queue, nworkers, &server_running) < 0) {
+        fprintf(stderr, "Erreur démarrage des workers\n");
+        return 1;
+    }
+
+    start_admin_console(&pool, &server_running);
 
-    start_admin_console(&queue, &server_running);
+    metrics_gauge("netsched_queue_depth", "Tâches en attente", gauge_queue_depth, &pool);
+    metrics_gauge("netsched_tasks_waiting_input", "Tâches en attente de données du client",
+                  gauge_waiting_input, &pool);
+    metrics_gauge("netsched_tasks_waiting_output", "Tâches en attente de lecture du client",
+                  gauge_waiting_output, &pool);
+    metrics_gauge("netsched_zstd_level", "Niveau Zstd des nouvelles trames", gauge_zstd_level, NULL);
+    metrics_gauge("netsched_users_loaded", "Utilisateurs de l'annuaire", gauge_users, NULL);
+    metrics_gauge("netsched_result_cache_bytes", "Octets du cache de résultats", gauge_rcache_bytes, NULL);
+    metrics_gauge("netsched_connections_active", "Connexions ouvertes", gauge_connections, NULL);
+    metrics_gauge("netsched_sessions_active", "Utilisateurs connectés", gauge_sessions, NULL);
+    metrics_gauge("netsched_log_dropped_messages", "Messages de journal perdus", gauge_log_dropped, NULL);
+    if (metrics_port > 0 && metrics_serve(metrics_port, &server_running) < 0) {
+        fprintf(stderr, "Avertissement : endpoint de métriques indisponible\n");
+    }
 
-    int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
-    int opt=1;
-    setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    int listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    int one=1;
+    setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
 
     struct sockaddr_in addr;
     addr.sin_family = AF_INET;
     addr.sin_addr.s_addr = INADDR_ANY;
-    addr.sin_port = htons(SERVER_PORT);
-    bind(listen_fd, (struct sockaddr*)&addr, sizeof(addr));
-    listen(listen_fd, BACKLOG);
+    addr.sin_port = htons(port);
+    if (bind(listen_fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 ||
+        listen(listen_fd, BACKLOG) < 0) {
+        perror("bind/listen");
+        return 1;
+    }
 
-    while (server_running) {
-        pthread_mutex_lock(&clients_mutex);
-        if (current_clients >= MAX_CLIENTS) {
-            pthread_mutex_unlock(&clients_mutex);
-            usleep(100000);
-            continue;
-        }
-        pthread_mutex_unlock(&clients_mutex);
-
-        int cli = accept(listen_fd, NULL, NULL);
-        pthread_mutex_lock(&clients_mutex);
-        if (current_clients >= MAX_CLIENTS) {
-            const char *msg = "ERROR|Serveur plein\n";
-            write(cli, msg, strlen(msg));
-            close(cli);
-            pthread_mutex_unlock(&clients_mutex);
-            continue;
-        }
-        current_clients++;
-        pthread_mutex_unlock(&clients_mutex);
+    // Accept, authentification et soumission des tâches : threads epoll
+    if (netio_start(listen_fd, io_threads, &protocol_handlers, &server_running) < 0) {
+        fprintf(stderr, "Erreur démarrage des threads réseau\n");
+        return 1;
+    }
 
-        int *pcli = malloc(sizeof(int));
-        *pcli = cli;
-        pthread_t tid;
-        pthread_create(&tid, NULL, client_handler, pcli);
-        pthread_detach(tid);
+    while (server_running) {
+        sleep(1);
     }
 
     close(listen_fd);
+    log_flush();
     return 0;
 }
@@ -0,0 +1,177 @@
+#include "session.h"
+#include "netqueue.h"
+#include "utils.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SESSION_BUCKETS 64      // puissance de 2
+
+struct Session {
+    char *pseudo;
+    uint32_t hash;
+    int bucket;
+    int priority;               // niveau de la dernière connexion ouverte
+    int conns;
+    int tasks;
+    long bytes;
+    uint64_t rejected;          // connexions et tâches refusées
+    struct Session *next;
+};
+
+typedef struct {
+    pthread_mutex_t lock;
+    Session *head;
+} Bucket;
+
+static Bucket buckets[SESSION_BUCKETS];
+static pthread_once_t buckets_once = PTHREAD_ONCE_INIT;
+static int sessions = 0;        // atomique
+
+// Défauts larges : un client batch (plusieurs connexions, quelques tâches
+// chacune) ou le générateur de charge ne les atteignent pas ; un compte
+// seul ne peut plus occuper toute la file.
+static SessionLimits limits[NETQUEUE_PRIORITIES] = {
+    { 256, 1024, 16384 },
+    { 64, 256, 4096 },
+    { 32, 64, 1024 },
+};
+static pthread_mutex_t limits_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void buckets_init(void) {
+    for (int i = 0; i < SESSION_BUCKETS; i++) {
+        pthread_mutex_init(&buckets[i].lock, NULL);
+        buckets[i].head = NULL;
+    }
+}
+
+static int clamp_priority(int priority) {
+    if (priority < 0) return 0;
+    if (priority >= NETQUEUE_PRIORITIES) return NETQUEUE_PRIORITIES - 1;
+    return priority;
+}
+
+int session_parse_limits(const char *spec) {
+    int prio, conns, tasks;
+    long mb;
+    char end;
+    if (sscanf(spec, "%d:%d:%d:%ld%c", &prio, &conns, &tasks, &mb, &end) != 4) return -1;
+    if (prio < 0 || prio >= NETQUEUE_PRIORITIES || conns < 0 || tasks < 0 || mb < 0) return -1;
+    pthread_mutex_lock(&limits_mutex);
+    limits[prio].max_conns = conns;
+    limits[prio].max_tasks = tasks;
+    limits[prio].max_mb = mb;
+    pthread_mutex_unlock(&limits_mutex);
+    return 0;
+}
+
+void session_get_limits(int priority, SessionLimits *out) {
+    pthread_mutex_lock(&limits_mutex);
+    *out = limits[clamp_priority(priority)];
+    pthread_mutex_unlock(&limits_mutex);
+}
+
+// Retire s de son seau s'il n'a plus ni connexion ni tâche (verrou tenu)
+static void unlink_if_idle(Bucket *b, Session *s) {
+    if (s->conns > 0 || s->tasks > 0) return;
+    for (Session **pp = &b->head; *pp; pp = &(*pp)->next) {
+        if (*pp == s) {
+            *pp = s->next;
+            break;
+        }
+    }
+    free(s->pseudo);
+    free(s);
+    __atomic_sub_fetch(&sessions, 1, __ATOMIC_RELAXED);
+}
+
+Session *session_open(const char *pseudo, int priority) {
+    pthread_once(&buckets_once, buckets_init);
+    SessionLimits l;
+    session_get_limits(priority, &l);
+    uint32_t h = (uint32_t)xxh64(pseudo, strlen(pseudo), 0);
+    Bucket *b = &buckets[h & (SESSION_BUCKETS - 1)];
+
+    pthread_mutex_lock(&b->lock);
+    Session *s = b->head;
+    while (s && (s->hash != h || strcmp(s->pseudo, pseudo) != 0)) s = s->next;
+    if (!s) {
+        s = calloc(1, sizeof(*s));
+        if (s) s->pseudo = strdup(pseudo);
+        if (!s || !s->pseudo) {
+            pthread_mutex_unlock(&b->lock);
+            free(s);
+            return NULL;
+        }
+        s->hash = h;
+        s->bucket = (int)(h & (SESSION_BUCKETS - 1));
+        s->next = b->head;
+        b->head = s;
+        __atomic_add_fetch(&sessions, 1, __ATOMIC_RELAXED);
+    }
+    s->priority = priority;
+    if (l.max_conns > 0 && s->conns >= l.max_conns) {
+        s->rejected++;
+        pthread_mutex_unlock(&b->lock);
+        return NULL;
+    }
+    s->conns++;
+    pthread_mutex_unlock(&b->lock);
+    return s;
+}
+
+void session_close(Session *s) {
+    if (!s) return;
+    Bucket *b = &buckets[s->bucket];
+    pthread_mutex_lock(&b->lock);
+    s->conns--;
+    unlink_if_idle(b, s);
+    pthread_mutex_unlock(&b->lock);
+}
+
+bool session_admit(Session *s, int priority, long bytes) {
+    SessionLimits l;
+    session_get_limits(priority, &l);
+    if (bytes < 0) return false;
+    Bucket *b = &buckets[s->bucket];
+    pthread_mutex_lock(&b->lock);
+    bool ok = (l.max_tasks == 0 || s->tasks < l.max_tasks) &&
+              (l.max_mb == 0 || s->tasks == 0 || s->bytes + bytes <= (l.max_mb << 20));
+    if (ok) {
+        s->tasks++;
+        s->bytes += bytes;
+    } else {
+        s->rejected++;
+    }
+    pthread_mutex_unlock(&b->lock);
+    return ok;
+}
+
+void session_release(void *arg, long bytes) {
+    Session *s = arg;
+    if (!s) return;
+    Bucket *b = &buckets[s->bucket];
+    pthread_mutex_lock(&b->lock);
+    s->tasks--;
+    s->bytes -= bytes;
+    unlink_if_idle(b, s);
+    pthread_mutex_unlock(&b->lock);
+}
+
+int session_count(void) {
+    return __atomic_load_n(&sessions, __ATOMIC_RELAXED);
+}
+
+void session_foreach(void (*fn)(const char *pseudo, int priority, int conns, int tasks, long bytes,
+                                uint64_t rejected, void *ctx),
+                     void *ctx) {
+    pthread_once(&buckets_once, buckets_init);
+    for (int i = 0; i < SESSION_BUCKETS; i++) {
+        pthread_mutex_lock(&buckets[i].lock);
+        for (Session *s = buckets[i].head; s; s = s->next) {
+            fn(s->pseudo, s->priority, s->conns, s->tasks, s->bytes, s->rejected, ctx);
+        }
+        pthread_mutex_unlock(&buckets[i].lock);
+    }
+}
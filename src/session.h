@@ -0,0 +1,50 @@
+#ifndef SESSION_H
+#define SESSION_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Registre des sessions : une entrée par pseudo connecté, qui compte ses
+// connexions ouvertes, ses tâches admises non terminées et les octets
+// d'entrée de ces tâches. Chaque niveau de priorité a ses limites ; une
+// connexion ou une tâche hors quota est refusée à l'admission, avant toute
+// allocation et sans passer par la file. Table de hachage chaînée dont
+// chaque seau a son propre verrou : deux pseudos différents ne se gênent
+// presque jamais. Une entrée disparaît avec sa dernière connexion et sa
+// dernière tâche.
+
+typedef struct Session Session;
+
+// Limites d'un niveau de priorité ; 0 = illimité.
+typedef struct {
+    int max_conns;
+    int max_tasks;
+    long max_mb;                // Mio d'entrée des tâches en cours
+} SessionLimits;
+
+// Remplace les limites d'un niveau à partir de "prio:conns:tasks:mio".
+// Retourne -1 si la chaîne est invalide.
+int session_parse_limits(const char *spec);
+void session_get_limits(int priority, SessionLimits *out);
+
+// Ouvre une connexion pour pseudo ; NULL si la limite de connexions de son
+// niveau est atteinte (ou mémoire insuffisante).
+Session *session_open(const char *pseudo, int priority);
+void session_close(Session *s);
+
+// Admet une tâche de bytes octets au niveau priority. Une tâche plus grosse
+// que le quota d'octets passe quand l'utilisateur n'a rien d'autre en cours ;
+// une taille négative est toujours refusée.
+bool session_admit(Session *s, int priority, long bytes);
+// Fin d'une tâche admise (signature de NetTask.session_release).
+void session_release(void *s, long bytes);
+
+// Nombre de sessions ouvertes.
+int session_count(void);
+
+// Appelle fn pour chaque session (verrou de son seau tenu).
+void session_foreach(void (*fn)(const char *pseudo, int priority, int conns, int tasks, long bytes,
+                                uint64_t rejected, void *ctx),
+                     void *ctx);
+
+#endif // SESSION_H
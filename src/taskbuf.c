@@ -0,0 +1,312 @@
+#define _GNU_SOURCE
+#include "taskbuf.h"
+#include "mempool.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <time.h>
+#include <unistd.h>
+
+// Taille d'un bloc, en-tête compris : une classe exacte du pool de tampons
+#define TASKBUF_CHUNK_SIZE (64 * 1024)
+
+static Slab taskbuf_slab = SLAB_INITIALIZER("taskbuf", sizeof(TaskBuf), 64);
+
+static void chunk_free(TaskBufChunk *c) {
+    bufpool_put(c, sizeof(*c) + c->cap);
+}
+
+TaskBuf *taskbuf_new(uint32_t stream_id) {
+    TaskBuf *b = slab_alloc(&taskbuf_slab);
+    if (!b) return NULL;
+    pthread_mutex_init(&b->mutex, NULL);
+    pthread_cond_init(&b->cond, NULL);
+    b->refs = 1;
+    b->stream_id = stream_id;
+    b->pipe_r = b->pipe_w = -1;
+    return b;
+}
+
+TaskBuf *taskbuf_new_pipe(uint32_t stream_id, size_t capacity) {
+    TaskBuf *b = taskbuf_new(stream_id);
+    if (!b) return NULL;
+    int p[2];
+    if (pipe2(p, O_CLOEXEC | O_NONBLOCK) < 0) return b;
+    int cap = fcntl(p[1], F_SETPIPE_SZ, (int)capacity);
+    if (cap < 0 || (size_t)cap < capacity) {
+        // pipe-max-size trop petit : le contrôle de flux ne tiendrait pas
+        close(p[0]);
+        close(p[1]);
+        return b;
+    }
+    b->pipe_r = p[0];
+    b->pipe_w = p[1];
+    b->piped = true;
+    return b;
+}
+
+static size_t pipe_pending(int fd) {
+    int n = 0;
+    if (fd < 0 || ioctl(fd, FIONREAD, &n) < 0) return 0;
+    return (size_t)n;
+}
+
+static void deadline_in(struct timespec *ts, int wait_ms) {
+    clock_gettime(CLOCK_REALTIME, ts);
+    ts->tv_sec += wait_ms / 1000;
+    ts->tv_nsec += (long)(wait_ms % 1000) * 1000000L;
+    if (ts->tv_nsec >= 1000000000L) { ts->tv_sec++; ts->tv_nsec -= 1000000000L; }
+}
+
+// Octets lisibles par le consommateur (verrou tenu)
+static size_t available_locked(const TaskBuf *b) {
+    return b->buffered + pipe_pending(b->pipe_r);
+}
+
+typedef struct {
+    void (*fn)(void *a, void *b);
+    void *a, *b;
+} Wake;
+
+// Retire le réveil enregistré si le consommateur garé peut repartir
+// (verrou tenu) ; l'appel se fait après déverrouillage
+static Wake take_wake_locked(TaskBuf *b) {
+    Wake w = { NULL, NULL, NULL };
+    if (b->ready_fn && (b->eof || b->closed || available_locked(b) >= b->ready_want)) {
+        w.fn = b->ready_fn;
+        w.a = b->ready_a;
+        w.b = b->ready_b;
+        b->ready_fn = NULL;
+    }
+    return w;
+}
+
+static void run_wake(Wake w) {
+    if (w.fn) w.fn(w.a, w.b);
+}
+
+void taskbuf_get(TaskBuf *b) {
+    __atomic_add_fetch(&b->refs, 1, __ATOMIC_RELAXED);
+}
+
+static void free_chunks(TaskBuf *b) {
+    TaskBufChunk *c = b->head;
+    while (c) {
+        TaskBufChunk *n = c->next;
+        chunk_free(c);
+        c = n;
+    }
+    b->head = b->tail = NULL;
+    b->buffered = 0;
+}
+
+void taskbuf_put(TaskBuf *b) {
+    if (!b) return;
+    if (__atomic_sub_fetch(&b->refs, 1, __ATOMIC_ACQ_REL) > 0) return;
+    free_chunks(b);
+    if (b->pipe_r >= 0) close(b->pipe_r);
+    if (b->pipe_w >= 0) close(b->pipe_w);
+    pthread_mutex_destroy(&b->mutex);
+    pthread_cond_destroy(&b->cond);
+    slab_free(&taskbuf_slab, b);
+}
+
+size_t taskbuf_append(TaskBuf *b, const void *data, size_t len) {
+    const char *p = data;
+    pthread_mutex_lock(&b->mutex);
+    if (b->closed || b->eof) {
+        pthread_mutex_unlock(&b->mutex);
+        return 0;
+    }
+    // Mode tube : tant que rien n'a débordé, l'ordre impose le tube
+    while (b->piped && !__atomic_load_n(&b->spill, __ATOMIC_RELAXED) && len > 0) {
+        ssize_t w = write(b->pipe_w, p, len);
+        if (w > 0) {
+            p += w;
+            len -= w;
+        } else if (w < 0 && errno == EAGAIN) {
+            __atomic_store_n(&b->spill, true, __ATOMIC_RELAXED);
+        } else if (!(w < 0 && errno == EINTR)) {
+            break;
+        }
+    }
+    if (b->piped && !__atomic_load_n(&b->spill, __ATOMIC_RELAXED)) len = 0;
+    while (len > 0) {
+        TaskBufChunk *c = b->tail;
+        if (!c || c->len == c->cap) {
+            size_t cap = TASKBUF_CHUNK_SIZE - sizeof(*c);
+            if (len > cap) cap = len;
+            c = bufpool_get(sizeof(*c) + cap);
+            if (!c) break;
+            c->next = NULL;
+            c->len = c->off = 0;
+            c->cap = cap;
+            if (b->tail) b->tail->next = c;
+            else b->head = c;
+            b->tail = c;
+        }
+        size_t n = c->cap - c->len;
+        if (n > len) n = len;
+        memcpy(c->data + c->len, p, n);
+        c->len += n;
+        p += n;
+        len -= n;
+        b->buffered += n;
+    }
+    size_t total = b->buffered + pipe_pending(b->pipe_w);
+    pthread_cond_signal(&b->cond);
+    Wake w = take_wake_locked(b);
+    pthread_mutex_unlock(&b->mutex);
+    run_wake(w);
+    return total;
+}
+
+ssize_t taskbuf_splice_from(TaskBuf *b, int sock_fd, size_t max) {
+    // Seul le thread d'E/S passe spill à vrai : une lecture périmée
+    // renvoie au pire vers taskbuf_append, qui revérifie sous le verrou
+    if (__atomic_load_n(&b->spill, __ATOMIC_RELAXED)) return 0;
+    for (;;) {
+        ssize_t n = splice(sock_fd, NULL, b->pipe_w, NULL, max,
+                           SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if (n > 0) {
+            pthread_mutex_lock(&b->mutex);
+            pthread_cond_signal(&b->cond);
+            Wake w = take_wake_locked(b);
+            pthread_mutex_unlock(&b->mutex);
+            run_wake(w);
+            return n;
+        }
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && errno != EAGAIN) return -1;
+        if (n < 0 && errno == EAGAIN) {
+            // EAGAIN vient du socket vide ou du tube saturé
+            struct pollfd pfd = { .fd = b->pipe_w, .events = POLLOUT };
+            if (poll(&pfd, 1, 0) == 0) {
+                pthread_mutex_lock(&b->mutex);
+                __atomic_store_n(&b->spill, true, __ATOMIC_RELAXED);
+                pthread_mutex_unlock(&b->mutex);
+            }
+        }
+        return 0;
+    }
+}
+
+size_t taskbuf_pipe_ready(TaskBuf *b, size_t n, int wait_ms) {
+    struct timespec deadline;
+    if (wait_ms >= 0) deadline_in(&deadline, wait_ms);
+    pthread_mutex_lock(&b->mutex);
+    size_t avail = pipe_pending(b->pipe_r) + b->buffered;
+    while (avail < n && !b->eof && !b->closed) {
+        int rc = 0;
+        if (wait_ms < 0) pthread_cond_wait(&b->cond, &b->mutex);
+        else rc = pthread_cond_timedwait(&b->cond, &b->mutex, &deadline);
+        avail = pipe_pending(b->pipe_r) + b->buffered;
+        if (rc != 0) break;
+    }
+    pthread_mutex_unlock(&b->mutex);
+    return avail < n ? avail : n;
+}
+
+size_t taskbuf_pipe_pending(TaskBuf *b) {
+    return pipe_pending(b->pipe_r);
+}
+
+void taskbuf_set_eof(TaskBuf *b) {
+    pthread_mutex_lock(&b->mutex);
+    // Mode tube : fermer l'écrivain donne EOF au lecteur une fois vidé
+    if (b->pipe_w >= 0) {
+        close(b->pipe_w);
+        b->pipe_w = -1;
+    }
+    b->eof = true;
+    pthread_cond_broadcast(&b->cond);
+    Wake w = take_wake_locked(b);
+    pthread_mutex_unlock(&b->mutex);
+    run_wake(w);
+}
+
+void taskbuf_set_lost(TaskBuf *b) {
+    __atomic_store_n(&b->lost, true, __ATOMIC_RELEASE);
+    taskbuf_set_eof(b);
+}
+
+void taskbuf_close(TaskBuf *b) {
+    pthread_mutex_lock(&b->mutex);
+    b->closed = true;
+    free_chunks(b);
+    // Les écritures suivantes du thread d'E/S échoueront (EPIPE) et seront jetées
+    if (b->pipe_r >= 0) {
+        close(b->pipe_r);
+        b->pipe_r = -1;
+    }
+    pthread_mutex_unlock(&b->mutex);
+}
+
+size_t taskbuf_read(TaskBuf *b, void *buf, size_t n, int wait_ms) {
+    struct timespec deadline;
+    if (wait_ms >= 0) deadline_in(&deadline, wait_ms);
+
+    pthread_mutex_lock(&b->mutex);
+    while (b->buffered < n && !b->eof && !b->closed) {
+        if (wait_ms < 0) {
+            pthread_cond_wait(&b->cond, &b->mutex);
+        } else if (pthread_cond_timedwait(&b->cond, &b->mutex, &deadline) != 0) {
+            break;
+        }
+    }
+
+    char *out = buf;
+    size_t got = 0;
+    while (got < n && b->head) {
+        TaskBufChunk *c = b->head;
+        size_t k = c->len - c->off;
+        if (k > n - got) k = n - got;
+        memcpy(out + got, c->data + c->off, k);
+        c->off += k;
+        got += k;
+        if (c->off == c->len) {
+            b->head = c->next;
+            if (!b->head) b->tail = NULL;
+            chunk_free(c);
+        }
+    }
+    b->buffered -= got;
+    // Débordement résorbé : le thread d'E/S peut reprendre le tube
+    if (b->spill && b->buffered == 0 && pipe_pending(b->pipe_r) == 0) {
+        __atomic_store_n(&b->spill, false, __ATOMIC_RELAXED);
+    }
+    pthread_mutex_unlock(&b->mutex);
+    return got;
+}
+
+bool taskbuf_drained(TaskBuf *b) {
+    pthread_mutex_lock(&b->mutex);
+    bool d = b->eof && b->buffered == 0 && pipe_pending(b->pipe_r) == 0;
+    pthread_mutex_unlock(&b->mutex);
+    return d;
+}
+
+bool taskbuf_park(TaskBuf *b, size_t want, void (*fn)(void *a, void *b), void *a, void *arg_b) {
+    pthread_mutex_lock(&b->mutex);
+    bool park = !b->eof && !b->closed && available_locked(b) < want;
+    if (park) {
+        b->ready_want = want;
+        b->ready_fn = fn;
+        b->ready_a = a;
+        b->ready_b = arg_b;
+    }
+    pthread_mutex_unlock(&b->mutex);
+    return park;
+}
+
+bool taskbuf_unpark(TaskBuf *b, void *arg_b) {
+    pthread_mutex_lock(&b->mutex);
+    bool found = b->ready_fn && b->ready_b == arg_b;
+    if (found) b->ready_fn = NULL;
+    pthread_mutex_unlock(&b->mutex);
+    return found;
+}
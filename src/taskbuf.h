@@ -0,0 +1,100 @@
+#ifndef TASKBUF_H
+#define TASKBUF_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+#include <sys/types.h>
+
+typedef struct TaskBufChunk {
+    struct TaskBufChunk *next;
+    size_t len;
+    size_t off;
+    size_t cap;
+    char data[];
+} TaskBufChunk;
+
+// Données d'entrée d'une tâche : rempli par le thread d'E/S à partir des
+// trames DATA, vidé par le worker qui traite ses quanta. Partagé entre la
+// connexion et la tâche (compteur de références).
+typedef struct TaskBuf {
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    TaskBufChunk *head;
+    TaskBufChunk *tail;
+    size_t buffered;
+    bool eof;                   // plus rien ne viendra (fin d'envoi ou coupure)
+    bool lost;                  // fin due à la perte de la connexion
+    bool closed;                // la tâche n'existe plus : on jette les données
+    int refs;                   // atomique
+    uint32_t stream_id;         // identifiant de la tâche côté client
+    // Mode tube (zéro copie) : les données vont du socket à pipe_w par
+    // splice() et le worker les reprend de pipe_r ; -1 en mode mémoire.
+    // Un tube rempli de petits segments TCP sature ses cases avant ses
+    // octets : le surplus déborde alors dans les blocs mémoire (spill),
+    // jusqu'à ce que le worker ait tout vidé.
+    int pipe_r;
+    int pipe_w;
+    bool piped;
+    bool spill;                 // atomique : écrit par le thread d'E/S et le worker
+    // Tâche garée faute de données : réveillée (une fois) par le producteur
+    // dès que ready_want octets sont disponibles ou à la fin du flux
+    size_t ready_want;
+    void (*ready_fn)(void *a, void *b);
+    void *ready_a, *ready_b;
+} TaskBuf;
+
+TaskBuf *taskbuf_new(uint32_t stream_id);
+
+// Tampon en mode tube, pour les données que le serveur n'inspecte pas
+// (transcodage). Le tube doit contenir au moins `capacity` octets ; sinon
+// le tampon est créé en mode mémoire.
+TaskBuf *taskbuf_new_pipe(uint32_t stream_id, size_t capacity);
+
+static inline bool taskbuf_is_pipe(const TaskBuf *b) { return b->piped; }
+
+// Mode tube : déplace au plus max octets du socket vers le tube, sans copie.
+// Retourne le nombre d'octets déplacés, 0 si l'appelant doit passer par
+// read() + taskbuf_append (socket vide ou fermé, tube saturé), ou -1 sur
+// erreur de splice() (errno EPIPE : la tâche n'existe plus).
+ssize_t taskbuf_splice_from(TaskBuf *b, int sock_fd, size_t max);
+
+// Mode tube : attend qu'au moins n octets soient en attente ou la fin du
+// flux, au plus wait_ms ms. Retourne le nombre d'octets lisibles (<= n).
+size_t taskbuf_pipe_ready(TaskBuf *b, size_t n, int wait_ms);
+
+// Mode tube : octets à reprendre de b->pipe_r avant ceux des blocs mémoire.
+size_t taskbuf_pipe_pending(TaskBuf *b);
+
+void taskbuf_get(TaskBuf *b);
+void taskbuf_put(TaskBuf *b);
+
+// Ajoute len octets (jetés si la tâche est fermée). Retourne le total en attente.
+size_t taskbuf_append(TaskBuf *b, const void *data, size_t len);
+
+void taskbuf_set_eof(TaskBuf *b);
+
+// Fin de flux par perte de la connexion : une tâche reprenable se suspend.
+void taskbuf_set_lost(TaskBuf *b);
+
+// Marque la fin de la tâche consommatrice ; les ajouts suivants sont jetés.
+void taskbuf_close(TaskBuf *b);
+
+// Copie jusqu'à n octets. Attend que n octets soient là ou la fin du flux,
+// au plus wait_ms ms (-1 = sans limite). Peut retourner 0 sans fin de flux.
+size_t taskbuf_read(TaskBuf *b, void *buf, size_t n, int wait_ms);
+
+// Vrai si la fin de flux est atteinte et tout a été lu.
+bool taskbuf_drained(TaskBuf *b);
+
+// Gare le consommateur tant que moins de want octets sont disponibles et que
+// le flux continue : fn(a, b) sera appelé une fois, depuis le thread qui
+// apporte les données (ou la fin du flux). Retourne false, sans rien
+// enregistrer, si les données sont déjà là : le quantum peut commencer.
+bool taskbuf_park(TaskBuf *b, size_t want, void (*fn)(void *a, void *b), void *a, void *arg_b);
+// Annule le réveil enregistré pour arg_b. Retourne false s'il n'y en a plus :
+// le réveil est déjà parti (ou part) vers fn.
+bool taskbuf_unpark(TaskBuf *b, void *arg_b);
+
+#endif // TASKBUF_H
@@ -0,0 +1,238 @@
+#define _GNU_SOURCE
+#include "transcoder.h"
+#include "log.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <sys/ioctl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define TRANSCODER_MAX_WARM 16
+
+static Transcoder *warm_pool[TRANSCODER_MAX_WARM];
+static int warm_count = 0;
+static int warm_target = 0;
+static pthread_mutex_t pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pool_cond = PTHREAD_COND_INITIALIZER;
+
+// Même profil pour la compression média et la conversion : mp3 192k.
+// Les tubes sont O_CLOEXEC : un ffmpeg n'hérite jamais des tubes d'un autre.
+static Transcoder *transcoder_spawn(void) {
+    int pin[2], pout[2];
+    if (pipe2(pin, O_CLOEXEC) < 0) return NULL;
+    if (pipe2(pout, O_CLOEXEC) < 0) {
+        close(pin[0]); close(pin[1]);
+        return NULL;
+    }
+    pid_t pid = fork();
+    if (pid < 0) {
+        close(pin[0]); close(pin[1]); close(pout[0]); close(pout[1]);
+        return NULL;
+    }
+    if (pid == 0) {
+        dup2(pin[0], 0); dup2(pout[1], 1);
+        execlp("ffmpeg","ffmpeg","-hide_banner","-loglevel","error",
+               "-i","pipe:0","-f","mp3","-b:a","192k","pipe:1",(char*)NULL);
+        _exit(1);
+    }
+    close(pin[0]); close(pout[1]);
+
+    Transcoder *tc = malloc(sizeof(*tc));
+    if (!tc) {
+        close(pin[1]); close(pout[0]);
+        kill(pid, SIGKILL);
+        waitpid(pid, NULL, 0);
+        return NULL;
+    }
+    tc->pid = pid;
+    tc->wfd = pin[1];
+    tc->rfd = pout[0];
+    tc->stalled = false;
+    fcntl(tc->wfd, F_SETFL, fcntl(tc->wfd, F_GETFL, 0) | O_NONBLOCK);
+    fcntl(tc->rfd, F_SETFL, fcntl(tc->rfd, F_GETFL, 0) | O_NONBLOCK);
+    return tc;
+}
+
+static bool transcoder_alive(Transcoder *tc) {
+    return waitpid(tc->pid, NULL, WNOHANG) == 0;
+}
+
+static void *refill_thread(void *arg) {
+    (void)arg;
+    pthread_mutex_lock(&pool_mutex);
+    for (;;) {
+        while (warm_count >= warm_target) pthread_cond_wait(&pool_cond, &pool_mutex);
+        pthread_mutex_unlock(&pool_mutex);
+        Transcoder *tc = transcoder_spawn();
+        pthread_mutex_lock(&pool_mutex);
+        if (!tc) {
+            log_msg(LOG_WARN, -1, "Transcoder pool: spawn failed");
+            // Pas de boucle serrée si fork échoue : on attend la prochaine demande
+            pthread_cond_wait(&pool_cond, &pool_mutex);
+            continue;
+        }
+        warm_pool[warm_count++] = tc;
+    }
+    return NULL;
+}
+
+int transcoder_pool_init(int warm) {
+    if (warm < 0) warm = 0;
+    if (warm > TRANSCODER_MAX_WARM) warm = TRANSCODER_MAX_WARM;
+    warm_target = warm;
+    if (warm == 0) return 0;
+    pthread_t tid;
+    if (pthread_create(&tid, NULL, refill_thread, NULL) != 0) {
+        warm_target = 0;
+        return -1;
+    }
+    pthread_detach(tid);
+    pthread_mutex_lock(&pool_mutex);
+    pthread_cond_signal(&pool_cond);
+    pthread_mutex_unlock(&pool_mutex);
+    return 0;
+}
+
+Transcoder *transcoder_acquire(void) {
+    Transcoder *tc = NULL;
+    pthread_mutex_lock(&pool_mutex);
+    while (warm_count > 0 && !tc) {
+        tc = warm_pool[--warm_count];
+        // Un ffmpeg de réserve mort (binaire absent...) est jeté
+        if (!transcoder_alive(tc)) {
+            tc->pid = -1;       // déjà récolté par waitpid
+            transcoder_release(tc);
+            tc = NULL;
+        }
+    }
+    if (warm_target > 0) pthread_cond_signal(&pool_cond);
+    pthread_mutex_unlock(&pool_mutex);
+    return tc ? tc : transcoder_spawn();
+}
+
+static int relay_copy(Transcoder *tc, const TranscoderSink *sink) {
+    char buf[32768];
+    for (;;) {
+        ssize_t n = read(tc->rfd, buf, sizeof(buf));
+        if (n > 0) {
+            sink->write(sink->ctx, buf, n);
+            continue;
+        }
+        if (n == 0) return 1;
+        if (errno == EINTR) continue;
+        return 0;
+    }
+}
+
+// Relaie vers sink tout ce que ffmpeg a déjà produit.
+// Retourne 1 à EOF, 0 sinon.
+static int relay_output(Transcoder *tc, const TranscoderSink *sink) {
+    if (!sink->splice) return relay_copy(tc, sink);
+    for (;;) {
+        int avail = 0;
+        if (ioctl(tc->rfd, FIONREAD, &avail) < 0) return relay_copy(tc, sink);
+        if (avail > 0) {
+            // Socket perdu en cours de route : on vide le tube par copie
+            if (sink->splice(sink->ctx, tc->rfd, (size_t)avail) < 0) return relay_copy(tc, sink);
+            continue;
+        }
+        // Tube vide : EOF si ffmpeg a fermé sa sortie
+        struct pollfd pfd = { .fd = tc->rfd, .events = POLLIN };
+        if (poll(&pfd, 1, 0) > 0 && (pfd.revents & POLLHUP) &&
+            ioctl(tc->rfd, FIONREAD, &avail) == 0 && avail == 0) return 1;
+        return 0;
+    }
+}
+
+static void transcoder_kill_stalled(Transcoder *tc) {
+    log_msg(LOG_WARN, -1, "ffmpeg %d stalled for %d ms, killed", (int)tc->pid, TRANSCODER_STALL_MS);
+    kill(tc->pid, SIGKILL);
+    waitpid(tc->pid, NULL, 0);
+    tc->pid = -1;
+    tc->stalled = true;
+}
+
+// Boucle commune de transcoder_feed et transcoder_feed_fd : attend que
+// stdin accepte des octets en relayant la sortie, puis appelle push.
+static int feed_loop(Transcoder *tc, const TranscoderSink *sink, size_t len,
+                     ssize_t (*push)(Transcoder *, const void *, size_t, size_t),
+                     const void *src) {
+    size_t done = 0;
+    while (done < len) {
+        struct pollfd pfd[2] = {
+            { .fd = tc->wfd, .events = POLLOUT },
+            { .fd = tc->rfd, .events = POLLIN },
+        };
+        int ready = poll(pfd, 2, TRANSCODER_STALL_MS);
+        if (ready < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        if (ready == 0) {
+            transcoder_kill_stalled(tc);
+            return -1;
+        }
+        if (pfd[1].revents & (POLLIN | POLLHUP)) relay_output(tc, sink);
+        if (pfd[0].revents & (POLLERR | POLLHUP)) return -1;
+        if (pfd[0].revents & POLLOUT) {
+            ssize_t w = push(tc, src, done, len - done);
+            if (w > 0) done += w;
+            else if (w < 0 && errno != EAGAIN && errno != EINTR) return -1;
+        }
+    }
+    relay_output(tc, sink);
+    return 0;
+}
+
+static ssize_t push_mem(Transcoder *tc, const void *src, size_t off, size_t n) {
+    return write(tc->wfd, (const char *)src + off, n);
+}
+
+static ssize_t push_pipe(Transcoder *tc, const void *src, size_t off, size_t n) {
+    (void)off;
+    ssize_t w = splice(*(const int *)src, NULL, tc->wfd, NULL, n, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+    if (w == 0) errno = EPIPE;  // tube source vide et fermé : données perdues
+    return w == 0 ? -1 : w;
+}
+
+int transcoder_feed(Transcoder *tc, const TranscoderSink *sink, const void *data, size_t len) {
+    return feed_loop(tc, sink, len, push_mem, data);
+}
+
+int transcoder_feed_fd(Transcoder *tc, const TranscoderSink *sink, int in_fd, size_t len) {
+    return feed_loop(tc, sink, len, push_pipe, &in_fd);
+}
+
+void transcoder_finish(Transcoder *tc, const TranscoderSink *sink) {
+    if (tc->wfd >= 0) {
+        close(tc->wfd);
+        tc->wfd = -1;
+    }
+    struct pollfd pfd = { .fd = tc->rfd, .events = POLLIN };
+    while (!relay_output(tc, sink)) {
+        int ready = poll(&pfd, 1, TRANSCODER_STALL_MS);
+        if (ready < 0 && errno != EINTR) break;
+        if (ready == 0 && tc->pid > 0) {
+            transcoder_kill_stalled(tc);
+            break;
+        }
+    }
+    if (tc->pid > 0) waitpid(tc->pid, NULL, 0);
+    tc->pid = -1;
+}
+
+void transcoder_release(void *codec) {
+    Transcoder *tc = codec;
+    if (!tc) return;
+    if (tc->wfd >= 0) close(tc->wfd);
+    if (tc->rfd >= 0) close(tc->rfd);
+    if (tc->pid > 0) {
+        kill(tc->pid, SIGKILL);
+        waitpid(tc->pid, NULL, 0);
+    }
+    free(tc);
+}
@@ -0,0 +1,52 @@
+#ifndef TRANSCODER_H
+#define TRANSCODER_H
+
+#include <stdbool.h>
+#include <sys/types.h>
+
+// Reçoit la sortie de ffmpeg au fil de l'eau. Si splice est fourni, la
+// sortie lui est passée directement depuis le tube de ffmpeg (len octets
+// lisibles sur fd, sans copie) ; il retourne -1 s'il n'a pas pu tout prendre.
+typedef struct {
+    void (*write)(void *ctx, const void *data, size_t len);
+    int (*splice)(void *ctx, int fd, size_t len);
+    void *ctx;
+} TranscoderSink;
+
+// Un processus ffmpeg dédié à une tâche, vivant toute la durée de la tâche.
+// stdin et stdout sont des tubes non bloquants côté serveur.
+typedef struct {
+    pid_t pid;
+    int wfd;            // stdin de ffmpeg (-1 une fois fermé)
+    int rfd;            // stdout de ffmpeg
+    bool stalled;       // tué faute de progrès : sa sortie est incomplète
+} Transcoder;
+
+// Délai sans progrès (rien accepté sur stdin ni produit sur stdout) au-delà
+// duquel ffmpeg est tué : un processus bloqué ne retient pas un worker.
+#define TRANSCODER_STALL_MS 30000
+
+// Prépare une réserve de `warm` transcodeurs pré-lancés (0 = aucune).
+// Un thread de remplissage en relance un à chaque acquisition.
+int transcoder_pool_init(int warm);
+
+// Prend un transcodeur de la réserve, ou en lance un à la volée.
+Transcoder *transcoder_acquire(void);
+
+// Envoie len octets à ffmpeg en relayant sa sortie vers sink au fil de l'eau
+// (évite l'interblocage tube plein). Retourne 0, ou -1 si ffmpeg a disparu
+// ou vient d'être tué (stalled).
+int transcoder_feed(Transcoder *tc, const TranscoderSink *sink, const void *data, size_t len);
+
+// Comme transcoder_feed, mais les len octets (déjà présents dans le tube
+// in_fd) passent vers stdin de ffmpeg par splice(), sans copie.
+int transcoder_feed_fd(Transcoder *tc, const TranscoderSink *sink, int in_fd, size_t len);
+
+// Ferme stdin, relaie la sortie restante jusqu'à EOF et attend ffmpeg (ou
+// le tue, stalled, s'il ne progresse plus).
+void transcoder_finish(Transcoder *tc, const TranscoderSink *sink);
+
+// Tue le processus si besoin et libère tout (signature de NetTask.codec_free).
+void transcoder_release(void *tc);
+
+#endif // TRANSCODER_H
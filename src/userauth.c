@@ -1,67 +1,240 @@
 #include "userauth.h"
+#include "log.h"
+#include "utils.h"
+#include <errno.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <signal.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <time.h>
 
-// Structure interne pour stocker un utilisateur chargé depuis users.txt
+// Une case de la table ; pseudo NULL = case vide
 typedef struct {
-    char *pseudo;
+    const char *pseudo;         // pointe dans Directory.text
+    uint32_t hash;
     int priority;
-} User;
+} UserSlot;
 
-// Tableau dynamique d’utilisateurs
-static User *users = NULL;
-static int user_count = 0;
+// Annuaire immuable une fois publié
+typedef struct {
+    UserSlot *slots;
+    uint32_t mask;              // capacité - 1 (puissance de 2, charge <= 1/2)
+    int count;
+    char *text;                 // contenu du fichier, lignes découpées sur place
+} Directory;
 
-int load_users(const char *filename) {
+static Directory *current = NULL;
+static char *users_path = NULL;
+static pthread_mutex_t reload_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// Lecteurs en cours, par époque (parité). Un lecteur compte dans l'époque
+// courante avant de lire le pointeur ; après une substitution, le
+// rechargeur change d'époque et attend que l'ancienne se vide.
+static unsigned long epoch = 0;
+static long readers[2] = { 0, 0 };
+
+// Entre dans l'époque courante. La parité lue peut déjà être périmée quand
+// le compteur est incrémenté (deux rechargements entre-temps) : on relit
+// l'époque et on recommence si elle a changé.
+static unsigned long reader_enter(void) {
+    for (;;) {
+        unsigned long e = __atomic_load_n(&epoch, __ATOMIC_SEQ_CST);
+        __atomic_add_fetch(&readers[e & 1], 1, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&epoch, __ATOMIC_SEQ_CST) == e) return e & 1;
+        __atomic_sub_fetch(&readers[e & 1], 1, __ATOMIC_RELEASE);
+    }
+}
+
+static void reader_leave(unsigned long e) {
+    __atomic_sub_fetch(&readers[e], 1, __ATOMIC_RELEASE);
+}
+
+static sem_t reload_sem;
+static bool reloader_started = false;
+
+static uint32_t user_hash(const char *pseudo) {
+    return (uint32_t)xxh64(pseudo, strlen(pseudo), 0);
+}
+
+static void directory_free(Directory *d) {
+    if (!d) return;
+    free(d->slots);
+    free(d->text);
+    free(d);
+}
+
+static void *read_all(const char *filename, size_t *len) {
     FILE *f = fopen(filename, "r");
-    if (!f) return -1;
-
-    char line[256];
-    // 1) Compter le nombre de lignes utiles
-    user_count = 0;
-    while (fgets(line, sizeof(line), f)) {
-        // Ignorer commentaires et lignes vides
-        if (line[0] == '#' || line[0] == '\n') continue;
-        user_count++;
+    if (!f) return NULL;
+    size_t cap = 64 * 1024, n = 0;
+    char *buf = malloc(cap + 1);
+    while (buf) {
+        n += fread(buf + n, 1, cap - n, f);
+        if (n < cap) break;
+        char *nb = realloc(buf, cap * 2 + 1);
+        if (!nb) {
+            free(buf);
+            buf = NULL;
+            break;
+        }
+        buf = nb;
+        cap *= 2;
+    }
+    if (buf && ferror(f)) {
+        free(buf);
+        buf = NULL;
     }
-    if (user_count <= 0) {
-        fclose(f);
-        return 0;
+    fclose(f);
+    if (buf) {
+        buf[n] = '\0';
+        *len = n;
     }
-    rewind(f);
+    return buf;
+}
 
-    // Allouer le tableau
-    users = malloc(sizeof(User) * user_count);
-    if (!users) {
-        fclose(f);
-        return -1;
+static void directory_insert(Directory *d, const char *pseudo, int priority) {
+    uint32_t h = user_hash(pseudo);
+    uint32_t i = h & d->mask;
+    while (d->slots[i].pseudo) {
+        // Doublon : la première ligne l'emporte, comme l'ancien parcours
+        if (d->slots[i].hash == h && strcmp(d->slots[i].pseudo, pseudo) == 0) return;
+        i = (i + 1) & d->mask;
+    }
+    d->slots[i].pseudo = pseudo;
+    d->slots[i].hash = h;
+    d->slots[i].priority = priority;
+    d->count++;
+}
+
+// Construit un annuaire depuis filename (format pseudo:priorite, # commentaire)
+static Directory *directory_build(const char *filename) {
+    size_t len;
+    char *text = read_all(filename, &len);
+    if (!text) return NULL;
+    uint32_t lines = 1;
+    for (size_t i = 0; i < len; i++) lines += text[i] == '\n';
+    uint32_t cap = 16;
+    while (cap < lines * 2) cap <<= 1;
+
+    Directory *d = calloc(1, sizeof(*d));
+    if (d) d->slots = calloc(cap, sizeof(UserSlot));
+    if (!d || !d->slots) {
+        free(d);
+        free(text);
+        return NULL;
     }
+    d->mask = cap - 1;
+    d->text = text;
 
-    int idx = 0;
-    while (fgets(line, sizeof(line), f)) {
-        if (line[0] == '#' || line[0] == '\n') continue;
-        // Supprimer le '\n' final
-        line[strcspn(line, "\n")] = '\0';
+    char *save = NULL;
+    for (char *line = strtok_r(text, "\n", &save); line; line = strtok_r(NULL, "\n", &save)) {
+        line[strcspn(line, "\r")] = '\0';
+        if (line[0] == '#' || line[0] == '\0') continue;
         // Découper en pseudo:priority
-        char *p1 = strtok(line, ":");
-        char *p2 = strtok(NULL, ":");
-        if (!p1 || !p2) continue;
-        users[idx].pseudo = strdup(p1);
-        users[idx].priority = atoi(p2);
-        idx++;
+        char *colon = strchr(line, ':');
+        if (!colon || colon == line || colon[1] == '\0') continue;
+        *colon = '\0';
+        directory_insert(d, line, atoi(colon + 1));
     }
-    user_count = idx;
-    fclose(f);
-    return user_count;
+    return d;
+}
+
+// Publie next et libère l'ancien annuaire après le délai de grâce
+static void directory_swap(Directory *next) {
+    Directory *old = __atomic_exchange_n(&current, next, __ATOMIC_SEQ_CST);
+    unsigned long e = __atomic_fetch_add(&epoch, 1, __ATOMIC_SEQ_CST);
+    struct timespec pause = { 0, 100 * 1000 };
+    while (__atomic_load_n(&readers[e & 1], __ATOMIC_SEQ_CST) > 0) nanosleep(&pause, NULL);
+    directory_free(old);
+}
+
+int load_users(const char *filename) {
+    pthread_mutex_lock(&reload_mutex);
+    Directory *d = directory_build(filename);
+    if (!d) {
+        pthread_mutex_unlock(&reload_mutex);
+        return -1;
+    }
+    if (!users_path || strcmp(users_path, filename) != 0) {
+        free(users_path);
+        users_path = strdup(filename);
+    }
+    int count = d->count;
+    directory_swap(d);
+    pthread_mutex_unlock(&reload_mutex);
+    return count;
 }
 
 bool find_user_priority(const char *pseudo, int *out_priority) {
-    for (int i = 0; i < user_count; i++) {
-        if (strcmp(pseudo, users[i].pseudo) == 0) {
-            *out_priority = users[i].priority;
-            return true;
+    unsigned long e = reader_enter();
+    const Directory *d = __atomic_load_n(&current, __ATOMIC_SEQ_CST);
+    bool found = false;
+    if (d) {
+        uint32_t h = user_hash(pseudo);
+        for (uint32_t i = h & d->mask; d->slots[i].pseudo; i = (i + 1) & d->mask) {
+            if (d->slots[i].hash == h && strcmp(d->slots[i].pseudo, pseudo) == 0) {
+                *out_priority = d->slots[i].priority;
+                found = true;
+                break;
+            }
+        }
+    }
+    reader_leave(e);
+    return found;
+}
+
+int userauth_count(void) {
+    unsigned long e = reader_enter();
+    const Directory *d = __atomic_load_n(&current, __ATOMIC_SEQ_CST);
+    int n = d ? d->count : 0;
+    reader_leave(e);
+    return n;
+}
+
+void userauth_request_reload(void) {
+    if (reloader_started) sem_post(&reload_sem);
+}
+
+static void on_sighup(int sig) {
+    (void)sig;
+    userauth_request_reload();
+}
+
+static void *reloader_thread(void *arg) {
+    (void)arg;
+    for (;;) {
+        if (sem_wait(&reload_sem) < 0) {
+            if (errno == EINTR) continue;
+            break;
         }
+        // Demandes groupées : une relecture suffit
+        while (sem_trywait(&reload_sem) == 0) {}
+        pthread_mutex_lock(&reload_mutex);
+        char *path = users_path ? strdup(users_path) : NULL;
+        pthread_mutex_unlock(&reload_mutex);
+        if (!path) continue;
+        int n = load_users(path);
+        if (n < 0) log_internal("Annuaire %s : rechargement impossible, ancien annuaire conservé", path);
+        else log_internal("Annuaire %s rechargé : %d utilisateur(s)", path, n);
+        free(path);
     }
-    return false;
+    return NULL;
+}
+
+int userauth_start_reloader(void) {
+    if (reloader_started) return 0;
+    if (sem_init(&reload_sem, 0, 0) < 0) return -1;
+    pthread_t tid;
+    if (pthread_create(&tid, NULL, reloader_thread, NULL) != 0) return -1;
+    pthread_detach(tid);
+    reloader_started = true;
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_sighup;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = SA_RESTART;
+    return sigaction(SIGHUP, &sa, NULL);
 }
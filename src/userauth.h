@@ -3,13 +3,30 @@
 
 #include <stdbool.h>
 
-// Charge tous les utilisateurs depuis le fichier filename (ex : "users.txt").
-// Retourne le nombre d’utilisateurs chargés, ou -1 en cas d’erreur (fichier introuvable, malloc échoué).
+// Annuaire des utilisateurs : table de hachage à adressage ouvert, publiée
+// par un pointeur atomique. Un rechargement construit une nouvelle table à
+// côté puis la substitue ; l'ancienne est libérée quand plus aucune lecture
+// ne peut la tenir (style RCU). Les recherches ne prennent aucun verrou.
+
+// Charge tous les utilisateurs depuis le fichier filename (ex : "users.txt")
+// et remplace l'annuaire courant ; filename est retenu pour les rechargements.
+// Retourne le nombre d’utilisateurs chargés, ou -1 en cas d’erreur (fichier
+// introuvable, malloc échoué) : l'annuaire courant est alors conservé.
 int load_users(const char *filename);
 
-// Recherche le pseudo dans la liste chargée.
+// Recherche le pseudo dans l'annuaire courant.
 // Si trouvé, stocke la priorité dans *out_priority (0, 1, 2), retourne true.
 // Sinon, retourne false.
 bool find_user_priority(const char *pseudo, int *out_priority);
 
+// Nombre d'utilisateurs de l'annuaire courant.
+int userauth_count(void);
+
+// Démarre le thread de rechargement et installe le gestionnaire de SIGHUP.
+int userauth_start_reloader(void);
+
+// Demande un rechargement au thread (utilisable depuis un gestionnaire de
+// signal) ; sans thread démarré, la demande est ignorée.
+void userauth_request_reload(void);
+
 #endif // USERAUTH_H
@@ -1,5 +1,12 @@
+#define _GNU_SOURCE
 #include "utils.h"
+#include <fcntl.h>
 #include <errno.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+#include <stdint.h>
+#include <string.h>
 
 ssize_t read_n_bytes(int fd, void *buffer, size_t n) {
     size_t total = 0;
@@ -29,3 +36,244 @@ ssize_t write_n_bytes(int fd, const void *buffer, size_t n) {
     }
     return total;
 }
+
+ssize_t writev_all(int fd, struct iovec *iov, int iovcnt) {
+    size_t total = 0;
+    while (iovcnt > 0) {
+        ssize_t w = writev(fd, iov, iovcnt);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                // Socket non bloquant plein : on attend qu'il se vide
+                struct pollfd pfd = { .fd = fd, .events = POLLOUT };
+                poll(&pfd, 1, -1);
+                continue;
+            }
+            return -1;
+        }
+        total += w;
+        while (iovcnt > 0 && (size_t)w >= iov->iov_len) {
+            w -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if (iovcnt > 0) {
+            iov->iov_base = (char *)iov->iov_base + w;
+            iov->iov_len -= w;
+        }
+    }
+    return total;
+}
+
+static void wait_fd(int fd, short events) {
+    struct pollfd pfd = { .fd = fd, .events = events };
+    poll(&pfd, 1, -1);
+}
+
+// Repli par copie quand splice n'est pas supporté pour ces descripteurs
+static ssize_t copy_n_bytes(int in_fd, int out_fd, size_t n) {
+    char buf[16384];
+    size_t total = 0;
+    while (total < n) {
+        size_t want = n - total < sizeof(buf) ? n - total : sizeof(buf);
+        ssize_t r = read(in_fd, buf, want);
+        if (r < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) { wait_fd(in_fd, POLLIN); continue; }
+            return -1;
+        }
+        if (r == 0) return -1;
+        struct iovec iov = { .iov_base = buf, .iov_len = (size_t)r };
+        if (writev_all(out_fd, &iov, 1) < 0) return -1;
+        total += r;
+    }
+    return total;
+}
+
+ssize_t splice_n_bytes(int in_fd, int out_fd, size_t n) {
+    size_t total = 0;
+    while (total < n) {
+        ssize_t s = splice(in_fd, NULL, out_fd, NULL, n - total,
+                           SPLICE_F_MOVE | SPLICE_F_NONBLOCK | SPLICE_F_MORE);
+        if (s > 0) {
+            total += s;
+            continue;
+        }
+        if (s == 0) return -1;
+        if (errno == EINTR) continue;
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            wait_fd(in_fd, POLLIN);
+            wait_fd(out_fd, POLLOUT);
+            continue;
+        }
+        if (errno == EINVAL || errno == ENOSYS) {
+            ssize_t c = copy_n_bytes(in_fd, out_fd, n - total);
+            return c < 0 ? -1 : (ssize_t)n;
+        }
+        return -1;
+    }
+    return total;
+}
+
+// Repli quand sendfile n'est pas supporté : projection du fichier, puis write
+static ssize_t mmap_send_n_bytes(int out_fd, int in_fd, off_t offset, size_t n) {
+    long page = sysconf(_SC_PAGESIZE);
+    off_t base = offset & ~((off_t)page - 1);
+    size_t delta = (size_t)(offset - base);
+    char *map = mmap(NULL, delta + n, PROT_READ, MAP_PRIVATE, in_fd, base);
+    if (map == MAP_FAILED) return -1;
+    madvise(map, delta + n, MADV_SEQUENTIAL);
+    struct iovec iov = { .iov_base = map + delta, .iov_len = n };
+    ssize_t w = writev_all(out_fd, &iov, 1);
+    munmap(map, delta + n);
+    return w < 0 ? -1 : (ssize_t)n;
+}
+
+ssize_t sendfile_n_bytes(int out_fd, int in_fd, off_t offset, size_t n) {
+    size_t total = 0;
+    while (total < n) {
+        ssize_t s = sendfile(out_fd, in_fd, &offset, n - total);
+        if (s > 0) {
+            total += s;
+            continue;
+        }
+        if (s == 0) return -1;      // fichier tronqué entre-temps
+        if (errno == EINTR) continue;
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            wait_fd(out_fd, POLLOUT);
+            continue;
+        }
+        if (errno == EINVAL || errno == ENOSYS) {
+            ssize_t m = mmap_send_n_bytes(out_fd, in_fd, offset, n - total);
+            return m < 0 ? -1 : (ssize_t)n;
+        }
+        return -1;
+    }
+    return total;
+}
+
+// XXH64 (Yann Collet), version en un seul appel : 4 accumulateurs sur des
+// bandes de 32 octets, puis la queue et le mélange final.
+#define XXH_P1 0x9E3779B185EBCA87ULL
+#define XXH_P2 0xC2B2AE3D27D4EB4FULL
+#define XXH_P3 0x165667B19E3779F9ULL
+#define XXH_P4 0x85EBCA77C2B2AE63ULL
+#define XXH_P5 0x27D4EB2F165667C5ULL
+
+static inline uint64_t xxh_rotl(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+
+static inline uint64_t xxh_read64(const uint8_t *p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;       // petit-boutiste (x86, arm64)
+}
+
+static inline uint32_t xxh_read32(const uint8_t *p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint64_t xxh_round(uint64_t acc, uint64_t in) {
+    acc += in * XXH_P2;
+    acc = xxh_rotl(acc, 31);
+    return acc * XXH_P1;
+}
+
+static inline uint64_t xxh_merge(uint64_t acc, uint64_t v) {
+    acc ^= xxh_round(0, v);
+    return acc * XXH_P1 + XXH_P4;
+}
+
+// Queue (moins de 32 octets) et mélange final, h contenant déjà la longueur
+static uint64_t xxh_finish(uint64_t h, const uint8_t *p, const uint8_t *end) {
+    for (; p + 8 <= end; p += 8) {
+        h ^= xxh_round(0, xxh_read64(p));
+        h = xxh_rotl(h, 27) * XXH_P1 + XXH_P4;
+    }
+    if (p + 4 <= end) {
+        h ^= (uint64_t)xxh_read32(p) * XXH_P1;
+        h = xxh_rotl(h, 23) * XXH_P2 + XXH_P3;
+        p += 4;
+    }
+    for (; p < end; p++) {
+        h ^= *p * XXH_P5;
+        h = xxh_rotl(h, 11) * XXH_P1;
+    }
+    h ^= h >> 33;
+    h *= XXH_P2;
+    h ^= h >> 29;
+    h *= XXH_P3;
+    h ^= h >> 32;
+    return h;
+}
+
+static uint64_t xxh_converge(const uint64_t v[4]) {
+    uint64_t h = xxh_rotl(v[0], 1) + xxh_rotl(v[1], 7) + xxh_rotl(v[2], 12) + xxh_rotl(v[3], 18);
+    for (int i = 0; i < 4; i++) h = xxh_merge(h, v[i]);
+    return h;
+}
+
+uint64_t xxh64(const void *data, size_t len, uint64_t seed) {
+    const uint8_t *p = data, *end = p + len;
+    uint64_t h;
+    if (len >= 32) {
+        uint64_t v1 = seed + XXH_P1 + XXH_P2, v2 = seed + XXH_P2, v3 = seed, v4 = seed - XXH_P1;
+        const uint8_t *limit = end - 32;
+        do {
+            v1 = xxh_round(v1, xxh_read64(p));
+            v2 = xxh_round(v2, xxh_read64(p + 8));
+            v3 = xxh_round(v3, xxh_read64(p + 16));
+            v4 = xxh_round(v4, xxh_read64(p + 24));
+            p += 32;
+        } while (p <= limit);
+        uint64_t v[4] = { v1, v2, v3, v4 };
+        h = xxh_converge(v);
+    } else {
+        h = seed + XXH_P5;
+    }
+    return xxh_finish(h + (uint64_t)len, p, end);
+}
+
+void xxh64_init(Xxh64State *s, uint64_t seed) {
+    s->v[0] = seed + XXH_P1 + XXH_P2;
+    s->v[1] = seed + XXH_P2;
+    s->v[2] = seed;
+    s->v[3] = seed - XXH_P1;
+    s->seed = seed;
+    s->total = 0;
+    s->buf_len = 0;
+}
+
+static inline void xxh_stripe(uint64_t v[4], const uint8_t *p) {
+    v[0] = xxh_round(v[0], xxh_read64(p));
+    v[1] = xxh_round(v[1], xxh_read64(p + 8));
+    v[2] = xxh_round(v[2], xxh_read64(p + 16));
+    v[3] = xxh_round(v[3], xxh_read64(p + 24));
+}
+
+void xxh64_update(Xxh64State *s, const void *data, size_t len) {
+    const uint8_t *p = data, *end = p + len;
+    s->total += len;
+    // Compléter d'abord la bande laissée par le morceau précédent
+    if (s->buf_len > 0) {
+        size_t k = 32 - s->buf_len;
+        if (k > len) k = len;
+        memcpy(s->buf + s->buf_len, p, k);
+        s->buf_len += k;
+        p += k;
+        if (s->buf_len < 32) return;
+        xxh_stripe(s->v, s->buf);
+        s->buf_len = 0;
+    }
+    uint64_t v[4] = { s->v[0], s->v[1], s->v[2], s->v[3] };
+    for (; p + 32 <= end; p += 32) xxh_stripe(v, p);
+    memcpy(s->v, v, sizeof(v));
+    s->buf_len = (size_t)(end - p);
+    memcpy(s->buf, p, s->buf_len);
+}
+
+uint64_t xxh64_digest(const Xxh64State *s) {
+    uint64_t h = s->total >= 32 ? xxh_converge(s->v) : s->seed + XXH_P5;
+    return xxh_finish(h + s->total, s->buf, s->buf + s->buf_len);
+}
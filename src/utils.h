@@ -2,8 +2,37 @@
 #define UTILS_H
 
 #include <unistd.h>
+#include <sys/uio.h>
+#include <stdint.h>
 
 ssize_t read_n_bytes(int fd, void *buffer, size_t n);
 ssize_t write_n_bytes(int fd, const void *buffer, size_t n);
+// Écrit tous les iovec (modifiés au passage) ; attend sur EAGAIN.
+ssize_t writev_all(int fd, struct iovec *iov, int iovcnt);
+// Déplace exactement n octets de in_fd vers out_fd avec splice() (l'un des deux
+// doit être un tube), sans passer par l'espace utilisateur. Attend sur EAGAIN.
+// Si le noyau refuse splice, retombe sur read/write. Retourne n, ou -1.
+ssize_t splice_n_bytes(int in_fd, int out_fd, size_t n);
+// Envoie exactement n octets du fichier in_fd (à partir de offset) sur out_fd
+// avec sendfile(), sans copie en espace utilisateur. Si le noyau refuse
+// sendfile, retombe sur mmap + write. Retourne n, ou -1.
+ssize_t sendfile_n_bytes(int out_fd, int in_fd, off_t offset, size_t n);
+
+// Empreinte XXH64 de len octets (identique à xxhsum -H1).
+uint64_t xxh64(const void *data, size_t len, uint64_t seed);
+
+// XXH64 calculée au fil de l'eau, morceau par morceau : même résultat que
+// xxh64() sur la concaténation des morceaux.
+typedef struct {
+    uint64_t v[4];
+    uint64_t seed;
+    uint64_t total;
+    uint8_t buf[32];            // bande incomplète en attente
+    size_t buf_len;
+} Xxh64State;
+
+void xxh64_init(Xxh64State *s, uint64_t seed);
+void xxh64_update(Xxh64State *s, const void *data, size_t len);
+uint64_t xxh64_digest(const Xxh64State *s);
 
 #endif // UTILS_H
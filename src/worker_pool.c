@@ -0,0 +1,424 @@
+#include "worker_pool.h"
+#include "scheduler_helpers.h"
+#include "metrics.h"
+#include "levelctl.h"
+#include "log.h"
+#include "protocol.h"
+#include "netio.h"
+#include <sched.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+// Tous les GLOBAL_POLL_INTERVAL quanta, un worker sert la file globale même si
+// sa file locale a mieux : les nouvelles tâches ne restent pas bloquées.
+#define GLOBAL_POLL_INTERVAL 8
+// Délai max d'un worker endormi avant de revérifier les files (ms)
+#define IDLE_WAIT_MS 100
+
+// Bornes d'un quantum dimensionné par le coût. Une tâche alimentée par le
+// réseau ne lit pas plus d'une demi-fenêtre : le client continue d'envoyer
+// pendant que le worker traite.
+#define QUANTUM_MIN (4 * 1024)
+#define QUANTUM_MAX (PROTO_INITIAL_WINDOW / 2)
+#define CACHED_QUANTUM_MAX (4 * 1024 * 1024)
+// Poids d'une nouvelle mesure dans la moyenne mobile du coût
+#define COST_EWMA_ALPHA 0.25
+
+static int task_level(const NetTask *t) {
+    if (t->user_priority < 0) return 0;
+    if (t->user_priority >= NETQUEUE_PRIORITIES) return NETQUEUE_PRIORITIES - 1;
+    return t->user_priority;
+}
+
+// Quantum visant la tranche de temps du niveau (NETQUEUE_SLICE_NS) d'après
+// le coût mesuré de la tâche. Coût encore inconnu : taille fixe selon la
+// priorité (prio0→49152, prio1→32768, prio2→16384), multipliée pour un
+// résultat servi depuis le cache.
+static size_t quantum_for(const NetTask *t) {
+    int level = task_level(t);
+    if (t->cost_ns <= 0) {
+        size_t fixed = (size_t)(NETQUEUE_PRIORITIES - level) * 16384;
+        return t->cached ? fixed * RCACHE_QUANTUM_FACTOR : fixed;
+    }
+    double q = NETQUEUE_SLICE_NS(level) / t->cost_ns;
+    double max = t->cached ? CACHED_QUANTUM_MAX : QUANTUM_MAX;
+    if (q > max) q = max;
+    if (q < QUANTUM_MIN) q = QUANTUM_MIN;
+    return (size_t)q;
+}
+
+// Temps du quantum porté au compte de la tâche. Le coût par octet n'est
+// mesuré que sur un quantum complet (un quantum court a surtout attendu le
+// client), et pas sur le premier, qui paie la création du codec.
+static void account_quantum(NetTask *t, size_t quantum, long before, uint64_t wall_us,
+                            uint64_t cpu_ns) {
+    // Compteurs lus par la console et, pour une tâche parallèle, ajoutés
+    // aussi par les autres workers
+    bool first = __atomic_load_n(&t->service_ns, __ATOMIC_RELAXED) == 0;
+    __atomic_add_fetch(&t->cpu_ns, cpu_ns, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&t->service_ns, wall_us * 1000, __ATOMIC_RELAXED);
+    long done = t->processed_bytes - before;
+    if (first || done <= 0 || ((size_t)done < quantum && t->processed_bytes < t->total_size)) return;
+    double sample = (double)wall_us * 1000 / (double)done;
+    t->cost_ns = t->cost_ns > 0 ? t->cost_ns + COST_EWMA_ALPHA * (sample - t->cost_ns) : sample;
+}
+
+static NetTask *steal_work(WorkerPool *p, Worker *self) {
+    if (__atomic_load_n(&p->local_ready, __ATOMIC_ACQUIRE) == 0) return NULL;
+    // Victimes parcourues à partir du voisin pour répartir les vols
+    for (int i = 1; i < p->nworkers; i++) {
+        Worker *v = &p->workers[(self->id + i) % p->nworkers];
+        NetTask *t = netqueue_dequeue(&v->runq);
+        if (t) {
+            __atomic_sub_fetch(&p->local_ready, 1, __ATOMIC_RELEASE);
+            return t;
+        }
+    }
+    return NULL;
+}
+
+// Choix du prochain quantum : la meilleure clé (priorité puis octets
+// restants) entre file locale et file globale, la file globale étant de
+// toute façon servie tous les GLOBAL_POLL_INTERVAL tours.
+static NetTask *pick_task(WorkerPool *p, Worker *w) {
+    // Partage équitable : la ronde DRR n'existe que dans la file globale
+    if (p->global->policy == NETQUEUE_DRR) return netqueue_dequeue(p->global);
+    int lp, gp;
+    long lrem, grem;
+    bool has_local = netqueue_peek(&w->runq, &lp, &lrem);
+    bool has_global = netqueue_peek(p->global, &gp, &grem);
+    bool poll_global = (++w->picks % GLOBAL_POLL_INTERVAL) == 0;
+
+    if (has_global && (!has_local || poll_global || gp < lp ||
+                       (gp == lp && grem < lrem))) {
+        NetTask *t = netqueue_dequeue(p->global);
+        if (t) return t;
+    }
+    if (has_local) {
+        NetTask *t = netqueue_dequeue(&w->runq);
+        if (t) {
+            __atomic_sub_fetch(&p->local_ready, 1, __ATOMIC_RELEASE);
+            return t;
+        }
+    }
+    return steal_work(p, w);
+}
+
+static void wait_for_work(WorkerPool *p) {
+    NetQueue *g = p->global;
+    pthread_mutex_lock(&g->mutex);
+    if (g->size == 0 && *p->running &&
+        __atomic_load_n(&p->local_ready, __ATOMIC_ACQUIRE) == 0) {
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ts.tv_nsec += IDLE_WAIT_MS * 1000000L;
+        if (ts.tv_nsec >= 1000000000L) { ts.tv_sec++; ts.tv_nsec -= 1000000000L; }
+        __atomic_add_fetch(&p->idle, 1, __ATOMIC_ACQ_REL);
+        pthread_cond_timedwait(&g->cond, &g->mutex, &ts);
+        __atomic_sub_fetch(&p->idle, 1, __ATOMIC_ACQ_REL);
+    }
+    pthread_mutex_unlock(&g->mutex);
+}
+
+// Remet la tâche dans la file locale ; si elle en contient déjà une autre,
+// un worker inactif peut venir la voler. En DRR, retour dans la file
+// globale, qui seule connaît la ronde des utilisateurs.
+static void requeue_local(WorkerPool *p, Worker *w, NetTask *t) {
+    if (p->global->policy == NETQUEUE_DRR) {
+        if (!netqueue_enqueue(p->global, t)) {
+            log_msg(LOG_ERROR, t->task_id, "requeue failed, dropped");
+            nettask_free(t);
+        }
+        return;
+    }
+    if (!netqueue_enqueue(&w->runq, t)) {
+        log_msg(LOG_ERROR, t->task_id, "requeue failed, dropped");
+        nettask_free(t);
+        return;
+    }
+    int ready = __atomic_add_fetch(&p->local_ready, 1, __ATOMIC_RELEASE);
+    if (ready > 1 && __atomic_load_n(&p->idle, __ATOMIC_ACQUIRE) > 0) {
+        pthread_mutex_lock(&p->global->mutex);
+        pthread_cond_signal(&p->global->cond);
+        pthread_mutex_unlock(&p->global->mutex);
+    }
+}
+
+// Part des workers qu'une tâche parallèle peut occuper : tout le pool en
+// priorité 0, la moitié en 1, le quart en 2 (et au-delà, priorité bornée
+// comme pour les files).
+static int parallel_share(const WorkerPool *p, const NetTask *t) {
+    int share = p->nworkers >> task_level(t);
+    return share < 1 ? 1 : share;
+}
+
+typedef struct {
+    WorkerPool *pool;
+    Worker *worker;
+} RequeueCtx;
+
+// Appelé par le mode parallèle dès que la tâche peut repartir, pendant que
+// le worker compresse encore son bloc.
+static void requeue_parallel(NetTask *t, void *arg) {
+    RequeueCtx *rc = arg;
+    t->ready_us = metrics_now_us();
+    requeue_local(rc->pool, rc->worker, t);
+}
+
+static void task_done(Worker *w, NetTask *t, uint64_t end) {
+    metrics_inc(M_TASKS_DONE);
+    metrics_observe(H_TASK_US, end - t->created_us);
+    log_msg(LOG_INFO, t->task_id, "done (worker %d, cpu %.1f ms)", w->id,
+            __atomic_load_n(&t->cpu_ns, __ATOMIC_RELAXED) / 1e6);
+    nettask_free(t);
+}
+
+// Registre des tâches garées (parked_lock tenu)
+static int *parked_count(WorkerPool *p, TaskPark park) {
+    if (park == PARK_OUTPUT) return &p->waiting_output;
+    return park == PARK_BLOCKS ? &p->waiting_blocks : &p->waiting_input;
+}
+
+static void parked_link(WorkerPool *p, NetTask *t, TaskPark park) {
+    t->park = park;
+    t->park_prev = NULL;
+    t->park_next = p->parked;
+    if (p->parked) p->parked->park_prev = t;
+    p->parked = t;
+    (*parked_count(p, park))++;
+}
+
+static void parked_unlink(WorkerPool *p, NetTask *t) {
+    if (t->park_prev) t->park_prev->park_next = t->park_next;
+    else p->parked = t->park_next;
+    if (t->park_next) t->park_next->park_prev = t->park_prev;
+    t->park_prev = t->park_next = NULL;
+    (*parked_count(p, t->park))--;
+}
+
+// Annule le réveil d'une tâche garée (parked_lock tenu) ; false s'il est
+// déjà parti
+static bool parked_cancel(NetTask *t) {
+    if (t->park == PARK_OUTPUT) return netio_unpark_output(t->conn, t);
+    if (t->park == PARK_BLOCKS) return parallel_compress_unpark(t);
+    return taskbuf_unpark(t->input, t);
+}
+
+// Réveil d'une tâche garée, depuis le thread d'E/S qui a reçu ses données
+// ou vidé sa sortie. Elle passe du registre à la file sous le même verrou :
+// la console la trouve toujours quelque part.
+static void task_ready(void *pool, void *task) {
+    WorkerPool *p = pool;
+    NetTask *t = task;
+    pthread_mutex_lock(&p->parked_lock);
+    parked_unlink(p, t);
+    t->ready_us = metrics_now_us();
+    bool ok = netqueue_enqueue(p->global, t);
+    pthread_mutex_unlock(&p->parked_lock);
+    if (!ok) {
+        log_msg(LOG_ERROR, t->task_id, "requeue failed, dropped");
+        nettask_free(t);
+    }
+}
+
+// Gare t sur son tampon d'entrée s'il lui manque des données pour le
+// quantum ; true : la tâche ne nous appartient plus.
+static bool park_for_input(WorkerPool *p, NetTask *t, size_t quantum) {
+    size_t want = task_input_want(t, quantum);
+    if (want == 0) return false;
+    pthread_mutex_lock(&p->parked_lock);
+    bool parked = taskbuf_park(t->input, want, task_ready, p, t);
+    if (parked) parked_link(p, t, PARK_INPUT);
+    pthread_mutex_unlock(&p->parked_lock);
+    return parked;
+}
+
+// Gare t tant que son client n'a pas lu ce qu'elle a déjà produit : sans
+// quoi la sortie s'accumulerait en mémoire sur la connexion ; true : la
+// tâche ne nous appartient plus.
+static bool park_for_output(WorkerPool *p, NetTask *t) {
+    if (!t->conn || netio_output_pending(t->conn) <= CONN_OUT_HIGH) return false;
+    pthread_mutex_lock(&p->parked_lock);
+    bool parked = netio_park_output(t->conn, task_ready, p, t);
+    if (parked) parked_link(p, t, PARK_OUTPUT);
+    pthread_mutex_unlock(&p->parked_lock);
+    return parked;
+}
+
+// Tâche parallèle garée par son détenteur tant que trop de ses blocs
+// attendent d'être émis (verrou de la tâche tenu), puis réveillée par le
+// worker qui en émet un
+static void park_parallel(NetTask *t, bool parked, void *arg) {
+    RequeueCtx *rc = arg;
+    if (!parked) {
+        task_ready(rc->pool, t);
+        return;
+    }
+    pthread_mutex_lock(&rc->pool->parked_lock);
+    parked_link(rc->pool, t, PARK_BLOCKS);
+    pthread_mutex_unlock(&rc->pool->parked_lock);
+}
+
+static MetricHist wait_hist(const NetTask *t) {
+    if (t->user_priority <= 0) return H_WAIT_P0_US;
+    return t->user_priority == 1 ? H_WAIT_P1_US : H_WAIT_P2_US;
+}
+
+static void *worker_thread(void *arg) {
+    Worker *w = arg;
+    WorkerPool *p = w->pool;
+
+    while (*p->running) {
+        NetTask *t = pick_task(p, w);
+        if (!t) {
+            wait_for_work(p);
+            continue;
+        }
+
+        // Client en retard sur la sortie, ou données du quantum pas encore
+        // reçues : la tâche attend hors file, le worker passe à une autre
+        size_t quantum = quantum_for(t);
+        if (park_for_output(p, t) || park_for_input(p, t, quantum)) continue;
+
+        // La tâche n'est dans aucune file pendant son quantum : un seul
+        // worker la traite à la fois et ses sorties restent ordonnées.
+        uint64_t start = metrics_now_us();
+        metrics_observe(wait_hist(t), start - t->ready_us);
+        levelctl_observe_wait(t->user_priority, start - t->ready_us);
+        if (levelctl_due(start)) levelctl_update(start, worker_pool_pending(p), p->nworkers);
+        uint64_t cpu0 = metrics_thread_cpu_ns();
+        if (t->parallel) {
+            // La tâche est remise en file (ou garée) par le handler lui-même
+            RequeueCtx rc = { p, w };
+            bool done = handle_parallel_compress_partial(t, parallel_share(p, t),
+                                                         requeue_parallel, park_parallel, &rc);
+            uint64_t end = metrics_now_us();
+            metrics_observe(H_QUANTUM_US, end - start);
+            metrics_inc(M_QUANTA);
+            if (done) task_done(w, t, end);
+            continue;
+        }
+        long before = t->processed_bytes;
+        if (t->cached) {
+            handle_cached_partial(t, quantum);
+        } else if (t->type == TASK_COMPRESS) {
+            handle_streaming_compress_partial(t, quantum);
+        } else {
+            handle_streaming_convert_partial(t, quantum);
+        }
+        uint64_t end = metrics_now_us();
+        metrics_observe(H_QUANTUM_US, end - start);
+        metrics_inc(M_QUANTA);
+        account_quantum(t, quantum, before, end - start, metrics_thread_cpu_ns() - cpu0);
+
+        if (t->processed_bytes < t->total_size) {
+            t->ready_us = end;
+            requeue_local(p, w, t);
+        } else {
+            task_done(w, t, end);
+        }
+    }
+    return NULL;
+}
+
+int worker_pool_default_size(void) {
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int)n : 1;
+}
+
+int worker_pool_start(WorkerPool *p, NetQueue *global, int nworkers, bool *running) {
+    if (nworkers < 1) nworkers = 1;
+    p->global = global;
+    p->nworkers = nworkers;
+    p->local_ready = 0;
+    p->idle = 0;
+    p->waiting_input = 0;
+    p->waiting_output = 0;
+    p->waiting_blocks = 0;
+    pthread_mutex_init(&p->parked_lock, NULL);
+    p->parked = NULL;
+    p->running = running;
+    p->workers = calloc(nworkers, sizeof(Worker));
+    if (!p->workers) return -1;
+
+    for (int i = 0; i < nworkers; i++) {
+        Worker *w = &p->workers[i];
+        w->id = i;
+        w->pool = p;
+        netqueue_init(&w->runq);
+    }
+    for (int i = 0; i < nworkers; i++) {
+        Worker *w = &p->workers[i];
+        if (pthread_create(&w->thread, NULL, worker_thread, w) != 0) {
+            log_msg(LOG_ERROR, -1, "Worker %d: pthread_create failed", i);
+            p->nworkers = i;
+            return i > 0 ? 0 : -1;
+        }
+        pthread_detach(w->thread);
+    }
+    log_internal("Scheduler pool: %d workers, %s", nworkers,
+                 global->policy == NETQUEUE_DRR ? "drr" : "srpt");
+    return 0;
+}
+
+void worker_pool_foreach(WorkerPool *p, void (*fn)(NetTask *t, void *ctx), void *ctx) {
+    netqueue_foreach(p->global, fn, ctx);
+    for (int i = 0; i < p->nworkers; i++) {
+        netqueue_foreach(&p->workers[i].runq, fn, ctx);
+    }
+    pthread_mutex_lock(&p->parked_lock);
+    for (NetTask *t = p->parked; t; t = t->park_next) fn(t, ctx);
+    pthread_mutex_unlock(&p->parked_lock);
+}
+
+NetTask *worker_pool_remove(WorkerPool *p, int task_id) {
+    NetTask *t = netqueue_remove(p->global, task_id);
+    if (t) return t;
+    for (int i = 0; i < p->nworkers; i++) {
+        t = netqueue_remove(&p->workers[i].runq, task_id);
+        if (t) {
+            __atomic_sub_fetch(&p->local_ready, 1, __ATOMIC_RELEASE);
+            return t;
+        }
+    }
+    // Garée : son réveil est annulé. S'il est déjà parti, task_ready va la
+    // passer du registre à la file globale, où on la reprend.
+    for (bool retry = false;; retry = true) {
+        pthread_mutex_lock(&p->parked_lock);
+        t = p->parked;
+        while (t && t->task_id != task_id) t = t->park_next;
+        bool mine = t && parked_cancel(t);
+        if (mine) parked_unlink(p, t);
+        pthread_mutex_unlock(&p->parked_lock);
+        if (mine) return t;
+        if (!t && !retry) return NULL;
+        NetTask *q = netqueue_remove(p->global, task_id);
+        if (q || !t) return q;
+        sched_yield();
+    }
+}
+
+int worker_pool_pending(WorkerPool *p) {
+    pthread_mutex_lock(&p->global->mutex);
+    int n = p->global->size;
+    pthread_mutex_unlock(&p->global->mutex);
+    pthread_mutex_lock(&p->parked_lock);
+    n += p->waiting_blocks;
+    pthread_mutex_unlock(&p->parked_lock);
+    return n + __atomic_load_n(&p->local_ready, __ATOMIC_ACQUIRE);
+}
+
+int worker_pool_waiting_input(WorkerPool *p) {
+    pthread_mutex_lock(&p->parked_lock);
+    int n = p->waiting_input;
+    pthread_mutex_unlock(&p->parked_lock);
+    return n;
+}
+
+int worker_pool_waiting_output(WorkerPool *p) {
+    pthread_mutex_lock(&p->parked_lock);
+    int n = p->waiting_output;
+    pthread_mutex_unlock(&p->parked_lock);
+    return n;
+}
@@ -0,0 +1,57 @@
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+#include <stdbool.h>
+#include <pthread.h>
+#include "netqueue.h"
+
+struct WorkerPool;
+
+// Un worker d'ordonnancement : un thread + sa propre file de tâches.
+typedef struct {
+    int id;
+    pthread_t thread;
+    NetQueue runq;              // file locale, servie aussi aux voleurs
+    unsigned long picks;        // nombre de quanta choisis (équité vs file globale)
+    struct WorkerPool *pool;
+} Worker;
+
+typedef struct WorkerPool {
+    NetQueue *global;           // file d'injection des nouvelles tâches
+    Worker *workers;
+    int nworkers;
+    int local_ready;            // tâches en files locales (atomique)
+    int idle;                   // workers endormis (atomique)
+    int waiting_input;          // tâches garées en attente de données (parked_lock)
+    int waiting_output;         // tâches garées en attente du client (parked_lock)
+    int waiting_blocks;         // tâches parallèles garées sur leurs blocs (parked_lock)
+    pthread_mutex_t parked_lock;
+    NetTask *parked;            // registre des tâches garées hors file
+    bool *running;
+} WorkerPool;
+
+// Nombre de workers par défaut : un par cœur en ligne.
+int worker_pool_default_size(void);
+
+// Démarre nworkers threads consommant global. Retourne 0, ou -1 en cas d'erreur.
+int worker_pool_start(WorkerPool *p, NetQueue *global, int nworkers, bool *running);
+
+// Parcourt toutes les tâches en attente (file globale, files locales, puis
+// tâches garées faute de données, faute de lecture du client ou le temps
+// que leurs blocs parallèles soient émis).
+void worker_pool_foreach(WorkerPool *p, void (*fn)(NetTask *t, void *ctx), void *ctx);
+
+// Retire une tâche en attente où qu'elle soit, NULL si introuvable. Une
+// tâche garée perd son réveil : elle appartient ensuite à l'appelant.
+NetTask *worker_pool_remove(WorkerPool *p, int task_id);
+
+// Nombre total de tâches en attente, y compris les tâches parallèles garées
+// sur leurs blocs : elles repartent dès qu'un bloc est émis.
+int worker_pool_pending(WorkerPool *p);
+
+// Tâches hors file jusqu'à réception des données de leur prochain quantum.
+int worker_pool_waiting_input(WorkerPool *p);
+// Tâches hors file tant que leur client n'a pas lu la sortie déjà produite.
+int worker_pool_waiting_output(WorkerPool *p);
+
+#endif // WORKER_POOL_H